@@ -9,23 +9,157 @@
 //   - Setas (UP/DOWN/LEFT/RIGHT) controlam o carro (aceleração, freio, esterço).
 //   - WASD/QE controlam a câmera (movimento livre tipo "voo" em XZ e altura Y).
 //   - R: reseta a cena.
+//   - P: baliza automática (planeja até a vaga e segue; setas devolvem o controle).
 //   - ESC: sai da aplicação.
 //
+// MODO BATCH (sem janela):
+//   projeto.exe --batch [carros] [passos] [threads] [--fork-at passo]
+//   Simula N carros independentes (SoA + SIMD + threads) e confere contra o caminho de um carro.
+//
+// PASSO FIXO:
+//   projeto.exe --hz 240   (frequência da física; o desenho interpola entre os passos)
+//
+// SIMULAÇÃO EM THREAD PRÓPRIA:
+//   A física roda em sua thread no ritmo de --hz e entrega snapshots ao display() por um triple
+//   buffer; as teclas viram eventos com horário. O HUD mostra a latência entrada->tela.
+//   projeto.exe --single-thread   (física no loop do GLUT, como antes, para comparação)
+//   projeto --headless 3000 --realtime [--single-thread]   (mede a latência sem janela)
+//
+// REBOBINAGEM:
+//   Tecla B segurada volta no tempo; V volta 5 s. Keyframes a cada 1 s e 2 bytes de entradas por
+//   passo num buffer fixo (--rewind-sec 300); voltar refaz no máximo 1 s de física.
+//   projeto.exe --bench-rewind [segundos]   (confere e mede as buscas na história)
+//   projeto.exe --batch 100000 600 --fork-at 500   (lote parte do estado salvo no passo 500;
+//   confere que retomar desse estado refaz a corrida direta)
+//
+// MALHAS PRÉ-PROCESSADAS:
+//   projeto.exe --bake-meshes [malhas.bin]   (quantiza, une vértices e otimiza para o cache;
+//   mostra faltas/triângulo e bytes/vértice antes e depois)
+//   projeto.exe --meshes arquivo   (padrão malhas.bin; sem o arquivo o processamento roda na carga)
+//
+// MUNDO ABERTO:
+//   projeto.exe --open-world [--ground-cache-mb 16]   (sem borda; o chão é gerado em blocos de 8 m
+//   por threads auxiliares, enviado por PBO e guardado num cache LRU de tamanho fixo)
+//   Tecla C: câmera segue o carro (ligada por padrão no mundo aberto).
+//
+// TEXTURA DO ASFALTO:
+//   projeto.exe --tex 4096 --seed 7   (tamanho e semente; mesma semente gera a mesma textura)
+//   projeto.exe --bench-asphalt       (texels/s do gerador original contra o novo, 256..8192)
+//   Um canal com mipmaps gerados na CPU (SSE2), bilinear no mipmap mais próximo: 4/9 da memória em RGB.
+//   projeto.exe --trilinear           (mistura dois mipmaps; o dobro de leituras de textura)
+//   projeto.exe --tex-cache cache     (grava a cadeia na primeira vez; depois carrega sem gerar)
+//   projeto.exe --no-mipmaps          (só o nível 0, bilinear; mais barato em GL por software)
+//
+// COLISÃO COM CONES:
+//   Cones atingidos pelo carro são derrubados e contados no HUD.
+//   projeto.exe --bench-cones   (custo por passo: grade espacial x força bruta, 1k..1M cones)
+//
+// RENDERIZAÇÃO:
+//   Malhas geradas uma vez em buffers; cones em uma única chamada instanciada (GL 3.3) ou em
+//   uma malha pré-transformada. O HUD mostra draw calls e tempo de submissão da cena.
+//   Mudanças de estado GL passam por um cache que suprime as redundantes (contadas no HUD).
+//   projeto.exe --immediate        (modo imediato antigo, para comparação)
+//   projeto.exe --no-instancing    (força o caminho sem instancing)
+//   Cones e carro fora do frustum são descartados; cones e rodas usam 3 níveis de detalhe
+//   pelo tamanho projetado (contagens no HUD).
+//   projeto.exe --no-cull          (desenha tudo no nível máximo, para comparação)
+//
+// HEADLESS (sem janela, ex.: servidor sem GPU com Mesa llvmpipe):
+//   projeto --headless [frames] [--out dir] [--size 1280x720] [--capture-every N]
+//   Renderiza offscreen e grava frame_NNNNNN.ppm em 'dir' numa thread separada.
+//   Linux: g++ -O2 -DHEADLESS_EGL projeto.cpp -lglut -lGLU -lGL -lEGL -pthread -o projeto
+//
+// RASTERIZADOR POR SOFTWARE:
+//   projeto.exe --soft-raster [--soft-threads N]   (cena, luz, textura e HUD desenhados na CPU,
+//   em blocos de 64x64 com SSE2 e threads; a janela só mostra o frame pronto)
+//   projeto --headless 240 --soft-raster --out frames   (sem contexto GL nem -DHEADLESS_EGL)
+//   projeto --bench-raster [frames]   (frames/s contra o GL headless em 640x360..3840x2160)
+//
+// SUÍTE DE BENCHMARKS:
+//   projeto.exe --bench-suite [--json bench.json] [--label texto]   (física, asfalto, cones e
+//   desenho com N cones: ns/op, itens/s e alocações por operação, gravados em JSON)
+//   As alocações só são contadas compilando com -DBENCH_ALLOC=1 (operator new global com contador).
+//
+// PROFILER (compile com -DPROFILER=1):
+//   Tempos por estágio (física, luzes, chão, cones, carro, HUD) em CPU e GPU, p50/p95/p99 no
+//   HUD e CSV dos últimos 4096 frames na saída (--profile-csv arquivo, padrão profile.csv).
+//
+// HUD:
+//   Texto desenhado de um atlas de glifos (uma chamada por linha, reformatado só quando muda).
+//   projeto.exe --legacy-hud   (glutBitmapCharacter por caractere; o HUD mostra o tempo de frame)
+//
+// PERCURSO EM ARQUIVO:
+//   projeto.exe --course-convert percurso.txt percurso.course   (texto -> binário com índice espacial)
+//   projeto.exe --course percurso.course   (mapeado na memória; cones usados sem cópia)
+//   projeto.exe --course-info percurso.course   (cabeçalho, tempo de carga e consulta de colisão)
+//
+// BALIZA AUTOMÁTICA:
+//   A* híbrido com primitivas do modelo de bicicleta e expansão de nós em paralelo; o caminho
+//   aparece no chão (verde para frente, vermelho de ré) e o carro o segue com as setas.
+//   projeto.exe --autopark          (planeja e segue logo ao iniciar; --plan-threads N, padrão 1)
+//   projeto.exe --bench-planner [poses] [threads]   (tempo de plano e chegada à vaga)
+//   Tecla M: avalia o percurso com motoristas aleatórios (Monte Carlo em segundo plano, num pool
+//   de threads com roubo de trabalho); o HUD mostra quantos estacionam e a melhor tentativa
+//   aparece no chão quando a avaliação termina, sem parar a simulação.
+//   projeto.exe --eval-course [tentativas] [threads]   (escala por threads; --eval-rollouts N)
+//   A tecla M usa todas as threads do processador (--eval-threads N para limitar).
+//
+// TELEMETRIA:
+//   projeto.exe --record voltas.tlm     (estado e entradas de cada passo, gravados em segundo plano)
+//   projeto.exe --replay voltas.tlm     (refaz a simulação com as entradas gravadas e confere o estado)
+//   projeto.exe --telemetry-csv voltas.tlm voltas.csv   (converte para CSV)
+//
 // COMANDO DE COMPILAÇÃO (GCC/MinGW):
-// g++ projeto.cpp -lfreeglut -lglu32 -lopengl32 -lgdi32 -o projeto.exe
+// g++ -O2 projeto.cpp -lfreeglut -lglu32 -lopengl32 -lgdi32 -o projeto.exe
+// (opcional: -mavx para o kernel do modo batch usar 8 faixas em vez de 4; com -mfma, acrescente
+//  -ffp-contract=off para que o caminho escalar continue idêntico ao SIMD)
 
 #include <GL/freeglut.h> // Inclui FreeGLUT e, indiretamente, OpenGL.
-#include <cmath>         // Funções matemáticas (sinf, cosf, tanf, fabsf).
-#include <cstdlib>       // Funções gerais (rand, srand).
-#include <ctime>         // Funções de tempo (time) para inicialização do rand.
-#include <vector>        // Uso do std::vector para armazenar as posições dos cones.
-#include <iostream>      // Entrada/Saída padrão (não essencial, mas comum).
-#include <cstdio>        // snprintf para formatar texto no HUD.
-#include <string>        // Para uso de std::string no HUD.
+#include <GL/glext.h>    // Tipos das funções GL > 1.1 (VBO, shaders, instancing).
+#include <cmath>         // Funções matemáticas (sinf, cosf, tanf, fabsf).
+#include <cstdlib>       // Funções gerais (rand, srand).
+#include <ctime>         // Funções de tempo (time) para inicialização do rand.
+#include <vector>        // Uso do std::vector para armazenar as posições dos cones.
+#include <iostream>      // Entrada/Saída padrão (não essencial, mas comum).
+#include <cstdio>        // snprintf para formatar texto no HUD.
+#include <string>        // Para uso de std::string no HUD.
+#include <cstring>       // memcmp/strcmp (modo batch e argumentos de linha de comando).
+#include <cerrno>        // errno nas falhas de gravação dos frames.
+#include <algorithm>     // std::min/std::max.
+#include <atomic>        // Contador de blocos compartilhado entre threads.
+#include <thread>        // Threads do modo batch.
+#include <chrono>        // Medição de tempo do modo batch.
+#include <unordered_map> // Grade espacial (hash de células) dos cones.
+#include <mutex>         // Fila do gravador de frames (modo headless).
+#include <condition_variable>
+#include <deque>
+#include <queue>         // Filas de prioridade do planejador de baliza.
+#include <memory>        // Caminho do piloto automático compartilhado com o desenho.
+#include <filesystem>    // Cria o diretório de saída dos frames.
+#include <cstdint>       // Tipos de largura fixa do arquivo de percurso.
+#include <new>           // operator new contado pela suíte de benchmarks (-DBENCH_ALLOC=1).
+#ifdef _WIN32
+#include <windows.h>     // Mapeamento do arquivo de percurso (CreateFileMapping).
+#else
+#include <sys/mman.h>    // Mapeamento do arquivo de percurso (mmap).
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef HEADLESS_EGL
+#include <EGL/egl.h>     // Contexto OpenGL sem janela (Mesa surfaceless/llvmpipe).
+#include <EGL/eglext.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>   // Intrinsics AVX (kernel SoA do modo batch).
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>   // Intrinsics SSE2 (kernel SoA, textura e rasterizador por software).
+#endif
 
 // ----------------------- Configuração geral -----------------------
 const int WIN_W = 1000;
 const int WIN_H = 700;
+int winW = WIN_W, winH = WIN_H; // Tamanho atual da janela (atualizado em reshape).
 
 // ----------------------- Câmera (controle WASD) --------------------
 // Estrutura para armazenar o estado da câmera (posição e velocidade).
@@ -33,52 +167,190 @@ struct Camera {
     float x = 0.0f;
     float y = 3.2f; // Altura inicial
     float z = 10.0f;
+    float tx = 0.0f, ty = 0.5f, tz = 0.0f; // Ponto de foco (origem; o carro com followCar).
     float speed = 6.0f; // unidades por segundo para movimento livre
 } cam;
+Camera prevCam; // Câmera no passo de física anterior (interpolada no display).
 
 // Flags booleanas para rastrear o estado das teclas de movimento da câmera.
 bool camForward=false, camBack=false, camLeft=false, camRight=false, camUp=false, camDown=false;
+bool followCar = false; // Tecla C: a câmera segue o carro (padrão no mundo aberto).
+const float CAM_FOLLOW_DIST = 7.0f;  // Distância atrás do carro (m).
+const float CAM_FOLLOW_TAU = 0.3f;   // Constante de tempo da suavização (s).
 
 // ----------------------- Carro (setas) -----------------------------
 // Estrutura para armazenar o estado físico do carro.
 struct Car {
     float x=0.0f;
-    float y=0.25f;      // y é a altura (meia altura do modelo do carro).
+    float y=0.25f;      // y é a altura (meia altura do modelo do carro).
     float z=6.0f;
     float heading=180.0f; // Ângulo de rotação em Y (0=positivo Z, 90=positivo X, 180=negativo Z).
-    float speed=0.0f;   // Velocidade atual do carro (pode ser positiva ou negativa).
+    float speed=0.0f;   // Velocidade atual do carro (pode ser positiva ou negativa).
     float wheelAngle=0.0f; // Ângulo de esterço das rodas dianteiras (em graus).
 } car;
+Car prevCar; // Carro no passo de física anterior (interpolado no display).
 
 // Flags booleanas para rastrear o estado das teclas de controle do carro.
 bool keyUp=false, keyDown=false, keyLeft=false, keyRight=false;
 
 // Parâmetros físicos simplificados.
-const float CAR_ACCEL = 6.0f;   // Aceleração em unidades/s^2 (CORRIGIDO: Renomeado de ACCEL).
-const float BRAKE = 8.0f;       // Desaceleração por freio (não usado diretamente, mas pode ser usado).
-const float FRICTION = 3.0f;    // Desaceleração por fricção/arrasto quando não há input.
+const float CAR_ACCEL = 6.0f;   // Aceleração em unidades/s^2 (CORRIGIDO: Renomeado de ACCEL).
+const float BRAKE = 8.0f;       // Desaceleração por freio (não usado diretamente, mas pode ser usado).
+const float FRICTION = 3.0f;    // Desaceleração por fricção/arrasto quando não há input.
 const float MAX_SPEED = 8.0f;
 const float MAX_REVERSE = -3.0f;
-const float MAX_WHEEL_DEG = 30.0f;    // Ângulo máximo de esterço das rodas.
+const float MAX_WHEEL_DEG = 30.0f;    // Ângulo máximo de esterço das rodas.
 const float WHEEL_SPEED_DEG = 90.0f; // Velocidade de mudança do ângulo de esterço (graus/s).
-const float WHEEL_BASE = 1.0f;      // Distância entre eixos (base para o modelo de bicicleta).
+const float WHEEL_BASE = 1.0f;      // Distância entre eixos (base para o modelo de bicicleta).
 const float PI = 3.14159265f;
 
+// Parâmetros do modelo de bicicleta que podem variar por carro (varreduras no modo batch).
+struct CarParams {
+    float wheelBase = WHEEL_BASE;
+    float maxWheelDeg = MAX_WHEEL_DEG;
+    float friction = FRICTION;
+};
+const CarParams DEFAULT_CAR_PARAMS;
+
+// Entradas (setas) que controlam um carro durante um passo de simulação.
+struct CarInput {
+    bool up=false, down=false, left=false, right=false;
+};
+// Bits de entrada por carro no modo batch e na telemetria (equivalentes a keyUp/keyDown/keyLeft/keyRight).
+const unsigned char IN_UP = 1, IN_DOWN = 2, IN_LEFT = 4, IN_RIGHT = 8;
+
 // ----------------------- Cones (formam corredor) -------------------
-// Armazena as posições (x,z) dos cones.
-std::vector<std::pair<float,float>> cones;
+// Armazena as posições (x,z) dos cones. Percursos montados no programa usam o vetor próprio;
+// percursos carregados de arquivo apontam direto para a memória mapeada (sem cópia).
+struct ConeArray {
+    typedef std::pair<float,float> Cone;
+    std::vector<Cone> owned;
+    const Cone *ptr = nullptr;
+    size_t count = 0;
+    bool external = false;
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Cone &operator[](size_t i) const { return ptr[i]; }
+    const Cone *data() const { return ptr; }
+    void clear() { owned.clear(); ptr = nullptr; count = 0; external = false; }
+    void emplace_back(float x, float z) {
+        owned.emplace_back(x, z);
+        ptr = owned.data(); count = owned.size(); external = false;
+    }
+    void attach(const Cone *p, size_t n) {
+        std::vector<Cone>().swap(owned);
+        ptr = p; count = n; external = true;
+    }
+} cones;
+static_assert(sizeof(ConeArray::Cone) == 2 * sizeof(float), "cones mapeados precisam ser (x, z) contíguos");
+
+// Limites do chão, pose inicial do carro e vaga (região de chegada) do percurso atual.
+struct Course {
+    float groundMinX = -12.0f, groundMinZ = -24.0f, groundMaxX = 12.0f, groundMaxZ = 16.0f;
+    float startX = 0.0f, startZ = 6.0f, startHeading = 180.0f;
+    float goalMinX = -1.2f, goalMinZ = -8.0f, goalMaxX = 1.2f, goalMaxZ = -4.0f;
+
+    bool inGoal(float x, float z) const { return x >= goalMinX && x <= goalMaxX && z >= goalMinZ && z <= goalMaxZ; }
+} course;
+bool openWorld = false; // --open-world: sem limites para o carro e chão infinito em blocos (não vale no modo batch).
 const float CORRIDOR_HALF_WIDTH = 1.2f; // Meia largura do corredor.
-const int NUM_PAIRS = 3;                // Número de pares de cones.
-const float PAIR_SPACING = 3.0f;        // Espaçamento em Z entre os pares.
+const int NUM_PAIRS = 3;                // Número de pares de cones.
+const float PAIR_SPACING = 3.0f;        // Espaçamento em Z entre os pares.
+
+// ----------------------- Cache de estado GL -----------------------
+//
+// Espelha o estado fixo que a cena altera a cada frame (flags de glEnable, textura e programa
+// ligados, parâmetros de luz e material) e só repassa ao GL o que de fato muda. Os contadores
+// de chamadas emitidas e suprimidas no frame aparecem no HUD como métrica de regressão.
+// Quem mexer no estado direto no GL (fora de glPushAttrib/glPopAttrib) deve chamar invalidate().
+
+struct GLStateCache {
+    struct Cap { GLenum cap; bool on; };
+    struct Param { GLenum target, pname; int n; GLfloat v[4]; };
+
+    std::vector<Cap> caps;       // Só as flags já vistas; as ausentes são desconhecidas.
+    std::vector<Param> params;   // Luz (target = GL_LIGHTi), modelo de luz (0), material (face).
+    GLuint texture = 0, program = 0;
+    bool textureKnown = false, programKnown = false;
+    GLenum colorMaterialFace = 0, colorMaterialMode = 0;
+    int issued = 0, suppressed = 0;          // Frame atual.
+    int lastIssued = 0, lastSuppressed = 0;  // Frame anterior (HUD).
+
+    void beginFrame() {
+        lastIssued = issued; lastSuppressed = suppressed;
+        issued = suppressed = 0;
+    }
+    void invalidate() {
+        caps.clear(); params.clear();
+        textureKnown = programKnown = false;
+        colorMaterialFace = colorMaterialMode = 0;
+    }
+    // A posição da luz é guardada em coordenadas de olho: muda junto com a matriz de visão.
+    void viewChanged() {
+        params.erase(std::remove_if(params.begin(), params.end(),
+                                    [](const Param &p) { return p.pname == GL_POSITION; }), params.end());
+    }
+
+    void enable(GLenum cap)  { if(setCap(cap, true)) glEnable(cap); }
+    void disable(GLenum cap) { if(setCap(cap, false)) glDisable(cap); }
+    void bindTexture(GLuint id) {
+        if(textureKnown && texture == id) { suppressed++; return; }
+        texture = id; textureKnown = true; issued++;
+        glBindTexture(GL_TEXTURE_2D, id);
+    }
+    void useProgram(GLuint id);  // Definida junto das funções GL carregadas (glf).
+    void colorMaterial(GLenum face, GLenum mode) {
+        if(colorMaterialFace == face && colorMaterialMode == mode) { suppressed++; return; }
+        colorMaterialFace = face; colorMaterialMode = mode; issued++;
+        glColorMaterial(face, mode);
+    }
+    void lightfv(GLenum light, GLenum pname, const GLfloat *v) { if(setParam(light, pname, 4, v)) glLightfv(light, pname, v); }
+    void lightModelfv(GLenum pname, const GLfloat *v) { if(setParam(0, pname, 4, v)) glLightModelfv(pname, v); }
+    void materialfv(GLenum face, GLenum pname, const GLfloat *v) { if(setParam(face, pname, 4, v)) glMaterialfv(face, pname, v); }
+    void materialf(GLenum face, GLenum pname, GLfloat v) { if(setParam(face, pname, 1, &v)) glMaterialf(face, pname, v); }
+
+private:
+    bool setCap(GLenum cap, bool on) {
+        for(Cap &c : caps)
+            if(c.cap == cap) {
+                if(c.on == on) { suppressed++; return false; }
+                c.on = on; issued++; return true;
+            }
+        caps.push_back({cap, on}); issued++;
+        return true;
+    }
+    bool setParam(GLenum target, GLenum pname, int n, const GLfloat *v) {
+        for(Param &p : params)
+            if(p.target == target && p.pname == pname) {
+                if(memcmp(p.v, v, n * sizeof(GLfloat)) == 0) { suppressed++; return false; }
+                memcpy(p.v, v, n * sizeof(GLfloat)); issued++; return true;
+            }
+        Param p = {target, pname, n, {}};
+        memcpy(p.v, v, n * sizeof(GLfloat));
+        params.push_back(p); issued++;
+        return true;
+    }
+} glState;
 
 // ----------------------- Textura procedural -----------------------
 GLuint texAsphalt = 0;
 const int TEX_SIZE = 256;
+int asphaltTexSize = TEX_SIZE;     // Tamanho da textura gerada na inicialização (--tex N).
+unsigned int asphaltSeed = 1;      // Semente do ruído do asfalto (--seed N); mesma semente, mesma textura.
+bool asphaltMipmaps = true;        // --no-mipmaps: só o nível 0 com filtro bilinear (para comparação).
+bool asphaltTrilinear = false;     // --trilinear: mistura dois níveis (o dobro de leituras de textura).
+
+// Nome do filtro de minificação em uso (saída dos benchmarks).
+const char *asphaltFilterName() {
+    return !asphaltMipmaps ? "bilinear, so o nivel 0" : asphaltTrilinear ? "trilinear" : "bilinear, mipmap mais proximo";
+}
 
 /**
- * Gera uma textura procedural simples que imita asfalto (grayscale noise + streaks).
+ * Gera a versão original da textura (rand() serial, semeado com time()).
+ * Mantida apenas como referência para o microbenchmark (--bench-asphalt).
  */
-void generateAsphaltProc(unsigned char *buf, int size) {
+void generateAsphaltProcRand(unsigned char *buf, int size) {
     // Inicializa o gerador de números aleatórios apenas uma vez.
     static bool seeded = false;
     if(!seeded){ srand((unsigned)time(NULL)); seeded = true; }
@@ -102,65 +374,264 @@ void generateAsphaltProc(unsigned char *buf, int size) {
 }
 
 /**
- * Cria um ID de textura GL a partir de um buffer de dados RGB.
+ * Hash baseado em contador (finalizador do MurmurHash3): cada texel depende só de
+ * (semente, x, y), então qualquer linha pode ser gerada em qualquer ordem ou thread.
+ */
+inline unsigned int asphaltHash(unsigned int seed, unsigned int x, unsigned int y) {
+    unsigned int h = (x + y * 0x9E3779B1u) ^ (seed * 0x85EBCA77u);
+    h ^= h >> 16; h *= 0x85EBCA6Bu;
+    h ^= h >> 13; h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+/**
+ * Valor de cinza de um texel: base (40..79) + ruído (-20..19) + risco diagonal (0..7).
+ * Os três sorteios vêm de faixas de bits diferentes do mesmo hash (11 + 11 + 10 bits).
+ */
+inline unsigned char asphaltTexel(unsigned int seed, int x, int y) {
+    unsigned int h = asphaltHash(seed, (unsigned)x, (unsigned)y);
+    int base = 40 + (int)(((h & 0x7FF) * 40) >> 11);
+    int noise = (int)((((h >> 11) & 0x7FF) * 40) >> 11) - 20;
+    int streak = ((x + y) % 37 < 8) ? (int)(((h >> 22) * 8) >> 10) : 0;
+    return (unsigned char)(base + noise + streak); // Sempre em 20..105, não precisa de clamp.
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// Multiplicação 32x32 -> 32 bits por faixa (SSE2 não tem _mm_mullo_epi32).
+inline __m128i mullo32(__m128i a, __m128i b) {
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0,0,2,0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0,0,2,0)));
+#endif
+}
+
+// asphaltTexel() para 4 texels consecutivos da linha y, sem o risco (aplicado por máscara).
+inline __m128i asphaltTexel4(__m128i seedMix, __m128i yMix, int x) {
+    __m128i h = _mm_xor_si128(_mm_add_epi32(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0,1,2,3)), yMix), seedMix);
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 16)); h = mullo32(h, _mm_set1_epi32((int)0x85EBCA6Bu));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 13)); h = mullo32(h, _mm_set1_epi32((int)0xC2B2AE35u));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+    const __m128i mask11 = _mm_set1_epi32(0x7FF);
+    __m128i b = _mm_and_si128(h, mask11);
+    __m128i n = _mm_and_si128(_mm_srli_epi32(h, 11), mask11);
+    // v * 40 = (v << 5) + (v << 3)
+    b = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(b, 5), _mm_slli_epi32(b, 3)), 11);
+    n = _mm_srli_epi32(_mm_add_epi32(_mm_slli_epi32(n, 5), _mm_slli_epi32(n, 3)), 11);
+    __m128i s = _mm_srli_epi32(_mm_slli_epi32(_mm_srli_epi32(h, 22), 3), 10);
+    // Empacota base+ruído (16 bits) e risco (16 bits) na mesma palavra: [risco << 16 | base+ruído+20].
+    return _mm_or_si128(_mm_add_epi32(_mm_add_epi32(b, n), _mm_set1_epi32(20)), _mm_slli_epi32(s, 16));
+}
+#endif
+
+/**
+ * Gera as linhas [y0, y1) da textura em tons de cinza (1 byte por texel) em 'gray'.
+ * O caminho SSE2 produz 16 texels por iteração; o resto da linha usa asphaltTexel().
+ * (originX, originY) desloca as coordenadas do ruído (>= 0): é um recorte de uma textura
+ * infinita, usado pelos blocos do chão do mundo aberto.
+ */
+void generateAsphaltRows(unsigned char *gray, int size, unsigned int seed, int y0, int y1,
+                         const unsigned char *streakPattern, int originX = 0, int originY = 0) {
+    for(int y=y0;y<y1;y++){
+        unsigned char *row = gray + (size_t)y * size;
+        int gy = originY + y;
+        int x = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+        const unsigned char *streakRow = streakPattern + (originX + gy) % 37; // streakRow[x] = ((originX+x+gy)%37 < 8)
+        __m128i seedMix = _mm_set1_epi32((int)(seed * 0x85EBCA77u));
+        __m128i yMix = _mm_set1_epi32((int)((unsigned)gy * 0x9E3779B1u));
+        const __m128i lo16 = _mm_set1_epi32(0xFFFF);
+        for(; x + 16 <= size; x += 16){
+            __m128i t0 = asphaltTexel4(seedMix, yMix, originX + x);
+            __m128i t1 = asphaltTexel4(seedMix, yMix, originX + x + 4);
+            __m128i t2 = asphaltTexel4(seedMix, yMix, originX + x + 8);
+            __m128i t3 = asphaltTexel4(seedMix, yMix, originX + x + 12);
+            // Separa base+ruído e risco, empacota para 16 bytes e soma o risco onde a máscara permite.
+            __m128i v01 = _mm_packs_epi32(_mm_and_si128(t0, lo16), _mm_and_si128(t1, lo16));
+            __m128i v23 = _mm_packs_epi32(_mm_and_si128(t2, lo16), _mm_and_si128(t3, lo16));
+            __m128i s01 = _mm_packs_epi32(_mm_srli_epi32(t0, 16), _mm_srli_epi32(t1, 16));
+            __m128i s23 = _mm_packs_epi32(_mm_srli_epi32(t2, 16), _mm_srli_epi32(t3, 16));
+            __m128i v = _mm_packus_epi16(v01, v23);
+            __m128i s = _mm_packus_epi16(s01, s23);
+            __m128i m = _mm_loadu_si128((const __m128i*)(streakRow + x)); // 0xFF onde há risco
+            v = _mm_add_epi8(v, _mm_and_si128(s, m));
+            _mm_storeu_si128((__m128i*)(row + x), v);
+        }
+#endif
+        for(; x<size; x++) row[x] = asphaltTexel(seed, originX + x, gy);
+    }
+}
+
+/**
+ * Gera uma textura procedural simples que imita asfalto (grayscale noise + streaks).
+ * Determinística pela semente; linhas são divididas entre threads.
+ * @param channels 3 para RGB (cinza replicado) ou 1 para um único canal.
+ */
+void generateAsphaltProc(unsigned char *buf, int size, unsigned int seed, int channels = 3) {
+    // Máscara dos riscos diagonais: streakPattern[i] = (i % 37 < 8), com folga para y % 37.
+    std::vector<unsigned char> streakPattern(size + 37);
+    for(int i=0;i<size+37;i++) streakPattern[i] = (i % 37 < 8) ? 0xFF : 0x00;
+
+    // Gera em cinza direto no destino (1 canal) ou em um buffer temporário (RGB).
+    std::vector<unsigned char> tmp;
+    unsigned char *gray = buf;
+    if(channels != 1) { tmp.resize((size_t)size * size); gray = tmp.data(); }
+
+    int numThreads = (int)std::thread::hardware_concurrency();
+    if(numThreads > size / 64) numThreads = size / 64; // Texturas pequenas não compensam threads.
+    if(numThreads < 1) numThreads = 1;
+    auto work = [&](int t) {
+        int y0 = (int)((long long)size * t / numThreads);
+        int y1 = (int)((long long)size * (t + 1) / numThreads);
+        generateAsphaltRows(gray, size, seed, y0, y1, streakPattern.data());
+        // Replica o cinza nos canais RGB das mesmas linhas.
+        if(channels != 1)
+            for(size_t i=(size_t)y0*size; i<(size_t)y1*size; i++)
+                buf[i*3+0] = buf[i*3+1] = buf[i*3+2] = gray[i];
+    };
+    std::vector<std::thread> pool;
+    for(int t=1;t<numThreads;t++) pool.emplace_back(work, t);
+    work(0);
+    for(auto &th : pool) th.join();
+}
+
+// Número de níveis da cadeia de mipmaps de uma textura size x size (do nível 0 até 1x1).
+int mipLevelCount(int size) {
+    int n = 1;
+    for(; size > 1; size /= 2) n++;
+    return n;
+}
+
+// Bytes da cadeia inteira com um canal (cerca de 4/3 do nível 0).
+size_t mipChainBytes(int size) {
+    size_t n = (size_t)size * size;
+    for(; size > 1; size /= 2) n += (size_t)(size / 2) * (size / 2);
+    return n;
+}
+
+/**
+ * Reduz um nível de lado s para o próximo (lado s/2) com filtro de caixa 2x2 e média
+ * arredondada; com lado ímpar a última linha e a última coluna ficam de fora.
+ * O caminho SSE2 produz 16 texels por iteração: soma cada par de bytes vizinhos numa
+ * palavra de 16 bits (byte par + byte ímpar), soma as duas linhas e empacota de volta.
+ */
+void downsampleBox(const unsigned char *src, int s, unsigned char *dst) {
+    int d = s / 2;
+    for(int y=0;y<d;y++){
+        const unsigned char *r0 = src + (size_t)(2 * y) * s, *r1 = r0 + s;
+        unsigned char *row = dst + (size_t)y * d;
+        int x = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+        const __m128i lo8 = _mm_set1_epi16(0x00FF), two = _mm_set1_epi16(2);
+        auto pairs = [&](const unsigned char *p) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            return _mm_add_epi16(_mm_and_si128(v, lo8), _mm_srli_epi16(v, 8));
+        };
+        for(; x + 16 <= d; x += 16){
+            __m128i s0 = _mm_add_epi16(pairs(r0 + 2 * x), pairs(r1 + 2 * x));
+            __m128i s1 = _mm_add_epi16(pairs(r0 + 2 * x + 16), pairs(r1 + 2 * x + 16));
+            s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+            s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+            _mm_storeu_si128((__m128i*)(row + x), _mm_packus_epi16(s0, s1));
+        }
+#endif
+        for(; x<d; x++) row[x] = (unsigned char)((r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1] + 2) >> 2);
+    }
+}
+
+// Completa a cadeia em 'chain': o nível 0 já está no início e os outros vêm em seguida.
+void buildMipChain(unsigned char *chain, int size) {
+    for(int s=size; s>1; s/=2){
+        unsigned char *next = chain + (size_t)s * s;
+        downsampleBox(chain, s, next);
+        chain = next;
+    }
+}
+
+/**
+ * Cria um ID de textura GL de um canal a partir da cadeia de mipmaps em 'chain'
+ * (níveis em sequência, como em buildMipChain), com filtro bilinear no mipmap mais próximo
+ * (ou trilinear com --trilinear) e repetição (REPEAT). Com --no-mipmaps só o nível 0 é enviado.
  */
-GLuint createTextureFromBuffer(unsigned char *buf, int size) {
+GLuint createTextureFromBuffer(const unsigned char *chain, int size) {
     GLuint id;
     glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
-    // Envia os dados da imagem para a GPU.
-    glTexImage2D(GL_TEXTURE_2D,0,GL_RGB,size,size,0,GL_RGB,GL_UNSIGNED_BYTE,buf);
-    // Configura os parâmetros da textura para suavização (LINEAR) e repetição (REPEAT).
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glState.bindTexture(id);
+    // Envia todos os níveis; os menores têm linhas de 1 a 3 bytes.
+    GLint align;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &align);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    int level = 0;
+    for(int s=size;; s/=2, level++){
+        glTexImage2D(GL_TEXTURE_2D, level, GL_LUMINANCE8, s, s, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, chain);
+        chain += (size_t)s * s;
+        if(s <= 1 || !asphaltMipmaps) break;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, align);
+    // O chão distante lê o nível do tamanho do texel na tela, sem serrilhado. Só um nível por
+    // amostra: o trilinear lê dois e custava o dobro do passo do chão no GL por software.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, !asphaltMipmaps ? GL_LINEAR :
+                    asphaltTrilinear ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     return id;
 }
 
-// Inicializa a textura de asfalto.
-void initTextures(){
-    unsigned char *buf = new unsigned char[TEX_SIZE*TEX_SIZE*3];
-    generateAsphaltProc(buf, TEX_SIZE);
-    texAsphalt = createTextureFromBuffer(buf, TEX_SIZE);
-    delete[] buf;
-}
-
 // ----------------------- Desenho de objetos -----------------------
 
+// Níveis de detalhe de cones e rodas (0 = tesselação original), escolhidos pelo raio
+// projetado em pixels (ver Frustum::lodFor).
+const int LOD_LEVELS = 3;
+const float LOD_MIN_PIXELS[LOD_LEVELS - 1] = {12.0f, 4.0f}; // Raio mínimo dos níveis 0 e 1.
+const int CONE_LOD_SLICES[LOD_LEVELS] = {16, 8, 5}, CONE_LOD_STACKS[LOD_LEVELS] = {8, 3, 1};
+const int WHEEL_LOD_SIDES[LOD_LEVELS] = {10, 6, 4}, WHEEL_LOD_RINGS[LOD_LEVELS] = {10, 6, 4};
+
+// Repetições da textura no chão: 6 em cada eixo no percurso padrão (24 x 40 m), proporcional nos demais.
+float groundTexRepeatX() { return 6.0f * (course.groundMaxX - course.groundMinX) / 24.0f; }
+float groundTexRepeatZ() { return 6.0f * (course.groundMaxZ - course.groundMinZ) / 40.0f; }
+
 /**
  * Desenha o chão usando a textura de asfalto.
  */
 void drawGroundTextured() {
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texAsphalt);
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(texAsphalt);
     glColor3f(1.0f,1.0f,1.0f); // Garante que a cor base é branca para que a textura não seja escurecida.
     glBegin(GL_QUADS);
         glNormal3f(0,1,0); // Normal aponta para cima.
-        // Mapeamento de textura: 6.0f faz a textura de 256x256 se repetir 6 vezes no chão.
-        glTexCoord2f(0.0f, 0.0f); glVertex3f(-12.0f, 0.0f, 16.0f);
-        glTexCoord2f(6.0f, 0.0f); glVertex3f( 12.0f, 0.0f, 16.0f);
-        glTexCoord2f(6.0f, 6.0f); glVertex3f( 12.0f, 0.0f, -24.0f);
-        glTexCoord2f(0.0f, 6.0f); glVertex3f(-12.0f, 0.0f, -24.0f);
+        // Mapeamento de textura: no percurso padrão a textura se repete 6 vezes no chão.
+        float u = groundTexRepeatX(), v = groundTexRepeatZ();
+        glTexCoord2f(0.0f, 0.0f); glVertex3f(course.groundMinX, 0.0f, course.groundMaxZ);
+        glTexCoord2f(u, 0.0f);    glVertex3f(course.groundMaxX, 0.0f, course.groundMaxZ);
+        glTexCoord2f(u, v);       glVertex3f(course.groundMaxX, 0.0f, course.groundMinZ);
+        glTexCoord2f(0.0f, v);    glVertex3f(course.groundMinX, 0.0f, course.groundMinZ);
     glEnd();
-    glDisable(GL_TEXTURE_2D);
+    glState.disable(GL_TEXTURE_2D);
 }
 
 /**
- * Desenha um cone na posição (x, z) com altura Y=0.
+ * Desenha um cone na posição (x, z) com altura Y=0 (mais escuro se foi derrubado).
  */
-void drawConeAt(float x, float z) {
+void drawConeAt(float x, float z, bool knocked = false, int lod = 0) {
     glPushMatrix();
       glTranslatef(x, 0.0f, z);
-      glColor3f(1.0f, 0.45f, 0.05f); // Cor laranja brilhante.
-      glutSolidCone(0.22, 0.5, 16, 8); // Cone sólido.
+      if(knocked) glColor3f(0.45f, 0.2f, 0.05f); // Derrubado: laranja escuro.
+      else glColor3f(1.0f, 0.45f, 0.05f); // Cor laranja brilhante.
+      glutSolidCone(0.22, 0.5, CONE_LOD_SLICES[lod], CONE_LOD_STACKS[lod]); // Cone sólido.
     glPopMatrix();
 }
 
 /**
  * Desenha o modelo do carro (cubo + teto + 4 rodas torus).
  */
-void drawCarModel(const Car &c) {
+void drawCarModel(const Car &c, int wheelLod = 0) {
+    const int sides = WHEEL_LOD_SIDES[wheelLod], rings = WHEEL_LOD_RINGS[wheelLod];
     glPushMatrix();
       // 1. Posiciona o carro no mundo e ajusta sua altura.
       glTranslatef(c.x, c.y + 0.25f, c.z);
@@ -170,7 +641,7 @@ void drawCarModel(const Car &c) {
       // Corpo (Body)
       glPushMatrix();
         glColor3f(0.15f, 0.25f, 0.9f); // Azul
-        glScalef(1.1f, 0.5f, 1.8f);   // Escala para formato de carro
+        glScalef(1.1f, 0.5f, 1.8f);   // Escala para formato de carro
         glutSolidCube(1.0);
       glPopMatrix();
 
@@ -190,339 +661,6982 @@ void drawCarModel(const Car &c) {
       glPushMatrix();
         glTranslatef(-wx, wy, -wz);
         glRotatef(c.wheelAngle, 0, 1, 0); // Rotação do esterço!
-        glutSolidTorus(0.06,0.12,10,10);
+        glutSolidTorus(0.06,0.12,sides,rings);
       glPopMatrix();
 
       // Frente Direita (com ângulo de esterço)
       glPushMatrix();
         glTranslatef( wx, wy, -wz);
         glRotatef(c.wheelAngle, 0, 1, 0); // Rotação do esterço!
-        glutSolidTorus(0.06,0.12,10,10);
+        glutSolidTorus(0.06,0.12,sides,rings);
       glPopMatrix();
 
       // Traseira Esquerda (sem ângulo de esterço)
       glPushMatrix();
         glTranslatef(-wx, wy, wz);
-        glutSolidTorus(0.06,0.12,10,10);
+        glutSolidTorus(0.06,0.12,sides,rings);
       glPopMatrix();
 
       // Traseira Direita (sem ângulo de esterço)
       glPushMatrix();
         glTranslatef( wx, wy, wz);
-        glutSolidTorus(0.06,0.12,10,10);
+        glutSolidTorus(0.06,0.12,sides,rings);
       glPopMatrix();
 
     glPopMatrix();
 }
 
-// ----------------------- Inicialização da cena --------------------
+// ----------------------- Troca de dados entre threads ---------------------------
+//
+// Estruturas sem trava usadas entre a thread da simulação, a do desenho (GLUT) e as
+// auxiliares (gravadora da telemetria): filas de um produtor e um consumidor para eventos e
+// um triple buffer para o estado mais recente.
 
 /**
- * Configura as posições dos cones para formar um corredor.
+ * Fila circular sem trava para exatamente um produtor e um consumidor. Cada lado guarda uma
+ * cópia do índice do outro e só relê o atômico quando a cópia indica fila cheia/vazia.
  */
-void setupConesStraightCorridor() {
-    cones.clear();
-    float startZ = 2.0f;
-    for(int i=0;i<NUM_PAIRS;i++){
-        float z = startZ - i * PAIR_SPACING;
-        cones.emplace_back(-CORRIDOR_HALF_WIDTH, z); // Esquerda
-        cones.emplace_back( CORRIDOR_HALF_WIDTH, z); // Direita
-    }
-    // Adiciona um cone marcador extra para o fim da baliza.
-    cones.emplace_back(0.0f, startZ - NUM_PAIRS * PAIR_SPACING - 1.5f);
-}
+template<class T, size_t N>
+struct SpscRing {
+    static_assert((N & (N - 1)) == 0, "capacidade precisa ser potência de 2");
+    T items[N];
+    alignas(64) std::atomic<size_t> head{0}; // Próxima posição do produtor.
+    size_t tailCache = 0;                    // Visão do produtor sobre 'tail'.
+    alignas(64) std::atomic<size_t> tail{0}; // Próxima posição do consumidor.
+    size_t headCache = 0;                    // Visão do consumidor sobre 'head'.
 
-// ----------------------- Luzes e GL states -------------------------
+    bool push(const T &v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h - tailCache == N) {
+            tailCache = tail.load(std::memory_order_acquire);
+            if(h - tailCache == N) return false;
+        }
+        items[h & (N - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    // Copia até 'max' itens para 'out'; devolve quantos.
+    size_t pop(T *out, size_t max) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(headCache == t) headCache = head.load(std::memory_order_acquire);
+        size_t n = std::min(headCache - t, max);
+        for(size_t i=0;i<n;i++) out[i] = items[(t + i) & (N - 1)];
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+    // Próximo item sem consumi-lo (nullptr com a fila vazia); discard() o consome.
+    const T *peek() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(headCache == t) headCache = head.load(std::memory_order_acquire);
+        return headCache == t ? nullptr : &items[t & (N - 1)];
+    }
+    void discard() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+};
 
 /**
- * Configura as luzes e o modelo de iluminação do OpenGL.
+ * Triple buffer: o escritor preenche sempre a sua cópia e a troca pela do meio; o leitor
+ * pega a do meio só quando há uma nova. Nenhum lado espera o outro e o leitor sempre vê um
+ * estado completo (o mais recente publicado).
  */
-void setupLighting() {
-    glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
-    glEnable(GL_COLOR_MATERIAL); // Permite que glColor altere as propriedades de material.
-    glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+template<class T>
+struct TripleBuffer {
+    static const int FRESH = 4;            // Bit em 'middle': publicada e ainda não lida.
+    T slots[3];
+    std::atomic<int> middle{1};
+    int back = 0, front = 2;               // Cópias exclusivas do escritor e do leitor.
 
-    // Luz Ambiente (ilumina a cena uniformemente).
-    GLfloat amb[] = {0.25f,0.25f,0.25f,1.0f};
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, amb);
+    T &writeSlot() { return slots[back]; }
+    // Publica writeSlot(); true se a publicação anterior não chegou a ser lida (ela volta para writeSlot()).
+    bool publish() {
+        int old = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old & 3;
+        return (old & FRESH) != 0;
+    }
+    // Estado mais recente (o mesmo do frame anterior se nada foi publicado desde então).
+    const T &read() {
+        if(middle.load(std::memory_order_relaxed) & FRESH)
+            front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return slots[front];
+    }
+};
 
-    // Luz Direcional (simula o sol).
-    GLfloat col[] = {1.0f,0.95f,0.85f,1.0f}; // Cor branca/amarelada
-    GLfloat pos[] = {0.2f,1.0f,0.3f,0.0f};  // w=0 indica luz direcional.
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, col);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, col);
-    glLightfv(GL_LIGHT0, GL_POSITION, pos);
+// ----------------------- Colisão carro x cones --------------------
+//
+// O carro é uma caixa orientada no plano XZ (o corpo de drawCarModel) e cada cone é um
+// círculo do raio da base. Uma grade espacial uniforme (hash de células) limita o teste
+// aos cones próximos, então o custo por passo não cresce com o total de cones do percurso.
 
-    // Configura o material padrão para o brilho especular (para reflexos em cones/carro).
-    GLfloat spec[] = {0.2f,0.2f,0.2f,1.0f};
-    glMaterialfv(GL_FRONT, GL_SPECULAR, spec);
-    glMaterialf(GL_FRONT, GL_SHININESS, 32.0f);
-}
+const float CAR_HALF_WIDTH = 0.55f;  // Meia largura do corpo (glScalef 1.1 em X).
+const float CAR_HALF_LENGTH = 0.9f;  // Meio comprimento do corpo (glScalef 1.8 em Z).
+const float CONE_RADIUS = 0.22f;     // Raio da base do cone (glutSolidCone).
+const float CONE_CELL = 1.0f;        // Lado de uma célula da grade espacial.
 
-// ----------------------- Input handlers ---------------------------
+// Grade espacial esparsa: célula (cx, cz) -> índices dos cones em pé dentro dela.
+struct ConeGrid {
+    std::unordered_map<long long, std::vector<int>> cells;
 
-/**
- * Função de callback chamada quando uma tecla regular (como WASD, ESC) é pressionada.
- * (Corrigido: Renomeado de keyDown para keyboardDown para evitar conflito).
- */
-void keyboardDown(unsigned char key, int x, int y) {
-    switch(key) {
-        case 'w': camForward=true; break;
-        case 's': camBack=true; break;
-        case 'a': camLeft=true; break;
-        case 'd': camRight=true; break;
-        case 'q': camUp=true; break;
-        case 'e': camDown=true; break;
-        case 'r': // Reseta posições da câmera e do carro.
-            car.x = 0; car.z = 6; car.heading=180; car.speed=0; car.wheelAngle=0;
-            cam.x = 0; cam.y = 3.2f; cam.z = 10.0f;
-            break;
-        case 27: // ASCII 27 é ESC
-            exit(0);
-        default: break;
+    static int cellOf(float v) { return (int)floorf(v / CONE_CELL); }
+    static long long key(int cx, int cz) { return ((long long)cx << 32) ^ (unsigned int)cz; }
+
+    void clear() { cells.clear(); }
+    void insert(int i, float x, float z) { cells[key(cellOf(x), cellOf(z))].push_back(i); }
+    void remove(int i, float x, float z) {
+        auto it = cells.find(key(cellOf(x), cellOf(z)));
+        if(it == cells.end()) return;
+        std::vector<int> &v = it->second;
+        for(size_t k=0;k<v.size();k++)
+            if(v[k] == i) { v[k] = v.back(); v.pop_back(); break; }
+        if(v.empty()) cells.erase(it);
+    }
+    // Chama f(i) para cada cone nas células que tocam o retângulo [minX,maxX] x [minZ,maxZ].
+    template<class F> void query(float minX, float minZ, float maxX, float maxZ, F f) const {
+        int cx0 = cellOf(minX), cx1 = cellOf(maxX), cz0 = cellOf(minZ), cz1 = cellOf(maxZ);
+        for(int cx=cx0;cx<=cx1;cx++)
+            for(int cz=cz0;cz<=cz1;cz++){
+                auto it = cells.find(key(cx, cz));
+                if(it != cells.end()) for(int i : it->second) f(i);
+            }
+    }
+};
+
+// Índice espacial estático de um percurso em arquivo: grade uniforme em CSR (cellStart[c] ..
+// cellStart[c+1] em cellCones). Cones derrubados continuam no índice e são pulados por 'knocked'.
+struct ConeCellIndex {
+    float cellSize = 1.0f;
+    int x0 = 0, z0 = 0;
+    unsigned w = 0, h = 0;
+    uint32_t count = 0;
+    const uint32_t *cellStart = nullptr, *cellCones = nullptr;
+    const unsigned char *knocked = nullptr;
+
+    bool valid() const { return cellStart != nullptr; }
+    void clear() { *this = ConeCellIndex(); }
+    // Cones em pé nas células que tocam o retângulo (colisão).
+    template<class F> void query(float minX, float minZ, float maxX, float maxZ, F f) const {
+        queryAll(minX, minZ, maxX, maxZ, [&](int i) { if(!knocked[i]) f(i); });
+    }
+    // Todos os cones, em pé ou derrubados (desenho).
+    template<class F> void queryAll(float minX, float minZ, float maxX, float maxZ, F f) const {
+        int cx0 = std::max(0, (int)floorf(minX / cellSize) - x0), cx1 = std::min((int)w - 1, (int)floorf(maxX / cellSize) - x0);
+        int cz0 = std::max(0, (int)floorf(minZ / cellSize) - z0), cz1 = std::min((int)h - 1, (int)floorf(maxZ / cellSize) - z0);
+        for(int cz=cz0;cz<=cz1;cz++)
+            for(int cx=cx0;cx<=cx1;cx++){
+                size_t c = (size_t)cz * w + cx;
+                uint32_t end = std::min(cellStart[c + 1], count); // Limita índices de um arquivo corrompido.
+                for(uint32_t k=cellStart[c];k<end;k++)
+                    if(cellCones[k] < count) f((int)cellCones[k]);
+            }
     }
+};
+
+// Um contato carro x cone: índice do cone e penetração (m) do círculo na caixa.
+struct ConeHit {
+    int cone;
+    float penetration;
+};
+
+// Estatísticas de colisão exibidas no HUD.
+struct ConeStats {
+    int knocked = 0;            // Cones derrubados desde o último reset.
+    float lastPenetration = 0;  // Penetração do último contato (m).
+    double lastHitTime = -1e9;  // Tempo simulado do último contato (s).
+};
+
+ConeGrid coneGrid;                     // Apenas cones em pé (percursos montados no programa).
+ConeCellIndex coneIndex;               // Índice do arquivo de percurso (substitui coneGrid).
+std::vector<unsigned char> coneKnocked; // 1 = derrubado (paralelo a 'cones').
+ConeStats coneStats;
+
+// Cópia do estado dos cones usada pelo desenho. A simulação não a toca diretamente: cada cone
+// derrubado (ou CONE_EVENT_RESET) vira um evento, aplicado na hora quando física e desenho
+// dividem a thread, ou levado por uma fila SPSC até o display() com a thread de simulação.
+struct ConeView {
+    std::vector<unsigned char> knocked; // 1 = derrubado (paralelo a 'cones').
+    std::vector<int> changes;           // Cones derrubados desde o último frame.
+    int layoutVersion = 0;              // Muda quando o percurso é (re)montado.
+} coneView;
+const int CONE_EVENT_RESET = -1;
+inline int coneStandEvent(int i) { return -2 - i; } // Cone levantado (rebobinagem/restauração).
+SpscRing<int, 1 << 16> coneEvents;
+bool coneEventsQueued = false;          // true enquanto a thread de simulação roda.
+
+void applyConeEvent(int e) {
+    if(e == CONE_EVENT_RESET) {
+        coneView.knocked.assign(cones.size(), 0);
+        coneView.changes.clear();
+        coneView.layoutVersion++;
+    } else if(e < CONE_EVENT_RESET) {
+        coneView.knocked[-2 - e] = 0;
+        coneView.changes.push_back(-2 - e);
+    } else {
+        coneView.knocked[e] = 1;
+        coneView.changes.push_back(e);
+    }
+}
+
+// Lado da simulação. Com a fila cheia espera o desenho (um reset perdido deixaria cones no chão).
+void publishConeEvent(int e) {
+    if(!coneEventsQueued) { applyConeEvent(e); return; }
+    while(!coneEvents.push(e)) std::this_thread::yield();
+}
+
+// Lado do desenho: aplica os eventos pendentes na ordem em que a simulação os gerou.
+void drainConeEvents() {
+    int buf[256];
+    while(size_t n = coneEvents.pop(buf, 256))
+        for(size_t i=0;i<n;i++) applyConeEvent(buf[i]);
 }
 
 /**
- * Função de callback chamada quando uma tecla regular é liberada.
- * (Corrigido: Renomeado de keyUp para keyboardUp para evitar conflito).
+ * Testa o círculo (cx, cz, r) contra a caixa orientada do carro.
+ * @return penetração (> 0) se houver contato, ou 0.
  */
-void keyboardUp(unsigned char key, int x, int y) {
-    switch(key) {
-        case 'w': camForward=false; break;
-        case 's': camBack=false; break;
-        case 'a': camLeft=false; break;
-        case 'd': camRight=false; break;
-        case 'q': camUp=false; break;
-        case 'e': camDown=false; break;
-        default: break;
-    }
+inline float carConePenetration(const Car &c, float cs, float sn, float cx, float cz) {
+    // Leva o centro do cone para o referencial do carro (inverso de glRotatef(heading, 0,1,0)).
+    float dx = cx - c.x, dz = cz - c.z;
+    float lx = dx * cs - dz * sn;
+    float lz = dx * sn + dz * cs;
+    float qx = std::max(-CAR_HALF_WIDTH, std::min(CAR_HALF_WIDTH, lx));
+    float qz = std::max(-CAR_HALF_LENGTH, std::min(CAR_HALF_LENGTH, lz));
+    float ex = lx - qx, ez = lz - qz;
+    float d2 = ex*ex + ez*ez;
+    if(d2 == 0.0f) // Centro dentro da caixa: distância até a borda mais próxima.
+        return CONE_RADIUS + std::min(CAR_HALF_WIDTH - fabsf(lx), CAR_HALF_LENGTH - fabsf(lz));
+    if(d2 >= CONE_RADIUS*CONE_RADIUS) return 0.0f;
+    return CONE_RADIUS - sqrtf(d2);
 }
 
 /**
- * Função de callback chamada quando uma tecla especial (como setas) é pressionada.
+ * Encontra os cones da grade que tocam o carro (broadphase pela grade + teste exato).
+ * Grid é ConeGrid ou ConeCellIndex.
  */
-void specialDown(int key, int x, int y) {
-    switch(key) {
-        case GLUT_KEY_UP: keyUp=true; break;      // Acelerar
-        case GLUT_KEY_DOWN: keyDown=true; break;  // Ré/Freio
-        case GLUT_KEY_LEFT: keyLeft=true; break;  // Virar esquerda
-        case GLUT_KEY_RIGHT: keyRight=true; break; // Virar direita
-    }
+template<class Grid>
+void queryConeHits(const Grid &grid, const ConeArray::Cone *cs, const Car &c, std::vector<ConeHit> &hits) {
+    hits.clear();
+    float hr = c.heading * (PI/180.0f);
+    float sn = sinf(hr), co = cosf(hr);
+    // Caixa alinhada aos eixos que envolve a caixa orientada, expandida pelo raio do cone.
+    float ex = fabsf(co) * CAR_HALF_WIDTH + fabsf(sn) * CAR_HALF_LENGTH + CONE_RADIUS;
+    float ez = fabsf(sn) * CAR_HALF_WIDTH + fabsf(co) * CAR_HALF_LENGTH + CONE_RADIUS;
+    grid.query(c.x - ex, c.z - ez, c.x + ex, c.z + ez, [&](int i) {
+        float p = carConePenetration(c, co, sn, cs[i].first, cs[i].second);
+        if(p > 0.0f) hits.push_back(ConeHit{i, p});
+    });
 }
+
 /**
- * Função de callback chamada quando uma tecla especial é liberada.
+ * Mesmo teste sem broadphase (O(n)); usado como referência no benchmark.
  */
-void specialUp(int key, int x, int y) {
-    switch(key) {
-        case GLUT_KEY_UP: keyUp=false; break;
-        case GLUT_KEY_DOWN: keyDown=false; break;
-        case GLUT_KEY_LEFT: keyLeft=false; break;
-        case GLUT_KEY_RIGHT: keyRight=false; break;
+void queryConeHitsBrute(const ConeArray::Cone *cs, size_t n, const Car &c, std::vector<ConeHit> &hits) {
+    hits.clear();
+    float hr = c.heading * (PI/180.0f);
+    float sn = sinf(hr), co = cosf(hr);
+    for(size_t i=0;i<n;i++){
+        float p = carConePenetration(c, co, sn, cs[i].first, cs[i].second);
+        if(p > 0.0f) hits.push_back(ConeHit{(int)i, p});
     }
 }
 
-// ----------------------- Physics & update ------------------------
+std::vector<ConeHit> lastConeHits; // Cones derrubados no último passo (reaproveitado, sem alocação).
+unsigned coneResets = 0;           // Conta rebuildConeGrid (a rebobinagem não volta além de um reset).
 
-int prevTime = 0; // Armazena o tempo da última atualização.
+// Reconstrói a grade do zero e levanta todos os cones (início da cena e reset).
+void rebuildConeGrid() {
+    coneGrid.clear();
+    coneKnocked.assign(cones.size(), 0);
+    if(!cones.external) coneIndex.clear();
+    if(coneIndex.valid()) coneIndex.knocked = coneKnocked.data(); // Índice pronto do arquivo.
+    else for(size_t i=0;i<cones.size();i++) coneGrid.insert((int)i, cones[i].first, cones[i].second);
+    coneStats = ConeStats();
+    coneResets++;
+    publishConeEvent(CONE_EVENT_RESET);
+}
+
+// Derruba ou levanta um cone fora da colisão (restauração de estado e rebobinagem).
+void setConeKnocked(int i, bool knocked) {
+    if((coneKnocked[i] != 0) == knocked) return;
+    coneKnocked[i] = knocked ? 1 : 0;
+    if(!coneIndex.valid()) {
+        if(knocked) coneGrid.remove(i, cones[i].first, cones[i].second);
+        else coneGrid.insert(i, cones[i].first, cones[i].second);
+    }
+    publishConeEvent(knocked ? i : coneStandEvent(i));
+}
 
 /**
- * Atualiza o estado físico da câmera e do carro. Chamada a cada frame (timerFunc).
- * @param dt Tempo decorrido desde o último frame (em segundos).
+ * Testa o carro contra os cones em pé; cada cone atingido é derrubado e sai da grade.
+ * @param now Tempo simulado atual (s), usado pelo aviso de colisão no HUD.
  */
-void updatePhysics(float dt) {
-    // --- Lógica da Câmera ---
-    float cs = cam.speed * dt;
-    // Movimento simples nos eixos globais X e Z.
-    if(camForward) { cam.z -= cs; }
-    if(camBack) { cam.z += cs; }
-    if(camLeft) { cam.x -= cs; }
-    if(camRight) { cam.x += cs; }
-    // Movimento vertical.
-    if(camUp) { cam.y += cs; }
-    if(camDown) { cam.y -= cs; if(cam.y < 0.5f) cam.y = 0.5f; } // Limita a altura mínima.
-
-    // --- Lógica do Carro ---
-
-    // 1. Controle do Ângulo de Esterço (Rodas Dianteiras)
-    if(keyLeft) car.wheelAngle += WHEEL_SPEED_DEG * dt;
-    else if(keyRight) car.wheelAngle -= WHEEL_SPEED_DEG * dt;
-    else {
-        // Auto-centralização do volante (lento).
-        if(car.wheelAngle > 1.0f) car.wheelAngle -= 60.0f*dt;
-        else if(car.wheelAngle < -1.0f) car.wheelAngle += 60.0f*dt;
-        else car.wheelAngle = 0.0f;
+void updateConeCollisions(double now) {
+    std::vector<ConeHit> &hits = lastConeHits;
+    if(coneIndex.valid()) queryConeHits(coneIndex, cones.data(), car, hits);
+    else queryConeHits(coneGrid, cones.data(), car, hits);
+    for(const ConeHit &h : hits){
+        coneKnocked[h.cone] = 1;
+        if(!coneIndex.valid()) coneGrid.remove(h.cone, cones[h.cone].first, cones[h.cone].second);
+        coneStats.knocked++;
+        coneStats.lastPenetration = h.penetration;
+        coneStats.lastHitTime = now;
+        publishConeEvent(h.cone);
     }
-    // Limita o ângulo de esterço.
-    if(car.wheelAngle > MAX_WHEEL_DEG) car.wheelAngle = MAX_WHEEL_DEG;
-    if(car.wheelAngle < -MAX_WHEEL_DEG) car.wheelAngle = -MAX_WHEEL_DEG;
+}
 
-    // 2. Controle da Velocidade (Aceleração e Freio/Fricção)
-    if(keyUp) car.speed += CAR_ACCEL * dt;  // Acelera
-    else if(keyDown) car.speed -= CAR_ACCEL * dt; // Ré ou freio
-    else {
-        // Fricção/Arrasto: Se não estiver acelerando, a velocidade cai.
-        if(car.speed > 0.0f) { car.speed -= FRICTION * dt; if(car.speed < 0) car.speed = 0.0f; }
-        else if(car.speed < 0.0f) { car.speed += FRICTION * dt; if(car.speed > 0) car.speed = 0.0f; }
-    }
-    // Limita a velocidade máxima.
-    if(car.speed > MAX_SPEED) car.speed = MAX_SPEED;
-    if(car.speed < MAX_REVERSE) car.speed = MAX_REVERSE;
+// ----------------------- Arquivos binários (seções alinhadas) ----------
+//
+// Os formatos binários (percurso, malhas e cache da textura) gravam um cabeçalho com os
+// deslocamentos de seções alinhadas a FILE_SECTION_ALIGN bytes; ao abrir, cada seção é
+// conferida contra o tamanho do arquivo antes de o conteúdo mapeado ser usado.
 
-    // 3. Atualização da Posição e Direção (Modelo de Bicicleta Simplificado)
-    float steerRad = car.wheelAngle * (PI/180.0f); // Converte esterço para radianos.
-    if(fabsf(steerRad) > 1e-4f) {
-        // R = Distância entre eixos / tan(ângulo de esterço) -> Raio de Curva
-        float R = WHEEL_BASE / tanf(steerRad);
-        // Calcula a velocidade angular (deg/s).
-        float angVel = (car.speed / R) * (180.0f/PI);
-        car.heading += angVel * dt; // Atualiza o ângulo de direção.
-    }
-    // Move o carro na direção atual (heading).
-    float hr = car.heading * (PI/180.0f); // Converte heading para radianos.
-    car.x += sinf(hr) * car.speed * dt;  // Movimento X = sin(heading) * velocidade * dt
-    car.z += cosf(hr) * car.speed * dt;  // Movimento Z = cos(heading) * velocidade * dt
+const size_t FILE_SECTION_ALIGN = 64;
 
-    // 4. Limites de Borda (opcional)
-    if(car.x > 10.0f) car.x = 10.0f;
-    if(car.x < -10.0f) car.x = -10.0f;
-    if(car.z > 16.0f) car.z = 16.0f;
-    if(car.z < -24.0f) car.z = -24.0f;
+// Alinha o arquivo em 'f' para a próxima seção; retorna o deslocamento dela.
+static uint64_t padFileSection(FILE *f) {
+    long pos = ftell(f);
+    static const char zeros[FILE_SECTION_ALIGN] = {};
+    size_t pad = (FILE_SECTION_ALIGN - (size_t)pos % FILE_SECTION_ALIGN) % FILE_SECTION_ALIGN;
+    fwrite(zeros, 1, pad, f);
+    return (uint64_t)pos + pad;
 }
 
-// ----------------------- HUD (Head-Up Display) ------------------------------------
+// Seção [off, off + len) alinhada e inteira num arquivo de 'size' bytes (sem somar, para não estourar).
+inline bool fileSectionFits(uint64_t off, uint64_t len, size_t size) {
+    return off % FILE_SECTION_ALIGN == 0 && off <= size && len <= size - off;
+}
 
-/**
- * Desenha informações de texto na tela (posição, velocidade, controles).
- */
-void drawHUD() {
-    int w = glutGet(GLUT_WINDOW_WIDTH);
-    int h = glutGet(GLUT_WINDOW_HEIGHT);
+// ----------------------- Percurso em arquivo (binário mapeado) ----------
+//
+// Formato versionado, na ordem de bytes da máquina que converteu (little-endian no x86):
+//   CourseHeader | cones (x, z) float | início de cada célula (uint32, w*h + 1) |
+//   índices dos cones agrupados por célula (uint32, um por cone)
+// Cada seção começa alinhada a 64 bytes. O arquivo é mapeado na memória e os cones são
+// usados direto das páginas mapeadas como 'cones' (sem cópia); o índice espacial já vem
+// pronto e substitui coneGrid, então carregar não depende do número de cones.
+// Texto aceito por --course-convert (uma diretiva por linha, '#' comenta):
+//   ground minX minZ maxX maxZ | start x z heading | goal minX minZ maxX maxZ | cone x z
 
-    // Salva e configura a matriz de projeção para 2D (ortogonal)
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-      glLoadIdentity();
-      glOrtho(0,w,0,h,-1,1); // Projeção 2D de 0 a W e 0 a H.
-      glMatrixMode(GL_MODELVIEW);
-      glPushMatrix();
-        glLoadIdentity();
-        glDisable(GL_LIGHTING); // Desabilita luz para que o texto não seja afetado.
+const char COURSE_MAGIC[8] = {'B','A','L','I','Z','A','C','R'};
+const uint32_t COURSE_VERSION = 1;
 
-        glColor3f(1,1,1);
-        // Texto de instruções.
-        std::string s = "Setas: dirigir carro   WASD/QE: mover camera   R: resetar   ESC: sair";
-        glRasterPos2i(10, h-20);
-        for(char c : s) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, c);
+struct CourseHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;          // sizeof(CourseHeader) de quem gravou.
+    uint64_t coneCount;
+    float groundMinX, groundMinZ, groundMaxX, groundMaxZ;
+    float startX, startZ, startHeading;
+    float goalMinX, goalMinZ, goalMaxX, goalMaxZ;
+    float cellSize;               // Lado da célula do índice espacial (m).
+    int32_t gridX0, gridZ0;       // Célula do canto (minX, minZ) da grade.
+    uint32_t gridW, gridH;
+    uint64_t conesOffset;
+    uint64_t cellStartOffset;
+    uint64_t cellConesOffset;
+    uint64_t fileSize;
+};
 
-        // Texto com o estado atual do carro (usa snprintf para formatar floats).
-        char buf[128];
-        snprintf(buf, sizeof(buf), "Carro: Pos (%.2f, %.2f) Direcao %.1f Velocidade %.2f Esterco %.1f",
-                  car.x, car.z, car.heading, car.speed, car.wheelAngle);
-        glRasterPos2i(10, h-36);
-        for(char *p = buf; *p; ++p) glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *p);
+// Arquivo inteiro mapeado somente para leitura.
+struct MappedFile {
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#endif
 
-        glEnable(GL_LIGHTING); // Reabilita a iluminação para a renderização 3D.
-      glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-}
+    bool open(const char *path) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER len;
+        if(!GetFileSizeEx(file, &len) || len.QuadPart == 0) { close(); return false; }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if(!mapping) { close(); return false; }
+        data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)len.QuadPart;
+#else
+        int fd = ::open(path, O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // O mapeamento continua válido sem o descritor.
+        if(p == MAP_FAILED) return false;
+        data = (const unsigned char*)p;
+        size = (size_t)st.st_size;
+#endif
+        if(!data) { close(); return false; }
+        return true;
+    }
+    void close() {
+#ifdef _WIN32
+        if(data) UnmapViewOfFile(data);
+        if(mapping) CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL; file = INVALID_HANDLE_VALUE;
+#else
+        if(data) munmap((void*)data, size);
+#endif
+        data = nullptr; size = 0;
+    }
+    ~MappedFile() { close(); }
+};
 
-// ----------------------- Display / Render ------------------------
+MappedFile courseFile; // Mantido aberto enquanto 'cones' aponta para ele.
+
+// Confere o cabeçalho e se as seções cabem no arquivo; retorna a mensagem de erro ou NULL.
+const char *validateCourse(const unsigned char *data, size_t size) {
+    if(size < sizeof(CourseHeader)) return "arquivo menor que o cabecalho";
+    const CourseHeader &hd = *(const CourseHeader*)data;
+    if(memcmp(hd.magic, COURSE_MAGIC, sizeof(COURSE_MAGIC)) != 0) return "nao e um arquivo de percurso";
+    if(hd.version != COURSE_VERSION) return "versao do formato nao suportada";
+    if(hd.headerSize != sizeof(CourseHeader) || hd.fileSize != size) return "cabecalho inconsistente";
+    if(hd.coneCount > 0xffffffffull || !(hd.cellSize > 0.0f)) return "cabecalho inconsistente";
+    // O carro fica preso ao chão (stepCar): a caixa precisa ser finita e não vazia.
+    if(!(hd.groundMinX < hd.groundMaxX && hd.groundMinZ < hd.groundMaxZ) ||
+       !std::isfinite(hd.groundMinX) || !std::isfinite(hd.groundMaxX) ||
+       !std::isfinite(hd.groundMinZ) || !std::isfinite(hd.groundMaxZ)) return "limites do chao invalidos";
+    // gridW*gridH cabe em 64 bits, mas (cells + 1) * 4 não: compara com o arquivo antes de multiplicar.
+    uint64_t cells = (uint64_t)hd.gridW * hd.gridH;
+    if(cells >= size / sizeof(uint32_t)) return "secao fora do arquivo";
+    struct { uint64_t off, len; } sec[3] = {{hd.conesOffset, hd.coneCount * 2 * sizeof(float)},
+                                           {hd.cellStartOffset, (cells + 1) * sizeof(uint32_t)},
+                                           {hd.cellConesOffset, hd.coneCount * sizeof(uint32_t)}};
+    for(auto &s : sec)
+        if(!fileSectionFits(s.off, s.len, size)) return "secao fora do arquivo";
+    const uint32_t *cellStart = (const uint32_t*)(data + hd.cellStartOffset);
+    if(cellStart[0] != 0 || cellStart[cells] != hd.coneCount) return "indice espacial inconsistente";
+    return NULL;
+}
 
 /**
- * Função principal de desenho (callback de display).
+ * Mapeia um percurso binário e passa a usá-lo como cena: cones, índice espacial, limites do
+ * chão, pose inicial e vaga. Não copia os cones nem percorre o arquivo.
  */
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+bool loadCourseFile(const char *path) {
+    if(!courseFile.open(path)) { fprintf(stderr, "Nao foi possivel abrir o percurso %s\n", path); return false; }
+    if(const char *err = validateCourse(courseFile.data, courseFile.size)) {
+        fprintf(stderr, "Percurso %s invalido: %s\n", path, err);
+        courseFile.close();
+        return false;
+    }
+    const CourseHeader &hd = *(const CourseHeader*)courseFile.data;
+    course.groundMinX = hd.groundMinX; course.groundMinZ = hd.groundMinZ;
+    course.groundMaxX = hd.groundMaxX; course.groundMaxZ = hd.groundMaxZ;
+    course.startX = hd.startX; course.startZ = hd.startZ; course.startHeading = hd.startHeading;
+    course.goalMinX = hd.goalMinX; course.goalMinZ = hd.goalMinZ;
+    course.goalMaxX = hd.goalMaxX; course.goalMaxZ = hd.goalMaxZ;
 
-    // Configura a matriz de visualização (câmera)
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    // gluLookAt define a posição da câmera (cam.x, cam.y, cam.z), o ponto de foco (0.0f, 0.5f, 0.0f)
-    // e o vetor 'up' (0.0f, 1.0f, 0.0f).
-    gluLookAt(cam.x, cam.y, cam.z, 0.0f, 0.5f, 0.0f, 0.0f, 1.0f, 0.0f);
+    cones.attach((const ConeArray::Cone*)(courseFile.data + hd.conesOffset), (size_t)hd.coneCount);
+    coneIndex.cellSize = hd.cellSize;
+    coneIndex.x0 = hd.gridX0; coneIndex.z0 = hd.gridZ0;
+    coneIndex.w = hd.gridW; coneIndex.h = hd.gridH;
+    coneIndex.count = (uint32_t)hd.coneCount;
+    coneIndex.cellStart = (const uint32_t*)(courseFile.data + hd.cellStartOffset);
+    coneIndex.cellCones = (const uint32_t*)(courseFile.data + hd.cellConesOffset);
 
-    // Desenha a cena
-    setupLighting();
-    drawGroundTextured();
-    for(auto &p : cones) drawConeAt(p.first, p.second);
-    drawCarModel(car);
+    car = Car();
+    car.x = course.startX; car.z = course.startZ; car.heading = course.startHeading;
+    prevCar = car;
+    return true;
+}
 
-    // Desenha o HUD (em 2D por cima da cena 3D)
-    drawHUD();
+/**
+ * Converte a descrição em texto de um percurso para o formato binário, calculando o índice
+ * espacial (grade uniforme com cerca de 2 cones por célula, no mínimo CONE_CELL de lado).
+ */
+int runCourseConvert(const char *inPath, const char *outPath) {
+    FILE *in = fopen(inPath, "r");
+    if(!in) { fprintf(stderr, "Nao foi possivel abrir %s\n", inPath); return 1; }
+    Course c; // Valores padrão para as diretivas ausentes.
+    std::vector<ConeArray::Cone> cs;
+    char line[256], word[16];
+    int lineNo = 0;
+    while(fgets(line, sizeof(line), in)){
+        lineNo++;
+        float v[4];
+        int n = sscanf(line, "%15s %f %f %f %f", word, &v[0], &v[1], &v[2], &v[3]);
+        if(n <= 0 || word[0] == '#') continue;
+        if(strcmp(word, "cone") == 0 && n == 3) cs.emplace_back(v[0], v[1]);
+        else if(strcmp(word, "ground") == 0 && n == 5) { c.groundMinX = v[0]; c.groundMinZ = v[1]; c.groundMaxX = v[2]; c.groundMaxZ = v[3]; }
+        else if(strcmp(word, "start") == 0 && n == 4) { c.startX = v[0]; c.startZ = v[1]; c.startHeading = v[2]; }
+        else if(strcmp(word, "goal") == 0 && n == 5) { c.goalMinX = v[0]; c.goalMinZ = v[1]; c.goalMaxX = v[2]; c.goalMaxZ = v[3]; }
+        else { fprintf(stderr, "%s:%d: diretiva invalida\n", inPath, lineNo); fclose(in); return 1; }
+    }
+    fclose(in);
+    if(cs.size() > 0xffffffffull) { fprintf(stderr, "Cones demais para o formato\n"); return 1; }
 
-    glutSwapBuffers(); // Troca o buffer frontal e traseiro (para animação suave - double buffering).
-}
+    // Índice espacial: limites dos cones, lado da célula e ordenação por contagem (CSR).
+    float minX = 0, minZ = 0, maxX = 0, maxZ = 0;
+    for(size_t i=0;i<cs.size();i++){
+        if(i == 0 || cs[i].first < minX) minX = cs[i].first;
+        if(i == 0 || cs[i].first > maxX) maxX = cs[i].first;
+        if(i == 0 || cs[i].second < minZ) minZ = cs[i].second;
+        if(i == 0 || cs[i].second > maxZ) maxZ = cs[i].second;
+    }
+    double area = std::max(1.0, (double)(maxX - minX) * (maxZ - minZ));
+    float cell = std::max(CONE_CELL, (float)sqrt(area / std::max<size_t>(1, cs.size() / 2)));
+    int x0 = (int)floorf(minX / cell), z0 = (int)floorf(minZ / cell);
+    uint32_t w = (uint32_t)((int)floorf(maxX / cell) - x0 + 1), h = (uint32_t)((int)floorf(maxZ / cell) - z0 + 1);
+    std::vector<uint32_t> cellStart((size_t)w * h + 1, 0), cellCones(cs.size());
+    auto cellOf = [&](const ConeArray::Cone &p) {
+        return (size_t)((int)floorf(p.second / cell) - z0) * w + (size_t)((int)floorf(p.first / cell) - x0);
+    };
+    for(const auto &p : cs) cellStart[cellOf(p) + 1]++;
+    for(size_t k=1;k<cellStart.size();k++) cellStart[k] += cellStart[k-1];
+    {
+        std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+        for(size_t i=0;i<cs.size();i++) cellCones[fill[cellOf(cs[i])]++] = (uint32_t)i;
+    }
 
-// ----------------------- Reshape / Projection --------------------
+    FILE *out = fopen(outPath, "wb");
+    if(!out) { fprintf(stderr, "Nao foi possivel criar %s\n", outPath); return 1; }
+    CourseHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, COURSE_MAGIC, sizeof(COURSE_MAGIC));
+    hd.version = COURSE_VERSION;
+    hd.headerSize = sizeof(CourseHeader);
+    hd.coneCount = cs.size();
+    hd.groundMinX = c.groundMinX; hd.groundMinZ = c.groundMinZ; hd.groundMaxX = c.groundMaxX; hd.groundMaxZ = c.groundMaxZ;
+    hd.startX = c.startX; hd.startZ = c.startZ; hd.startHeading = c.startHeading;
+    hd.goalMinX = c.goalMinX; hd.goalMinZ = c.goalMinZ; hd.goalMaxX = c.goalMaxX; hd.goalMaxZ = c.goalMaxZ;
+    hd.cellSize = cell; hd.gridX0 = x0; hd.gridZ0 = z0; hd.gridW = w; hd.gridH = h;
+    fwrite(&hd, sizeof(hd), 1, out); // Reescrito no fim com os deslocamentos.
+    hd.conesOffset = padFileSection(out);
+    fwrite(cs.data(), sizeof(ConeArray::Cone), cs.size(), out);
+    hd.cellStartOffset = padFileSection(out);
+    fwrite(cellStart.data(), sizeof(uint32_t), cellStart.size(), out);
+    hd.cellConesOffset = padFileSection(out);
+    fwrite(cellCones.data(), sizeof(uint32_t), cellCones.size(), out);
+    hd.fileSize = (uint64_t)ftell(out);
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hd, sizeof(hd), 1, out);
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if(!ok) { fprintf(stderr, "Erro ao gravar %s\n", outPath); return 1; }
+    printf("%s: %zu cones, grade %ux%u (celula %.2f m), %.1f MB\n", outPath, cs.size(), w, h, cell,
+           hd.fileSize / (1024.0 * 1024.0));
+    return 0;
+}
 
 /**
- * Função de callback chamada quando a janela é redimensionada.
+ * Carrega um percurso binário e mostra o cabeçalho, o tempo de carga e o custo de uma
+ * consulta de colisão pelo índice do arquivo (conferida contra a força bruta na pose inicial).
  */
-void reshape(int w, int h) {
-    if(h==0) h=1;
-    glViewport(0,0,w,h); // Ajusta o viewport para o novo tamanho da janela.
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    // Configura a perspectiva (FOV=60, AspectRatio, near, far).
-    gluPerspective(60.0, (double)w/(double)h, 0.1, 300.0);
-    glMatrixMode(GL_MODELVIEW);
+int runCourseInfo(const char *path) {
+    auto t0 = std::chrono::steady_clock::now();
+    if(!loadCourseFile(path)) return 1;
+    auto t1 = std::chrono::steady_clock::now();
+    rebuildConeGrid();
+    auto t2 = std::chrono::steady_clock::now();
+    const CourseHeader &hd = *(const CourseHeader*)courseFile.data;
+    printf("%s: formato v%u, %zu cones, %.1f MB mapeados\n", path, hd.version, cones.size(), courseFile.size / (1024.0 * 1024.0));
+    printf("  chao (%.1f, %.1f)-(%.1f, %.1f)  inicio (%.2f, %.2f) %.1f graus  vaga (%.1f, %.1f)-(%.1f, %.1f)\n",
+           course.groundMinX, course.groundMinZ, course.groundMaxX, course.groundMaxZ,
+           course.startX, course.startZ, course.startHeading,
+           course.goalMinX, course.goalMinZ, course.goalMaxX, course.goalMaxZ);
+    printf("  indice: grade %ux%u, celula %.2f m\n", hd.gridW, hd.gridH, hd.cellSize);
+    printf("  carga %.3f ms, estado dos cones %.3f ms\n",
+           std::chrono::duration<double, std::milli>(t1 - t0).count(),
+           std::chrono::duration<double, std::milli>(t2 - t1).count());
+
+    std::vector<ConeHit> hits, ref;
+    const int queries = 100000;
+    auto t3 = std::chrono::steady_clock::now();
+    long long total = 0;
+    for(int q=0;q<queries;q++){
+        Car c = car;
+        c.x += (float)(q % 100) * 0.37f; c.z += (float)(q / 100 % 100) * 0.37f;
+        queryConeHits(coneIndex, cones.data(), c, hits);
+        total += (long long)hits.size();
+    }
+    auto t4 = std::chrono::steady_clock::now();
+    queryConeHits(coneIndex, cones.data(), car, hits);
+    queryConeHitsBrute(cones.data(), cones.size(), car, ref);
+    printf("  consulta pelo indice %.3f us (%lld contatos em %d consultas); na pose inicial %zu contatos, forca bruta %zu\n",
+           std::chrono::duration<double, std::micro>(t4 - t3).count() / queries, total, queries, hits.size(), ref.size());
+    return hits.size() == ref.size() ? 0 : 1;
 }
 
-// ----------------------- Timer loop ------------------------------
+// ----------------------- Cache da textura do asfalto ----------------------
+//
+// A textura do asfalto é guardada com um canal e a cadeia de mipmaps completa (cerca de 4/9
+// dos bytes da versão RGB sem mipmaps). Com --tex-cache pasta, a cadeia é gravada em
+// pasta/asfalto_<semente>_<lado>.tex na primeira execução; nas seguintes o arquivo é mapeado
+// e os níveis vão ao GL direto das páginas mapeadas, sem gerar o ruído nem os mipmaps.
+//   TexCacheHeader | níveis 0..n-1 em sequência (um byte por texel), alinhados a 64 bytes
 
-/**
- * Função de callback chamada periodicamente (a cada 16ms, ~60 FPS).
- */
-void timerFunc(int value) {
-    // Cálculo de Delta Time (dt) para movimentos independentes da taxa de quadros (FPS).
-    int now = glutGet(GLUT_ELAPSED_TIME);
-    static int last = now;
-    float dt = (now - last) / 1000.0f; // dt em segundos
-    if(dt <= 0.0f || dt > 0.5f) dt = 0.016f; // Evita valores extremos.
-    last = now;
+const char TEX_CACHE_MAGIC[8] = {'B','A','L','I','Z','A','T','X'};
+const uint32_t TEX_CACHE_VERSION = 1;
+const char *texCacheDir = NULL;    // --tex-cache pasta
+size_t asphaltTexBytes = 0;        // Memória da textura enviada (todos os níveis).
+bool asphaltTexCached = false;     // Veio do cache em disco.
+double asphaltTexMs = 0.0;         // Tempo de initTextures() (gerar ou mapear, e enviar).
 
-    // Atualiza o estado da simulação.
-    updatePhysics(dt);
+struct TexCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;  // sizeof(TexCacheHeader) de quem gravou.
+    uint32_t size, seed;  // Chave do cache: lado do nível 0 e semente do ruído.
+    uint32_t levels;
+    uint32_t reserved;
+    uint64_t dataOffset, dataBytes;
+    uint64_t fileSize;
+};
 
-    glutPostRedisplay(); // Marca a janela para ser redesenhada no próximo loop.
-    glutTimerFunc(16, timerFunc, 0); // Reagenda o timer para 16ms (60 FPS).
+// Arquivo do cache para a semente e o tamanho atuais.
+std::string texCachePath() {
+    char name[64];
+    snprintf(name, sizeof(name), "/asfalto_%u_%d.tex", asphaltSeed, asphaltTexSize);
+    return std::string(texCacheDir) + name;
 }
 
-// ----------------------- Main ------------------------------------
+// Confere o cabeçalho, a chave e se os níveis cabem no arquivo; retorna a mensagem de erro ou NULL.
+const char *validateTexCache(const unsigned char *data, size_t size) {
+    if(size < sizeof(TexCacheHeader)) return "arquivo menor que o cabecalho";
+    const TexCacheHeader &hd = *(const TexCacheHeader*)data;
+    if(memcmp(hd.magic, TEX_CACHE_MAGIC, sizeof(TEX_CACHE_MAGIC)) != 0) return "nao e um cache de textura";
+    if(hd.version != TEX_CACHE_VERSION) return "versao do formato nao suportada";
+    if(hd.headerSize != sizeof(TexCacheHeader) || hd.fileSize != size) return "cabecalho inconsistente";
+    if(hd.size != (uint32_t)asphaltTexSize || hd.seed != asphaltSeed) return "outra semente ou tamanho";
+    if(hd.levels != (uint32_t)mipLevelCount(asphaltTexSize) || hd.dataBytes != mipChainBytes(asphaltTexSize))
+        return "cabecalho inconsistente";
+    if(!fileSectionFits(hd.dataOffset, hd.dataBytes, size)) return "secao fora do arquivo";
+    return NULL;
+}
 
-int main(int argc, char** argv) {
-    // Inicialização do GLUT/FreeGLUT
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH); // Double buffer, cor RGB, buffer de profundidade.
-    glutInitWindowSize(WIN_W, WIN_H);
-    glutCreateWindow("Baliza - Asfalto Procedural, Cones, Carro e Camera");
+// Grava a cadeia 'chain' no cache; uma falha só é avisada (o cache é opcional).
+void saveTexCache(const char *path, const unsigned char *chain) {
+    std::error_code ec;
+    std::filesystem::create_directories(texCacheDir, ec);
+    FILE *out = fopen(path, "wb");
+    if(!out) { fprintf(stderr, "Nao foi possivel criar %s\n", path); return; }
+    TexCacheHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, TEX_CACHE_MAGIC, sizeof(TEX_CACHE_MAGIC));
+    hd.version = TEX_CACHE_VERSION;
+    hd.headerSize = sizeof(TexCacheHeader);
+    hd.size = (uint32_t)asphaltTexSize;
+    hd.seed = asphaltSeed;
+    hd.levels = (uint32_t)mipLevelCount(asphaltTexSize);
+    hd.dataBytes = mipChainBytes(asphaltTexSize);
+    fwrite(&hd, sizeof(hd), 1, out); // Reescrito no fim com os deslocamentos.
+    hd.dataOffset = padFileSection(out);
+    fwrite(chain, 1, (size_t)hd.dataBytes, out);
+    hd.fileSize = (uint64_t)ftell(out);
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hd, sizeof(hd), 1, out);
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if(!ok) { fprintf(stderr, "Erro ao gravar %s\n", path); remove(path); }
+}
 
-    // Configurações iniciais de estado do OpenGL
-    glEnable(GL_DEPTH_TEST);  // Habilita o teste de profundidade para objetos 3D.
-    glShadeModel(GL_SMOOTH);  // Interpola cores e normais.
-    glEnable(GL_NORMALIZE);   // Garante que normais sejam unitárias após transformações.
+// Mapeia o cache em 'f' e devolve a cadeia gravada, ou NULL (com aviso se o arquivo não serve).
+const unsigned char *mapTexCache(MappedFile &f, const char *path) {
+    if(!f.open(path)) return NULL;
+    if(const char *err = validateTexCache(f.data, f.size)) {
+        fprintf(stderr, "Cache de textura %s ignorado: %s\n", path, err);
+        return NULL;
+    }
+    return f.data + ((const TexCacheHeader*)f.data)->dataOffset;
+}
 
-    // Inicialização da cena
-    initTextures();
-    setupConesStraightCorridor();
-    setupLighting();
+// Inicializa a textura de asfalto: do cache em disco, se houver um válido, ou gerada na hora.
+void initTextures(){
+    auto t0 = std::chrono::steady_clock::now();
+    asphaltTexBytes = asphaltMipmaps ? mipChainBytes(asphaltTexSize) : (size_t)asphaltTexSize * asphaltTexSize;
+    std::string path = texCacheDir ? texCachePath() : std::string();
+    MappedFile f;
+    const unsigned char *cached = texCacheDir ? mapTexCache(f, path.c_str()) : NULL;
+    asphaltTexCached = cached != NULL;
+    if(cached) texAsphalt = createTextureFromBuffer(cached, asphaltTexSize);
+    else {
+        std::vector<unsigned char> chain(mipChainBytes(asphaltTexSize));
+        generateAsphaltProc(chain.data(), asphaltTexSize, asphaltSeed, 1);
+        buildMipChain(chain.data(), asphaltTexSize);
+        texAsphalt = createTextureFromBuffer(chain.data(), asphaltTexSize);
+        if(texCacheDir) saveTexCache(path.c_str(), chain.data());
+    }
+    asphaltTexMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Mesma cadeia de initTextures, mas na memória da CPU (rasterizador por software).
+void loadAsphaltChain(std::vector<unsigned char> &chain) {
+    auto t0 = std::chrono::steady_clock::now();
+    asphaltTexBytes = mipChainBytes(asphaltTexSize);
+    std::string path = texCacheDir ? texCachePath() : std::string();
+    MappedFile f;
+    const unsigned char *cached = texCacheDir ? mapTexCache(f, path.c_str()) : NULL;
+    asphaltTexCached = cached != NULL;
+    if(cached) chain.assign(cached, cached + asphaltTexBytes);
+    else {
+        chain.resize(asphaltTexBytes);
+        generateAsphaltProc(chain.data(), asphaltTexSize, asphaltSeed, 1);
+        buildMipChain(chain.data(), asphaltTexSize);
+        if(texCacheDir) saveTexCache(path.c_str(), chain.data());
+    }
+    asphaltTexMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// ----------------------- Culling e LOD ----------------------------
+//
+// A cada frame os planos do frustum saem de projeção x visão (lidas do GL depois de
+// gluLookAt). Cones e carro são testados por esfera envolvente; cada cone visível recebe um
+// nível de detalhe pelo raio projetado em pixels. Percursos em arquivo percorrem só as células
+// do índice espacial que tocam a projeção do frustum no chão.
+
+const float CONE_BOUND_RADIUS = 0.34f; // Esfera do cone (base 0.22, altura 0.5, centro no meio do eixo).
+const float CAR_BOUND_RADIUS = 1.25f;  // Esfera do carro inteiro (corpo, teto e rodas).
+const float WHEEL_BOUND_RADIUS = 0.18f; // Raio externo do toro da roda.
+bool allowCulling = true;              // --no-cull desliga (para comparação).
+
+struct Frustum {
+    float planes[6][4];   // a*x + b*y + c*z + d >= 0 dentro; normalizados.
+    float depthRow[4];    // Linha Z da modelview: -profundidade em coordenadas de olho.
+    float pixelScale;     // Pixels por metro a 1 m de profundidade.
+    float minX, minZ, maxX, maxZ; // Projeção do frustum no plano XZ.
+
+    bool sphereVisible(float x, float y, float z, float r) const {
+        for(int p=0;p<6;p++)
+            if(planes[p][0]*x + planes[p][1]*y + planes[p][2]*z + planes[p][3] < -r) return false;
+        return true;
+    }
+    // Nível de detalhe pelo raio projetado da esfera (0 = mais detalhado).
+    int lodFor(float x, float y, float z, float r) const {
+        float depth = -(depthRow[0]*x + depthRow[1]*y + depthRow[2]*z + depthRow[3]);
+        float px = r * pixelScale / std::max(depth, 0.1f);
+        int lod = 0;
+        while(lod < LOD_LEVELS - 1 && px < LOD_MIN_PIXELS[lod]) lod++;
+        return lod;
+    }
+} viewFrustum;
+
+/**
+ * Monta o frustum a partir de projeção 'p' e visão 'm' (por colunas, Gribb/Hartmann) e do viewport.
+ */
+void frustumFromMatrices(Frustum &f, const float p[16], const float m[16], int viewportH) {
+    float c[16];
+    for(int col=0;col<4;col++)
+        for(int row=0;row<4;row++){
+            float s = 0;
+            for(int k=0;k<4;k++) s += p[k*4 + row] * m[col*4 + k];
+            c[col*4 + row] = s;
+        }
+    // Linha i da matriz combinada (armazenamento por colunas).
+    auto row = [&](int i, int k) { return c[k*4 + i]; };
+    for(int k=0;k<4;k++){
+        f.planes[0][k] = row(3,k) + row(0,k); f.planes[1][k] = row(3,k) - row(0,k); // Esquerda, direita.
+        f.planes[2][k] = row(3,k) + row(1,k); f.planes[3][k] = row(3,k) - row(1,k); // Baixo, cima.
+        f.planes[4][k] = row(3,k) + row(2,k); f.planes[5][k] = row(3,k) - row(2,k); // Perto, longe.
+        f.depthRow[k] = m[k*4 + 2];
+    }
+    for(int i=0;i<6;i++){
+        float len = sqrtf(f.planes[i][0]*f.planes[i][0] + f.planes[i][1]*f.planes[i][1] + f.planes[i][2]*f.planes[i][2]);
+        for(int k=0;k<4;k++) f.planes[i][k] /= len;
+    }
+    f.pixelScale = p[5] * viewportH * 0.5f; // p[5] = 1/tan(fov/2).
+
+    // Cantos: interseção de um plano de cada par (esquerda/direita, baixo/cima, perto/longe).
+    f.minX = f.minZ = 1e30f; f.maxX = f.maxZ = -1e30f;
+    for(int k=0;k<8;k++){
+        const float *a = f.planes[k & 1], *b = f.planes[2 + (k >> 1 & 1)], *d = f.planes[4 + (k >> 2)];
+        float bc[3] = {b[1]*d[2]-b[2]*d[1], b[2]*d[0]-b[0]*d[2], b[0]*d[1]-b[1]*d[0]};
+        float ca[3] = {d[1]*a[2]-d[2]*a[1], d[2]*a[0]-d[0]*a[2], d[0]*a[1]-d[1]*a[0]};
+        float ab[3] = {a[1]*b[2]-a[2]*b[1], a[2]*b[0]-a[0]*b[2], a[0]*b[1]-a[1]*b[0]};
+        float det = a[0]*bc[0] + a[1]*bc[1] + a[2]*bc[2];
+        if(fabsf(det) < 1e-12f) continue;
+        float x = -(a[3]*bc[0] + b[3]*ca[0] + d[3]*ab[0]) / det;
+        float z = -(a[3]*bc[2] + b[3]*ca[2] + d[3]*ab[2]) / det;
+        f.minX = std::min(f.minX, x); f.maxX = std::max(f.maxX, x);
+        f.minZ = std::min(f.minZ, z); f.maxZ = std::max(f.maxZ, z);
+    }
+}
+
+// Frustum das matrizes atuais do GL (depois de gluLookAt).
+void updateFrustum(Frustum &f, int viewportH) {
+    float p[16], m[16];
+    glGetFloatv(GL_PROJECTION_MATRIX, p);
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    frustumFromMatrices(f, p, m, viewportH);
+}
+
+// Cones visíveis do frame, agrupados por nível de detalhe.
+struct ConeVisibility {
+    std::vector<int> lod[LOD_LEVELS];
+    int culled = 0;
+} coneVis;
+
+/**
+ * Separa os cones visíveis por nível de detalhe (todos no nível 0 com --no-cull).
+ */
+void cullCones(const Frustum &f, ConeVisibility &vis) {
+    for(auto &l : vis.lod) l.clear();
+    vis.culled = 0;
+    if(!allowCulling) {
+        vis.lod[0].resize(cones.size());
+        for(size_t i=0;i<cones.size();i++) vis.lod[0][i] = (int)i;
+        return;
+    }
+    auto test = [&](int i) {
+        float x = cones[i].first, z = cones[i].second + 0.25f;
+        if(f.sphereVisible(x, 0.0f, z, CONE_BOUND_RADIUS)) vis.lod[f.lodFor(x, 0.0f, z, CONE_BOUND_RADIUS)].push_back(i);
+    };
+    if(coneIndex.valid())
+        coneIndex.queryAll(f.minX - CONE_BOUND_RADIUS, f.minZ - CONE_BOUND_RADIUS - 0.25f,
+                           f.maxX + CONE_BOUND_RADIUS, f.maxZ + CONE_BOUND_RADIUS, test);
+    else
+        for(size_t i=0;i<cones.size();i++) test((int)i);
+    size_t drawn = 0;
+    for(auto &l : vis.lod) drawn += l.size();
+    vis.culled = (int)(cones.size() - drawn);
+}
+
+// ----------------------- Renderização retida (buffers) ------------
+//
+// As malhas (chão, cone, cubo, toro) são geradas uma única vez em vértices + índices (cone,
+// cubo e toro já pré-processados, ver "Malhas pré-processadas") e enviadas para buffers (VBO)
+// quando o driver suporta; sem VBO, os mesmos arrays ficam na
+// memória do cliente (GL 1.1). Os cones são desenhados com UMA chamada instanciada (shader
+// GLSL 1.20 que reproduz a iluminação fixa de setupLighting) ou, sem instancing, com uma
+// malha única pré-transformada de todos os cones. drawGroundTextured/drawConeAt/drawCarModel
+// continuam disponíveis como modo imediato (--immediate) para comparação.
+
+// Ponteiros das funções GL além da 1.1 (opengl32 no Windows só exporta a 1.1).
+struct GLFuncs {
+    PFNGLGENBUFFERSPROC GenBuffers;
+    PFNGLBINDBUFFERPROC BindBuffer;
+    PFNGLBUFFERDATAPROC BufferData;
+    PFNGLBUFFERSUBDATAPROC BufferSubData;
+    PFNGLCREATESHADERPROC CreateShader;
+    PFNGLSHADERSOURCEPROC ShaderSource;
+    PFNGLCOMPILESHADERPROC CompileShader;
+    PFNGLGETSHADERIVPROC GetShaderiv;
+    PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog;
+    PFNGLCREATEPROGRAMPROC CreateProgram;
+    PFNGLATTACHSHADERPROC AttachShader;
+    PFNGLBINDATTRIBLOCATIONPROC BindAttribLocation;
+    PFNGLLINKPROGRAMPROC LinkProgram;
+    PFNGLGETPROGRAMIVPROC GetProgramiv;
+    PFNGLUSEPROGRAMPROC UseProgram;
+    PFNGLENABLEVERTEXATTRIBARRAYPROC EnableVertexAttribArray;
+    PFNGLDISABLEVERTEXATTRIBARRAYPROC DisableVertexAttribArray;
+    PFNGLVERTEXATTRIBPOINTERPROC VertexAttribPointer;
+    PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+    PFNGLDRAWELEMENTSINSTANCEDPROC DrawElementsInstanced;
+    PFNGLMAPBUFFERPROC MapBuffer;
+    PFNGLUNMAPBUFFERPROC UnmapBuffer;
+    PFNGLGENFRAMEBUFFERSPROC GenFramebuffers;
+    PFNGLBINDFRAMEBUFFERPROC BindFramebuffer;
+    PFNGLGENRENDERBUFFERSPROC GenRenderbuffers;
+    PFNGLBINDRENDERBUFFERPROC BindRenderbuffer;
+    PFNGLRENDERBUFFERSTORAGEPROC RenderbufferStorage;
+    PFNGLFRAMEBUFFERRENDERBUFFERPROC FramebufferRenderbuffer;
+    PFNGLCHECKFRAMEBUFFERSTATUSPROC CheckFramebufferStatus;
+    PFNGLDELETEFRAMEBUFFERSPROC DeleteFramebuffers;
+    PFNGLDELETERENDERBUFFERSPROC DeleteRenderbuffers;
+    PFNGLGENQUERIESPROC GenQueries;
+    PFNGLQUERYCOUNTERPROC QueryCounter;
+    PFNGLGETQUERYOBJECTIVPROC GetQueryObjectiv;
+    PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+    PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation;
+    PFNGLUNIFORM4FPROC Uniform4f;
+} glf;
+
+bool glHasVBO = false;       // GL >= 1.5
+bool glHasInstancing = false; // GL >= 3.3 e shader compilado
+bool glHasPBO = false;        // GL >= 2.1 (pixel-pack buffers para leitura assíncrona)
+bool glHasFBO = false;        // GL >= 3.0 (framebuffer offscreen)
+bool glHasPackedNormals = false; // GL >= 3.3 (normais GL_INT_2_10_10_10_REV)
+bool useImmediateMode = false; // --immediate: caminho antigo (glBegin/glutSolid*)
+bool useSoftRaster = false;    // --soft-raster: cena desenhada na CPU (ver "Rasterizador por software")
+bool allowInstancing = true;   // --no-instancing: força a malha única pré-transformada
+
+// Lê "major.minor" de GL_VERSION.
+int glVersionNumber() {
+    const char *v = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    if(v) sscanf(v, "%d.%d", &major, &minor);
+    return major * 10 + minor;
+}
+
+// Busca uma função GL pelo nome. Padrão: glutGetProcAddress; contextos sem GLUT trocam o carregador.
+typedef void (*GLProc)();
+GLProc glutProcLoader(const char *name) { return (GLProc)glutGetProcAddress(name); }
+GLProc (*glProcLoader)(const char *name) = glutProcLoader;
+
+#define LOAD_GL(name) (glf.name = (decltype(glf.name))glProcLoader("gl" #name))
+
+// Carrega as funções conforme a versão do contexto.
+void loadGLFunctions() {
+    int ver = glVersionNumber();
+    if(ver >= 15) {
+        LOAD_GL(GenBuffers); LOAD_GL(BindBuffer); LOAD_GL(BufferData); LOAD_GL(BufferSubData);
+        glHasVBO = glf.GenBuffers && glf.BindBuffer && glf.BufferData && glf.BufferSubData;
+        LOAD_GL(MapBuffer); LOAD_GL(UnmapBuffer);
+        glHasPBO = ver >= 21 && glHasVBO && glf.MapBuffer && glf.UnmapBuffer;
+    }
+    if(ver >= 30) {
+        LOAD_GL(GenFramebuffers); LOAD_GL(BindFramebuffer); LOAD_GL(GenRenderbuffers); LOAD_GL(BindRenderbuffer);
+        LOAD_GL(RenderbufferStorage); LOAD_GL(FramebufferRenderbuffer); LOAD_GL(CheckFramebufferStatus);
+        LOAD_GL(DeleteFramebuffers); LOAD_GL(DeleteRenderbuffers);
+        glHasFBO = glf.GenFramebuffers && glf.BindFramebuffer && glf.RenderbufferStorage && glf.CheckFramebufferStatus &&
+                   glf.DeleteFramebuffers && glf.DeleteRenderbuffers;
+    }
+    if(ver >= 33) {
+        LOAD_GL(CreateShader); LOAD_GL(ShaderSource); LOAD_GL(CompileShader); LOAD_GL(GetShaderiv);
+        LOAD_GL(GetShaderInfoLog); LOAD_GL(CreateProgram); LOAD_GL(AttachShader); LOAD_GL(BindAttribLocation);
+        LOAD_GL(LinkProgram); LOAD_GL(GetProgramiv); LOAD_GL(UseProgram); LOAD_GL(EnableVertexAttribArray);
+        LOAD_GL(DisableVertexAttribArray); LOAD_GL(VertexAttribPointer); LOAD_GL(VertexAttribDivisor);
+        LOAD_GL(DrawElementsInstanced);
+        LOAD_GL(GenQueries); LOAD_GL(QueryCounter); LOAD_GL(GetQueryObjectiv); LOAD_GL(GetQueryObjectui64v);
+        LOAD_GL(GetUniformLocation); LOAD_GL(Uniform4f);
+        // O Mesa recusa GL_INT_2_10_10_10_REV em glNormalPointer mesmo no 3.3+: testa uma vez e,
+        // se der erro, as malhas pré-processadas usam normais em bytes.
+        for(int i=0;i<8 && glGetError() != GL_NO_ERROR;i++) {}
+        static const uint32_t probe = 0;
+        glNormalPointer(GL_INT_2_10_10_10_REV, 0, &probe);
+        glHasPackedNormals = glGetError() == GL_NO_ERROR;
+        glNormalPointer(GL_FLOAT, 0, NULL);
+    }
+}
+
+void GLStateCache::useProgram(GLuint id) {
+    if(programKnown && program == id) { suppressed++; return; }
+    program = id; programKnown = true; issued++;
+    glf.UseProgram(id);
+}
+
+// Vértice das malhas pré-processadas: posição em 16 bits (posição = pos * quantScale +
+// quantOffset) e normal 10:10:10:2 com sinal; 12 bytes contra 32 do vértice em float.
+struct PackedVertex {
+    int16_t pos[4];   // x, y, z e preenchimento (alinha a normal em 4 bytes).
+    uint32_t normal;  // Sem GL 3.3: 3 bytes com sinal (Mesh::normalBytes).
+};
+
+// Malha indexada com vértices intercalados: posição (3), normal (3), coordenada de textura (2).
+// As malhas pré-processadas guardam os vértices em 'packed' e deixam 'verts' vazio.
+struct Mesh {
+    std::vector<float> verts;
+    std::vector<PackedVertex> packed;
+    std::vector<GLuint> indices;
+    float quantScale = 1.0f, quantOffset[3] = {0.0f, 0.0f, 0.0f};
+    bool normalBytes = false;
+    GLuint vbo = 0, ibo = 0;
+
+    bool isPacked() const { return !packed.empty(); }
+    int vertexCount() const { return isPacked() ? (int)packed.size() : (int)verts.size() / 8; }
+    void addVertex(float x, float y, float z, float nx, float ny, float nz, float u = 0.0f, float v = 0.0f) {
+        float a[8] = {x, y, z, nx, ny, nz, u, v};
+        verts.insert(verts.end(), a, a + 8);
+    }
+    void addTri(GLuint a, GLuint b, GLuint c) { indices.push_back(a); indices.push_back(b); indices.push_back(c); }
+    void addQuad(GLuint a, GLuint b, GLuint c, GLuint d) { addTri(a, b, c); addTri(a, c, d); }
+};
+
+// Estatísticas do último frame (exibidas no HUD).
+struct RenderStats {
+    int drawCalls = 0;      // Chamadas de desenho da cena 3D (sem o HUD).
+    double submitMs = 0.0;  // Tempo de CPU para submeter a cena 3D.
+    int conesDrawn = 0, conesCulled = 0;
+    int conesPerLod[LOD_LEVELS] = {};
+    bool carDrawn = true;
+    int wheelLod = 0;
+} renderStats;
+
+Mesh meshGround, meshCube, meshConeBatch;
+Mesh meshConeLod[LOD_LEVELS], meshTorusLod[LOD_LEVELS];
+Mesh &meshCone = meshConeLod[0], &meshTorus = meshTorusLod[0]; // Tesselação original.
+GLuint coneInstanceVBO = 0;          // (x, z, derrubado) por cone, divisor 1.
+GLuint coneVisibleVBO = 0;           // Instâncias dos cones visíveis no frame, agrupadas por LOD.
+GLuint coneProgram = 0;
+GLint coneDequantUniform = -1;       // Uniform 'dequant' do shader dos cones.
+const GLuint CONE_INSTANCE_ATTRIB = 6; // Atributo da instância no shader dos cones.
+int coneUploadedVersion = -1;         // coneView.layoutVersion enviada por último.
+int coneBatchStandingIndices = 0;     // Sem instancing: índices dos cones em pé no início de meshConeBatch.
+
+/**
+ * Gera a mesma geometria de glutSolidCone: eixo +Z, base em z=0, 'slices' x 'stacks'.
+ */
+void buildConeMesh(Mesh &m, float base, float height, int slices, int stacks) {
+    float sl = sqrtf(height*height + base*base);
+    float nr = height / sl, nz = base / sl; // Normal lateral (radial, z).
+    // Base (normal -Z).
+    GLuint center = m.vertexCount();
+    m.addVertex(0, 0, 0, 0, 0, -1);
+    for(int i=0;i<slices;i++){
+        float a = 2.0f * PI * i / slices;
+        m.addVertex(base * cosf(a), base * sinf(a), 0, 0, 0, -1);
+    }
+    for(int i=0;i<slices;i++) m.addTri(center, center + 1 + (i + 1) % slices, center + 1 + i);
+    // Lateral em anéis.
+    GLuint ring0 = m.vertexCount();
+    for(int j=0;j<=stacks;j++){
+        float z = height * j / stacks, r = base * (1.0f - (float)j / stacks);
+        for(int i=0;i<slices;i++){
+            float a = 2.0f * PI * i / slices;
+            m.addVertex(r * cosf(a), r * sinf(a), z, nr * cosf(a), nr * sinf(a), nz);
+        }
+    }
+    for(int j=0;j<stacks;j++)
+        for(int i=0;i<slices;i++){
+            GLuint a = ring0 + j * slices + i, b = ring0 + j * slices + (i + 1) % slices;
+            m.addQuad(a, b, b + slices, a + slices);
+        }
+}
+
+// Gera a mesma geometria de glutSolidCube(size): 6 faces com normais próprias.
+void buildCubeMesh(Mesh &m, float size) {
+    static const float n[6][3] = {{1,0,0},{-1,0,0},{0,1,0},{0,-1,0},{0,0,1},{0,0,-1}};
+    float h = size * 0.5f;
+    for(int f=0;f<6;f++){
+        // Dois eixos tangentes à face.
+        float u[3] = {n[f][1], n[f][2], n[f][0]};
+        float v[3] = {n[f][1]*u[2]-n[f][2]*u[1], n[f][2]*u[0]-n[f][0]*u[2], n[f][0]*u[1]-n[f][1]*u[0]};
+        GLuint first = m.vertexCount();
+        static const float corner[4][2] = {{-1,-1},{1,-1},{1,1},{-1,1}};
+        for(int k=0;k<4;k++){
+            float p[3];
+            for(int a=0;a<3;a++) p[a] = h * (n[f][a] + corner[k][0]*u[a] + corner[k][1]*v[a]);
+            m.addVertex(p[0], p[1], p[2], n[f][0], n[f][1], n[f][2]);
+        }
+        m.addQuad(first, first + 1, first + 2, first + 3);
+    }
+}
+
+// Gera a mesma geometria de glutSolidTorus: anel no plano XY em torno do eixo Z.
+void buildTorusMesh(Mesh &m, float inner, float outer, int sides, int rings) {
+    GLuint first = m.vertexCount();
+    for(int i=0;i<=rings;i++){
+        float t = 2.0f * PI * i / rings;
+        for(int j=0;j<=sides;j++){
+            float p = 2.0f * PI * j / sides;
+            float r = outer + inner * cosf(p);
+            m.addVertex(r * cosf(t), r * sinf(t), inner * sinf(p), cosf(p) * cosf(t), cosf(p) * sinf(t), sinf(p));
+        }
+    }
+    for(int i=0;i<rings;i++)
+        for(int j=0;j<sides;j++){
+            GLuint a = first + i * (sides + 1) + j, b = a + sides + 1;
+            m.addQuad(a, b, b + 1, a + 1);
+        }
+}
+
+// Mesmo quadrilátero de drawGroundTextured (limites do percurso, textura repetida 6 vezes no padrão).
+void buildGroundMesh(Mesh &m) {
+    float u = groundTexRepeatX(), v = groundTexRepeatZ();
+    m.addVertex(course.groundMinX, 0.0f, course.groundMaxZ, 0,1,0, 0.0f, 0.0f);
+    m.addVertex(course.groundMaxX, 0.0f, course.groundMaxZ, 0,1,0, u, 0.0f);
+    m.addVertex(course.groundMaxX, 0.0f, course.groundMinZ, 0,1,0, u, v);
+    m.addVertex(course.groundMinX, 0.0f, course.groundMinZ, 0,1,0, 0.0f, v);
+    m.addQuad(0, 1, 2, 3);
+}
+
+// ----------------------- Malhas pré-processadas -------------------------
+//
+// Cubo, cones e rodas são processados uma vez e guardados em arquivo (--bake-meshes), que é
+// carregado na inicialização em vez de gerar a geometria de novo (sem o arquivo, o mesmo
+// processamento roda na memória). Passos: posições quantizadas em 16 bits relativas à caixa da
+// malha, normais em 10:10:10:2; vértices iguais após a quantização são unidos (costura do toro);
+// os triângulos são reordenados para o cache pós-transformação (Forsyth, LRU de 32) e os
+// vértices renumerados na ordem do primeiro uso.
+// Formato (ordem de bytes da máquina que gravou; seções alinhadas a 64 bytes):
+//   MeshFileHeader | MeshFileEntry x meshCount | por malha: vértices (PackedVertex) e índices (uint32)
+
+const char MESH_MAGIC[8] = {'B','A','L','I','Z','A','M','S'};
+const uint32_t MESH_VERSION = 1;
+const int BAKED_MESH_COUNT = 1 + 2 * LOD_LEVELS; // Cubo, cones por LOD, rodas por LOD.
+const int VCACHE_SIZE = 32;       // Cache LRU simulado pela otimização.
+const int VCACHE_FIFO_SIZE = 16;  // Cache FIFO usado para medir a taxa de faltas (ACMR).
+const char *meshFilePath = "malhas.bin"; // --meshes arquivo
+
+struct MeshFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;  // sizeof(MeshFileHeader) de quem gravou.
+    uint32_t meshCount;
+    uint32_t entrySize;   // sizeof(MeshFileEntry)
+    uint64_t fileSize;
+};
+
+struct MeshFileEntry {
+    float params[4];      // Parâmetros de geração (conferidos ao carregar).
+    float quantScale, quantOffset[3];
+    uint32_t vertexCount, indexCount;
+    uint64_t vertsOffset, indicesOffset;
+};
+
+// Malha 'k' da ordem do arquivo.
+Mesh &bakedMesh(int k) {
+    if(k == 0) return meshCube;
+    return k <= LOD_LEVELS ? meshConeLod[k - 1] : meshTorusLod[k - 1 - LOD_LEVELS];
+}
+
+// Parâmetros com que a malha 'k' é gerada; um arquivo com outros é descartado.
+void bakedMeshParams(int k, float p[4]) {
+    if(k == 0) { p[0] = 1.0f; p[1] = p[2] = p[3] = 0.0f; }
+    else if(k <= LOD_LEVELS) { p[0] = 0.22f; p[1] = 0.5f; p[2] = (float)CONE_LOD_SLICES[k-1]; p[3] = (float)CONE_LOD_STACKS[k-1]; }
+    else { int l = k - 1 - LOD_LEVELS; p[0] = 0.06f; p[1] = 0.12f; p[2] = (float)WHEEL_LOD_SIDES[l]; p[3] = (float)WHEEL_LOD_RINGS[l]; }
+}
+
+// Gera a malha 'k' em float (entrada do pré-processamento).
+void buildBakedSource(int k, Mesh &m) {
+    float p[4];
+    bakedMeshParams(k, p);
+    if(k == 0) buildCubeMesh(m, p[0]);
+    else if(k <= LOD_LEVELS) buildConeMesh(m, p[0], p[1], (int)p[2], (int)p[3]);
+    else buildTorusMesh(m, p[0], p[1], (int)p[2], (int)p[3]);
+}
+
+// Normal unitária -> 10:10:10:2 com sinal (w = 0), o formato de GL_INT_2_10_10_10_REV.
+uint32_t packNormal(float x, float y, float z) {
+    auto q = [](float v) { return (uint32_t)((int)lroundf(std::max(-1.0f, std::min(1.0f, v)) * 511.0f) & 0x3ff); };
+    return q(x) | q(y) << 10 | q(z) << 20;
+}
+
+void unpackNormal(uint32_t n, float out[3]) {
+    for(int a=0;a<3;a++){
+        int v = (int)(n >> (10 * a) & 0x3ff);
+        if(v >= 512) v -= 1024;
+        out[a] = std::max(-1.0f, v / 511.0f);
+    }
+}
+
+// Sem GL_INT_2_10_10_10_REV (GL < 3.3): as normais viram 3 bytes com sinal no mesmo lugar.
+void normalsToBytes(Mesh &m) {
+    for(PackedVertex &v : m.packed) {
+        float n[3];
+        unpackNormal(v.normal, n);
+        signed char b[4] = {(signed char)lroundf(n[0] * 127.0f), (signed char)lroundf(n[1] * 127.0f),
+                            (signed char)lroundf(n[2] * 127.0f), 0};
+        memcpy(&v.normal, b, 4);
+    }
+    m.normalBytes = true;
+}
+
+/**
+ * Posição e normal do vértice 'i' em float, para quem usa a malha na CPU (malha única dos
+ * cones sem instancing).
+ */
+void meshVertex(const Mesh &m, int i, float out[6]) {
+    if(!m.isPacked()) { memcpy(out, &m.verts[i * 8], 6 * sizeof(float)); return; }
+    const PackedVertex &v = m.packed[i];
+    for(int a=0;a<3;a++) out[a] = v.pos[a] * m.quantScale + m.quantOffset[a];
+    if(!m.normalBytes) unpackNormal(v.normal, out + 3);
+    else {
+        signed char b[4];
+        memcpy(b, &v.normal, 4);
+        for(int a=0;a<3;a++) out[3 + a] = b[a] / 127.0f;
+    }
+}
+
+// Faltas por triângulo (ACMR) num cache FIFO de 'size' vértices.
+float cacheMissRatio(const std::vector<GLuint> &indices, int size = VCACHE_FIFO_SIZE) {
+    if(indices.empty()) return 0.0f;
+    std::vector<GLuint> fifo(size, ~0u);
+    int head = 0, misses = 0;
+    for(GLuint v : indices) {
+        if(std::find(fifo.begin(), fifo.end(), v) != fifo.end()) continue;
+        fifo[head] = v;
+        head = (head + 1) % size;
+        misses++;
+    }
+    return misses / (indices.size() / 3.0f);
+}
+
+/**
+ * Reordena os triângulos para o cache pós-transformação (Forsyth, "Linear-Speed Vertex Cache
+ * Optimisation"): cada vértice pontua pela posição no cache LRU simulado e pelos triângulos
+ * que ainda faltam nele; emite-se sempre o triângulo de maior soma entre os vizinhos do cache.
+ */
+void optimizeVertexCache(std::vector<GLuint> &indices, int vertexCount) {
+    const int triCount = (int)indices.size() / 3;
+    std::vector<int> remaining(vertexCount, 0), cachePos(vertexCount, -1);
+    for(GLuint v : indices) remaining[v]++;
+    // Triângulos de cada vértice (CSR).
+    std::vector<int> start(vertexCount + 1, 0), tris(indices.size());
+    for(GLuint v : indices) start[v + 1]++;
+    for(int v=0;v<vertexCount;v++) start[v + 1] += start[v];
+    {
+        std::vector<int> fill(start.begin(), start.end() - 1);
+        for(int t=0;t<triCount;t++) for(int k=0;k<3;k++) tris[fill[indices[3*t + k]]++] = t;
+    }
+    std::vector<float> vscore(vertexCount), tscore(triCount, 0.0f);
+    std::vector<char> emitted(triCount, 0);
+    auto scoreOf = [&](int v) {
+        if(remaining[v] == 0) return -1.0f;
+        float s = 0.0f;
+        int p = cachePos[v];
+        if(p >= 0) s = p < 3 ? 0.75f : powf(1.0f - (p - 3) / (float)(VCACHE_SIZE - 3), 1.5f);
+        return s + 2.0f / sqrtf((float)remaining[v]);
+    };
+    for(int v=0;v<vertexCount;v++) vscore[v] = scoreOf(v);
+    for(int t=0;t<triCount;t++) for(int k=0;k<3;k++) tscore[t] += vscore[indices[3*t + k]];
+
+    std::vector<GLuint> out;
+    out.reserve(indices.size());
+    std::vector<int> cache, next;
+    int best = -1;
+    while((int)out.size() < 3 * triCount) {
+        if(best < 0) { // Nenhum vizinho no cache: o melhor entre os restantes.
+            float bs = -1e30f;
+            for(int t=0;t<triCount;t++) if(!emitted[t] && tscore[t] > bs) { bs = tscore[t]; best = t; }
+        }
+        emitted[best] = 1;
+        const GLuint *tri = &indices[3 * best];
+        next.assign(tri, tri + 3);
+        for(int k=0;k<3;k++) remaining[tri[k]]--;
+        out.insert(out.end(), tri, tri + 3);
+        for(int v : cache) if(v != (int)tri[0] && v != (int)tri[1] && v != (int)tri[2]) next.push_back(v);
+        for(size_t i=0;i<next.size();i++) cachePos[next[i]] = i < (size_t)VCACHE_SIZE ? (int)i : -1;
+        // Atualiza as pontuações dos vértices que entraram, mudaram de posição ou saíram.
+        best = -1;
+        float bs = -1e30f;
+        for(int v : next) {
+            float old = vscore[v];
+            vscore[v] = scoreOf(v);
+            for(int j=start[v];j<start[v + 1];j++) {
+                int t = tris[j];
+                if(emitted[t]) continue;
+                tscore[t] += vscore[v] - old;
+            }
+        }
+        for(size_t i=0;i<next.size() && i < (size_t)VCACHE_SIZE;i++)
+            for(int j=start[next[i]];j<start[next[i] + 1];j++) {
+                int t = tris[j];
+                if(!emitted[t] && tscore[t] > bs) { bs = tscore[t]; best = t; }
+            }
+        if(next.size() > (size_t)VCACHE_SIZE) next.resize(VCACHE_SIZE);
+        cache.swap(next);
+    }
+    indices.swap(out);
+}
+
+// Números do pré-processamento de uma malha (antes -> depois).
+struct BakeStats {
+    int vertsIn = 0, vertsOut = 0, tris = 0;
+    float acmrIn = 0, acmrOut = 0;
+    size_t bytesIn = 0, bytesOut = 0;  // Vértices + índices.
+    float maxError = 0;                // Maior erro de posição da quantização (m).
+};
+
+/**
+ * Pré-processa uma malha em float no lugar: quantiza, une vértices iguais, descarta triângulos
+ * degenerados, otimiza a ordem para o cache e renumera os vértices. Depois 'verts' fica vazio.
+ */
+BakeStats bakeMesh(Mesh &m) {
+    BakeStats st;
+    int n = m.vertexCount();
+    st.vertsIn = n;
+    st.acmrIn = cacheMissRatio(m.indices);
+    st.bytesIn = m.verts.size() * sizeof(float) + m.indices.size() * sizeof(GLuint);
+
+    // Caixa da malha; escala uniforme para que a normal não precise de correção.
+    float lo[3] = {1e30f, 1e30f, 1e30f}, hi[3] = {-1e30f, -1e30f, -1e30f};
+    for(int i=0;i<n;i++) for(int a=0;a<3;a++) { lo[a] = std::min(lo[a], m.verts[i*8 + a]); hi[a] = std::max(hi[a], m.verts[i*8 + a]); }
+    float half = 0.0f;
+    for(int a=0;a<3;a++) { m.quantOffset[a] = 0.5f * (lo[a] + hi[a]); half = std::max(half, 0.5f * (hi[a] - lo[a])); }
+    m.quantScale = half > 0.0f ? half / 32767.0f : 1.0f;
+
+    std::vector<PackedVertex> q(n);
+    for(int i=0;i<n;i++){
+        const float *s = &m.verts[i * 8];
+        for(int a=0;a<3;a++) {
+            q[i].pos[a] = (int16_t)lroundf((s[a] - m.quantOffset[a]) / m.quantScale);
+            st.maxError = std::max(st.maxError, fabsf(q[i].pos[a] * m.quantScale + m.quantOffset[a] - s[a]));
+        }
+        q[i].pos[3] = 0;
+        q[i].normal = packNormal(s[3], s[4], s[5]);
+    }
+
+    // União: ordena pelos bytes do vértice e aponta cada cópia para a primeira.
+    auto key = [&](int i) { uint64_t k; memcpy(&k, q[i].pos, 8); return std::make_pair(k, q[i].normal); };
+    std::vector<int> order(n), remap(n);
+    for(int i=0;i<n;i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return key(a) != key(b) ? key(a) < key(b) : a < b; });
+    for(int i=0;i<n;i++) remap[order[i]] = (i > 0 && key(order[i]) == key(order[i-1])) ? remap[order[i-1]] : order[i];
+    std::vector<GLuint> idx;
+    idx.reserve(m.indices.size());
+    for(size_t t=0;t+2<m.indices.size();t+=3){
+        GLuint a = remap[m.indices[t]], b = remap[m.indices[t+1]], c = remap[m.indices[t+2]];
+        if(a != b && b != c && a != c) { idx.push_back(a); idx.push_back(b); idx.push_back(c); }
+    }
+
+    // Malhas pequenas já geradas em faixas podem sair piores no FIFO: fica a melhor ordem.
+    std::vector<GLuint> opt = idx;
+    optimizeVertexCache(opt, n);
+    if(cacheMissRatio(opt) < cacheMissRatio(idx)) idx.swap(opt);
+
+    // Vértices na ordem do primeiro uso (leitura sequencial do buffer).
+    std::vector<int> newIndex(n, -1);
+    m.packed.clear();
+    for(GLuint &v : idx) {
+        if(newIndex[v] < 0) { newIndex[v] = (int)m.packed.size(); m.packed.push_back(q[v]); }
+        v = (GLuint)newIndex[v];
+    }
+    m.indices.swap(idx);
+    m.verts.clear();
+    m.verts.shrink_to_fit();
+    m.normalBytes = false;
+
+    st.vertsOut = (int)m.packed.size();
+    st.tris = (int)m.indices.size() / 3;
+    st.acmrOut = cacheMissRatio(m.indices);
+    st.bytesOut = m.packed.size() * sizeof(PackedVertex) + m.indices.size() * sizeof(GLuint);
+    return st;
+}
+
+// Confere cabeçalho, parâmetros e limites das seções; retorna a mensagem de erro ou NULL.
+const char *validateMeshFile(const unsigned char *data, size_t size) {
+    if(size < sizeof(MeshFileHeader)) return "arquivo menor que o cabecalho";
+    const MeshFileHeader &hd = *(const MeshFileHeader*)data;
+    if(memcmp(hd.magic, MESH_MAGIC, sizeof(MESH_MAGIC)) != 0) return "nao e um arquivo de malhas";
+    if(hd.version != MESH_VERSION) return "versao do formato nao suportada";
+    if(hd.headerSize != sizeof(MeshFileHeader) || hd.entrySize != sizeof(MeshFileEntry) || hd.fileSize != size)
+        return "cabecalho inconsistente";
+    if(hd.meshCount != (uint32_t)BAKED_MESH_COUNT ||
+       sizeof(MeshFileHeader) + (uint64_t)hd.meshCount * sizeof(MeshFileEntry) > size) return "numero de malhas diferente";
+    const MeshFileEntry *e = (const MeshFileEntry*)(data + sizeof(MeshFileHeader));
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        float p[4];
+        bakedMeshParams(k, p);
+        if(memcmp(p, e[k].params, sizeof(p)) != 0) return "malhas geradas com outra tesselacao";
+        struct { uint64_t off, len; } sec[2] = {{e[k].vertsOffset, (uint64_t)e[k].vertexCount * sizeof(PackedVertex)},
+                                               {e[k].indicesOffset, (uint64_t)e[k].indexCount * sizeof(uint32_t)}};
+        for(auto &s : sec)
+            if(!fileSectionFits(s.off, s.len, size)) return "secao fora do arquivo";
+        const uint32_t *idx = (const uint32_t*)(data + e[k].indicesOffset);
+        for(uint32_t i=0;i<e[k].indexCount;i++) if(idx[i] >= e[k].vertexCount) return "indice fora da malha";
+    }
+    return NULL;
+}
+
+/**
+ * Carrega as malhas pré-processadas de 'path'. Retorna false (sem mensagem) se o arquivo não
+ * existe e avisa se ele existe mas não serve; em ambos os casos quem chama processa na memória.
+ */
+bool loadBakedMeshes(const char *path) {
+    MappedFile f;
+    if(!f.open(path)) return false;
+    if(const char *err = validateMeshFile(f.data, f.size)) {
+        fprintf(stderr, "Malhas %s ignoradas: %s\n", path, err);
+        return false;
+    }
+    const MeshFileEntry *e = (const MeshFileEntry*)(f.data + sizeof(MeshFileHeader));
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        Mesh &m = bakedMesh(k);
+        const PackedVertex *v = (const PackedVertex*)(f.data + e[k].vertsOffset);
+        const uint32_t *idx = (const uint32_t*)(f.data + e[k].indicesOffset);
+        m.verts.clear();
+        m.packed.assign(v, v + e[k].vertexCount);
+        m.indices.assign(idx, idx + e[k].indexCount);
+        m.quantScale = e[k].quantScale;
+        memcpy(m.quantOffset, e[k].quantOffset, sizeof(m.quantOffset));
+        m.normalBytes = false;
+    }
+    return true;
+}
+
+// Gera e pré-processa todas as malhas na memória; 'stats' recebe os números de cada uma.
+void bakeAllMeshes(BakeStats *stats = NULL) {
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        Mesh &m = bakedMesh(k);
+        m = Mesh();
+        buildBakedSource(k, m);
+        BakeStats st = bakeMesh(m);
+        if(stats) stats[k] = st;
+    }
+}
+
+/**
+ * --bake-meshes [arquivo]: pré-processa as malhas, grava o arquivo carregado na inicialização
+ * e mostra, por malha, vértices, taxa de faltas no cache e bytes antes e depois.
+ */
+int runMeshBake(const char *path) {
+    BakeStats st[BAKED_MESH_COUNT];
+    auto t0 = std::chrono::steady_clock::now();
+    bakeAllMeshes(st);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    FILE *out = fopen(path, "wb");
+    if(!out) { fprintf(stderr, "Nao foi possivel criar %s\n", path); return 1; }
+    MeshFileHeader hd;
+    memset(&hd, 0, sizeof(hd));
+    memcpy(hd.magic, MESH_MAGIC, sizeof(MESH_MAGIC));
+    hd.version = MESH_VERSION;
+    hd.headerSize = sizeof(MeshFileHeader);
+    hd.meshCount = BAKED_MESH_COUNT;
+    hd.entrySize = sizeof(MeshFileEntry);
+    MeshFileEntry e[BAKED_MESH_COUNT];
+    memset(e, 0, sizeof(e));
+    fwrite(&hd, sizeof(hd), 1, out); // Cabeçalho e entradas são reescritos no fim.
+    fwrite(e, sizeof(e), 1, out);
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        const Mesh &m = bakedMesh(k);
+        bakedMeshParams(k, e[k].params);
+        e[k].quantScale = m.quantScale;
+        memcpy(e[k].quantOffset, m.quantOffset, sizeof(m.quantOffset));
+        e[k].vertexCount = (uint32_t)m.packed.size();
+        e[k].indexCount = (uint32_t)m.indices.size();
+        e[k].vertsOffset = padFileSection(out);
+        fwrite(m.packed.data(), sizeof(PackedVertex), m.packed.size(), out);
+        e[k].indicesOffset = padFileSection(out);
+        fwrite(m.indices.data(), sizeof(GLuint), m.indices.size(), out);
+    }
+    hd.fileSize = (uint64_t)ftell(out);
+    fseek(out, 0, SEEK_SET);
+    fwrite(&hd, sizeof(hd), 1, out);
+    fwrite(e, sizeof(e), 1, out);
+    bool ok = !ferror(out);
+    ok = fclose(out) == 0 && ok;
+    if(!ok) { fprintf(stderr, "Erro ao gravar %s\n", path); return 1; }
+
+    printf("%s: %d malhas, %.1f KB, processadas em %.2f ms (cache FIFO de %d para a taxa de faltas)\n",
+           path, BAKED_MESH_COUNT, hd.fileSize / 1024.0, ms, VCACHE_FIFO_SIZE);
+    printf("  %-8s %13s %6s %15s %15s %17s %10s\n", "malha", "vertices", "tris", "faltas/tri", "bytes/vertice", "bytes (v+i)", "erro (um)");
+    double acmrIn = 0, acmrOut = 0;
+    size_t bytesIn = 0, bytesOut = 0, vertsIn = 0, vertsOut = 0;
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        char name[16];
+        if(k == 0) snprintf(name, sizeof(name), "cubo");
+        else if(k <= LOD_LEVELS) snprintf(name, sizeof(name), "cone%d", k - 1);
+        else snprintf(name, sizeof(name), "roda%d", k - 1 - LOD_LEVELS);
+        const BakeStats &s = st[k];
+        printf("  %-8s %6d->%-6d %6d %6.3f->%-6.3f %6d->%-6d %8zu->%-8zu %10.2f\n", name, s.vertsIn, s.vertsOut, s.tris,
+               s.acmrIn, s.acmrOut, (int)(8 * sizeof(float)), (int)sizeof(PackedVertex), s.bytesIn, s.bytesOut,
+               s.maxError * 1e6f);
+        acmrIn += s.acmrIn; acmrOut += s.acmrOut;
+        bytesIn += s.bytesIn; bytesOut += s.bytesOut;
+        vertsIn += s.vertsIn; vertsOut += s.vertsOut;
+    }
+    printf("  media de faltas/tri %.3f -> %.3f; vertices %zu -> %zu; bytes %zu -> %zu (%.0f%%)\n",
+           acmrIn / BAKED_MESH_COUNT, acmrOut / BAKED_MESH_COUNT, vertsIn, vertsOut, bytesIn, bytesOut,
+           100.0 * bytesOut / bytesIn);
+    return 0;
+}
+
+// ----------------------- Envio e desenho das malhas ---------------------
+
+// Envia a malha para VBO/IBO (se houver suporte); sem VBO ela é desenhada da memória do cliente.
+void uploadMesh(Mesh &m) {
+    if(!glHasVBO) return;
+    if(!m.vbo) { glf.GenBuffers(1, &m.vbo); glf.GenBuffers(1, &m.ibo); }
+    glf.BindBuffer(GL_ARRAY_BUFFER, m.vbo);
+    if(m.isPacked())
+        glf.BufferData(GL_ARRAY_BUFFER, m.packed.size() * sizeof(PackedVertex), m.packed.data(), GL_STATIC_DRAW);
+    else
+        glf.BufferData(GL_ARRAY_BUFFER, m.verts.size() * sizeof(float), m.verts.data(), GL_STATIC_DRAW);
+    glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ibo);
+    glf.BufferData(GL_ELEMENT_ARRAY_BUFFER, m.indices.size() * sizeof(GLuint), m.indices.data(), GL_STATIC_DRAW);
+    glf.BindBuffer(GL_ARRAY_BUFFER, 0);
+    glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Reenvia só os índices (os vértices já estão no buffer).
+void uploadMeshIndices(Mesh &m) {
+    if(!glHasVBO || !m.ibo) return;
+    glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ibo);
+    glf.BufferData(GL_ELEMENT_ARRAY_BUFFER, m.indices.size() * sizeof(GLuint), m.indices.data(), GL_STREAM_DRAW);
+    glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Aponta os arrays de vértice/normal/textura para a malha. Retorna o ponteiro base dos índices.
+const void *bindMesh(const Mesh &m, bool texCoords) {
+    const char *base = 0;
+    const void *idx = 0;
+    if(glHasVBO) {
+        glf.BindBuffer(GL_ARRAY_BUFFER, m.vbo);
+        glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ibo);
+    } else {
+        base = m.isPacked() ? (const char*)m.packed.data() : (const char*)m.verts.data();
+        idx = m.indices.data();
+    }
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    if(m.isPacked()) {
+        // A escala/deslocamento da quantização entram na matriz em drawBoundMesh.
+        const GLsizei stride = sizeof(PackedVertex);
+        glVertexPointer(3, GL_SHORT, stride, base);
+        glNormalPointer(m.normalBytes ? GL_BYTE : GL_INT_2_10_10_10_REV, stride, base + offsetof(PackedVertex, normal));
+        return idx;
+    }
+    const GLsizei stride = 8 * sizeof(float);
+    glVertexPointer(3, GL_FLOAT, stride, base);
+    glNormalPointer(GL_FLOAT, stride, base + 3 * sizeof(float));
+    if(texCoords) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, stride, base + 6 * sizeof(float));
+    }
+    return idx;
+}
+
+void unbindMesh() {
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    if(glHasVBO) {
+        glf.BindBuffer(GL_ARRAY_BUFFER, 0);
+        glf.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+// Desenha uma malha já ligada com bindMesh (uma chamada de desenho).
+void drawBoundMesh(const Mesh &m, const void *idx) {
+    if(m.isPacked()) {
+        // Escala uniforme: GL_NORMALIZE devolve o comprimento das normais.
+        glPushMatrix();
+        glTranslatef(m.quantOffset[0], m.quantOffset[1], m.quantOffset[2]);
+        glScalef(m.quantScale, m.quantScale, m.quantScale);
+    }
+    glDrawElements(GL_TRIANGLES, (GLsizei)m.indices.size(), GL_UNSIGNED_INT, idx);
+    if(m.isPacked()) glPopMatrix();
+    renderStats.drawCalls++;
+}
+
+// Shader dos cones instanciados: desloca a malha por instância e repete a iluminação fixa
+// (ambiente global + luz 0 difusa/especular, GL_COLOR_MATERIAL em AMBIENT_AND_DIFFUSE).
+const char *CONE_VS =
+    "#version 120\n"
+    "attribute vec3 instanceData; // x, z, derrubado (0/1)\n"
+    "uniform vec4 dequant;        // Malha quantizada: deslocamento (xyz) e escala (w)\n"
+    "varying vec4 color;\n"
+    "void main() {\n"
+    "    vec4 base = mix(vec4(1.0, 0.45, 0.05, 1.0), vec4(0.45, 0.2, 0.05, 1.0), instanceData.z);\n"
+    "    vec3 n = normalize(gl_NormalMatrix * gl_Normal);\n"
+    "    vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+    "    float nl = max(dot(n, l), 0.0);\n"
+    "    vec4 c = (gl_LightModel.ambient + gl_LightSource[0].ambient + nl * gl_LightSource[0].diffuse) * base;\n"
+    "    if(nl > 0.0)\n"
+    "        c += pow(max(dot(n, normalize(gl_LightSource[0].halfVector.xyz)), 0.0), gl_FrontMaterial.shininess)\n"
+    "             * gl_LightSource[0].specular * gl_FrontMaterial.specular;\n"
+    "    color = vec4(c.rgb, 1.0);\n"
+    "    vec3 p = gl_Vertex.xyz * dequant.w + dequant.xyz + vec3(instanceData.x, 0.0, instanceData.y);\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4(p, 1.0);\n"
+    "}\n";
+const char *CONE_FS =
+    "#version 120\n"
+    "varying vec4 color;\n"
+    "void main() { gl_FragColor = color; }\n";
+
+// Compila o programa dos cones; retorna 0 (e usa a malha pré-transformada) se falhar.
+GLuint buildConeProgram() {
+    auto compile = [](GLenum type, const char *src) -> GLuint {
+        GLuint sh = glf.CreateShader(type);
+        glf.ShaderSource(sh, 1, &src, NULL);
+        glf.CompileShader(sh);
+        GLint ok = 0;
+        glf.GetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+        if(!ok) {
+            char log[1024];
+            glf.GetShaderInfoLog(sh, sizeof(log), NULL, log);
+            fprintf(stderr, "Shader dos cones nao compilou: %s\n", log);
+            return 0;
+        }
+        return sh;
+    };
+    GLuint vs = compile(GL_VERTEX_SHADER, CONE_VS), fs = compile(GL_FRAGMENT_SHADER, CONE_FS);
+    if(!vs || !fs) return 0;
+    GLuint prog = glf.CreateProgram();
+    glf.AttachShader(prog, vs);
+    glf.AttachShader(prog, fs);
+    glf.BindAttribLocation(prog, CONE_INSTANCE_ATTRIB, "instanceData");
+    glf.LinkProgram(prog);
+    GLint ok = 0;
+    glf.GetProgramiv(prog, GL_LINK_STATUS, &ok);
+    if(ok) coneDequantUniform = glf.GetUniformLocation(prog, "dequant");
+    return ok ? prog : 0;
+}
+
+// Passa ao shader dos cones a quantização da malha ligada (com o programa em uso).
+void setConeDequant(const Mesh &m) {
+    if(m.isPacked()) glf.Uniform4f(coneDequantUniform, m.quantOffset[0], m.quantOffset[1], m.quantOffset[2], m.quantScale);
+    else glf.Uniform4f(coneDequantUniform, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+/**
+ * Gera e envia as malhas uma única vez (chamada após criar o contexto GL).
+ */
+void initMeshes() {
+    loadGLFunctions();
+    buildGroundMesh(meshGround);
+    uploadMesh(meshGround);
+    if(!loadBakedMeshes(meshFilePath)) bakeAllMeshes();
+    for(int k=0;k<BAKED_MESH_COUNT;k++){
+        if(!glHasPackedNormals) normalsToBytes(bakedMesh(k));
+        uploadMesh(bakedMesh(k));
+    }
+
+    if(allowInstancing && glHasVBO && glf.DrawElementsInstanced && glf.VertexAttribDivisor)
+        coneProgram = buildConeProgram();
+    glHasInstancing = coneProgram != 0;
+    if(glHasInstancing) { glf.GenBuffers(1, &coneInstanceVBO); glf.GenBuffers(1, &coneVisibleVBO); }
+}
+
+// Dados de instância de um cone: posição e estado.
+inline void coneInstance(int i, float out[3]) {
+    out[0] = cones[i].first;
+    out[1] = cones[i].second;
+    out[2] = coneView.knocked[i] ? 1.0f : 0.0f;
+}
+
+/**
+ * Sem instancing: monta os índices de meshConeBatch para os cones 'coneAt(0..n-1)', em pé
+ * primeiro e derrubados depois, para desenhar cada grupo com sua cor em uma chamada.
+ */
+template<class F> void buildConeBatchIndices(size_t n, F coneAt) {
+    int nv = meshCone.vertexCount();
+    meshConeBatch.indices.clear();
+    meshConeBatch.indices.reserve(n * meshCone.indices.size());
+    for(int pass=0;pass<2;pass++){
+        if(pass == 1) coneBatchStandingIndices = (int)meshConeBatch.indices.size();
+        for(size_t k=0;k<n;k++){
+            int c = coneAt(k);
+            if((coneView.knocked[c] != 0) != (pass == 1)) continue;
+            GLuint first = (GLuint)(c * nv);
+            for(GLuint idx : meshCone.indices) meshConeBatch.indices.push_back(first + idx);
+        }
+    }
+}
+
+/**
+ * Sincroniza os buffers dos cones com 'cones'/coneView: reenvia tudo quando o percurso
+ * muda e só os cones alterados quando algum é derrubado.
+ */
+void syncConeBuffers() {
+    bool full = coneUploadedVersion != coneView.layoutVersion;
+    if(!full && coneView.changes.empty()) return;
+
+    if(glHasInstancing) {
+        glf.BindBuffer(GL_ARRAY_BUFFER, coneInstanceVBO);
+        if(full) {
+            std::vector<float> data(cones.size() * 3);
+            for(size_t i=0;i<cones.size();i++) coneInstance((int)i, &data[i*3]);
+            glf.BufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_DYNAMIC_DRAW);
+        } else {
+            for(int i : coneView.changes) {
+                float d[3];
+                coneInstance(i, d);
+                glf.BufferSubData(GL_ARRAY_BUFFER, i * sizeof(d), sizeof(d), d);
+            }
+        }
+        glf.BindBuffer(GL_ARRAY_BUFFER, 0);
+    } else {
+        // Sem instancing: uma malha única com todos os cones já transladados. Os vértices só
+        // mudam com o percurso; com culling os índices são refeitos a cada frame em
+        // drawConesRetained.
+        int nv = meshCone.vertexCount();
+        if(full) {
+            meshConeBatch.verts.clear();
+            meshConeBatch.verts.reserve(cones.size() * nv * 8);
+            for(size_t c=0;c<cones.size();c++)
+                for(int v=0;v<nv;v++){
+                    float s[6];
+                    meshVertex(meshCone, v, s);
+                    meshConeBatch.addVertex(s[0] + cones[c].first, s[1], s[2] + cones[c].second, s[3], s[4], s[5]);
+                }
+        }
+        if(!allowCulling) buildConeBatchIndices(cones.size(), [](size_t k) { return (int)k; });
+        if(full) uploadMesh(meshConeBatch);
+        else if(!allowCulling) uploadMeshIndices(meshConeBatch);
+    }
+    coneView.changes.clear();
+    coneUploadedVersion = coneView.layoutVersion;
+}
+
+/**
+ * Desenha os cones de 'vis' com instancing: as instâncias visíveis vão para coneVisibleVBO
+ * agrupadas por LOD e cada nível é uma chamada instanciada com sua malha.
+ */
+void drawConesInstancedCulled(const ConeVisibility &vis) {
+    static std::vector<float> data;
+    size_t total = 0;
+    for(auto &l : vis.lod) total += l.size();
+    if(total == 0) return;
+    data.resize(total * 3);
+    size_t k = 0;
+    for(auto &l : vis.lod)
+        for(int i : l) coneInstance(i, &data[3 * k++]);
+    glf.BindBuffer(GL_ARRAY_BUFFER, coneVisibleVBO);
+    glf.BufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STREAM_DRAW);
+
+    glState.useProgram(coneProgram);
+    glf.EnableVertexAttribArray(CONE_INSTANCE_ATTRIB);
+    glf.VertexAttribDivisor(CONE_INSTANCE_ATTRIB, 1);
+    size_t first = 0;
+    for(int l=0;l<LOD_LEVELS;l++){
+        if(vis.lod[l].empty()) continue;
+        const void *idx = bindMesh(meshConeLod[l], false);
+        setConeDequant(meshConeLod[l]);
+        glf.BindBuffer(GL_ARRAY_BUFFER, coneVisibleVBO);
+        glf.VertexAttribPointer(CONE_INSTANCE_ATTRIB, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                                (const void*)(first * 3 * sizeof(float)));
+        glf.DrawElementsInstanced(GL_TRIANGLES, (GLsizei)meshConeLod[l].indices.size(), GL_UNSIGNED_INT, idx,
+                                  (GLsizei)vis.lod[l].size());
+        renderStats.drawCalls++;
+        first += vis.lod[l].size();
+    }
+    glf.VertexAttribDivisor(CONE_INSTANCE_ATTRIB, 0);
+    glf.DisableVertexAttribArray(CONE_INSTANCE_ATTRIB);
+    glState.useProgram(0);
+    unbindMesh();
+}
+
+/**
+ * Desenha os cones: chamadas instanciadas (uma por LOD com culling, uma só sem) ou, sem
+ * instancing, duas chamadas sobre a malha pré-transformada (cones em pé e derrubados).
+ */
+void drawConesRetained() {
+    syncConeBuffers();
+    if(cones.empty()) return;
+    if(glHasInstancing && allowCulling) {
+        drawConesInstancedCulled(coneVis);
+        return;
+    }
+    if(glHasInstancing) {
+        const void *idx = bindMesh(meshCone, false);
+        glState.useProgram(coneProgram);
+        setConeDequant(meshCone);
+        glf.BindBuffer(GL_ARRAY_BUFFER, coneInstanceVBO);
+        glf.EnableVertexAttribArray(CONE_INSTANCE_ATTRIB);
+        glf.VertexAttribPointer(CONE_INSTANCE_ATTRIB, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), 0);
+        glf.VertexAttribDivisor(CONE_INSTANCE_ATTRIB, 1);
+        glf.DrawElementsInstanced(GL_TRIANGLES, (GLsizei)meshCone.indices.size(), GL_UNSIGNED_INT, idx, (GLsizei)cones.size());
+        renderStats.drawCalls++;
+        glf.VertexAttribDivisor(CONE_INSTANCE_ATTRIB, 0);
+        glf.DisableVertexAttribArray(CONE_INSTANCE_ATTRIB);
+        glState.useProgram(0);
+        unbindMesh();
+        return;
+    }
+    if(allowCulling) {
+        // Sem instancing a malha única só tem o nível 0: os visíveis de todos os níveis entram nela.
+        static std::vector<int> visible;
+        visible.clear();
+        for(auto &l : coneVis.lod) visible.insert(visible.end(), l.begin(), l.end());
+        buildConeBatchIndices(visible.size(), [&](size_t k) { return visible[k]; });
+        uploadMeshIndices(meshConeBatch);
+    }
+    const char *idx = (const char*)bindMesh(meshConeBatch, false);
+    int total = (int)meshConeBatch.indices.size();
+    if(coneBatchStandingIndices > 0) {
+        glColor3f(1.0f, 0.45f, 0.05f);
+        glDrawElements(GL_TRIANGLES, coneBatchStandingIndices, GL_UNSIGNED_INT, idx);
+        renderStats.drawCalls++;
+    }
+    if(total > coneBatchStandingIndices) {
+        glColor3f(0.45f, 0.2f, 0.05f);
+        glDrawElements(GL_TRIANGLES, total - coneBatchStandingIndices, GL_UNSIGNED_INT,
+                       idx + coneBatchStandingIndices * sizeof(GLuint));
+        renderStats.drawCalls++;
+    }
+    unbindMesh();
+}
+
+// Desenha o chão a partir da malha em cache (mesmo resultado de drawGroundTextured).
+void drawGroundRetained() {
+    glState.enable(GL_TEXTURE_2D);
+    glState.bindTexture(texAsphalt);
+    glColor3f(1.0f,1.0f,1.0f);
+    drawBoundMesh(meshGround, bindMesh(meshGround, true));
+    unbindMesh();
+    glState.disable(GL_TEXTURE_2D);
+}
+
+/**
+ * Desenha o carro com as malhas em cache (mesmas transformações de drawCarModel).
+ */
+void drawCarRetained(const Car &c, int wheelLod = 0) {
+    glPushMatrix();
+      glTranslatef(c.x, c.y + 0.25f, c.z);
+      glRotatef(c.heading, 0,1,0);
+
+      const void *idx = bindMesh(meshCube, false);
+      // Corpo
+      glPushMatrix();
+        glColor3f(0.15f, 0.25f, 0.9f);
+        glScalef(1.1f, 0.5f, 1.8f);
+        drawBoundMesh(meshCube, idx);
+      glPopMatrix();
+      // Teto
+      glPushMatrix();
+        glColor3f(0.8f, 0.9f, 0.95f);
+        glTranslatef(0.0f, 0.35f, -0.1f);
+        glScalef(0.7f, 0.3f, 0.6f);
+        drawBoundMesh(meshCube, idx);
+      glPopMatrix();
+
+      // Rodas: dianteiras com esterço, traseiras retas.
+      const Mesh &wheel = meshTorusLod[wheelLod];
+      idx = bindMesh(wheel, false);
+      glColor3f(0.02f,0.02f,0.02f);
+      const float wx=0.55f, wz=0.65f, wy=-0.25f;
+      const float wheels[4][3] = {{-wx, wy, -wz}, {wx, wy, -wz}, {-wx, wy, wz}, {wx, wy, wz}};
+      for(int k=0;k<4;k++){
+        glPushMatrix();
+          glTranslatef(wheels[k][0], wheels[k][1], wheels[k][2]);
+          if(k < 2) glRotatef(c.wheelAngle, 0, 1, 0);
+          drawBoundMesh(wheel, idx);
+        glPopMatrix();
+      }
+      unbindMesh();
+    glPopMatrix();
+}
+
+// ----------------------- Chão em blocos (mundo aberto) -------------------------
+//
+// Com --open-world o carro não tem limites e o chão vira uma grade sem fim de blocos de
+// GROUND_TILE_M metros. Cada bloco tem a própria textura de asfalto (um canal), gerada pelo
+// ruído de generateAsphaltRows nas coordenadas globais dos texels: vizinhos continuam o padrão
+// e o mesmo bloco sai sempre igual. Threads auxiliares geram os blocos; com PBO escrevem direto
+// no buffer mapeado e o envio é um glTexSubImage2D a partir dele (cópia feita pelo driver), no
+// máximo GROUND_UPLOADS_PER_FRAME por frame. As texturas formam um cache LRU de tamanho fixo
+// (--ground-cache-mb): um bloco novo reaproveita a textura do bloco usado há mais tempo, então
+// a memória não cresce com a distância percorrida. Enquanto um bloco não chega, e além de
+// GROUND_VIEW_RADIUS, aparece a textura base repetida, desenhada atrás dos blocos (polygon offset).
+
+const float GROUND_TILE_M = 8.0f;           // Lado de um bloco (m).
+const int GROUND_TILE_TEXELS = 256;         // Texels por lado (32 por metro).
+const int GROUND_TILE_BIAS = 1 << 20;       // Soma às coordenadas dos blocos para o ruído só ver texels >= 0 (±8000 km).
+const float GROUND_VIEW_RADIUS = 64.0f;     // Blocos pedidos até esta distância da câmera (m).
+const float GROUND_FAR = 300.0f;            // Meia largura do chão base (plano distante da projeção).
+const float GROUND_BASE_REPEAT_M = 4.0f;    // Período da textura base no chão (m), como no percurso padrão.
+const int GROUND_MAX_INFLIGHT = 16;         // Blocos sendo gerados ou esperando envio.
+const int GROUND_UPLOADS_PER_FRAME = 4;
+const size_t GROUND_TILE_BYTES = (size_t)GROUND_TILE_TEXELS * GROUND_TILE_TEXELS;
+int groundCacheMB = 16;                     // --ground-cache-mb N: orçamento das texturas dos blocos.
+
+// Uma textura do cache e o bloco que ela guarda.
+struct GroundSlot {
+    enum State { EMPTY, PENDING, READY };
+    GLuint tex = 0;
+    int tx = 0, tz = 0;
+    State state = EMPTY;
+    unsigned long long lastUsed = 0;        // Último frame em que o bloco foi pedido.
+};
+
+// Um bloco em geração: destino dos texels (PBO mapeado ou memória) e slot de chegada.
+struct GroundJob {
+    int slot = -1;
+    int tx = 0, tz = 0;
+    unsigned char *dst = nullptr;
+    GLuint pbo = 0;
+    bool mapped = false;
+    std::vector<unsigned char> staging;     // Destino sem PBO.
+};
+
+struct GroundStreamer {
+    bool active = false;
+    std::vector<GroundSlot> slots;
+    std::unordered_map<long long, int> slotOf; // Bloco -> slot (só blocos PENDING/READY).
+    GroundJob jobs[GROUND_MAX_INFLIGHT];
+    std::vector<int> freeJobs;
+    std::vector<int> uploads;               // Jobs gerados esperando envio (thread do desenho).
+    std::vector<int> visible;               // Slots prontos desenhados neste frame.
+    std::vector<unsigned char> streakPattern;
+    unsigned long long frame = 0;
+
+    // Fila das threads auxiliares (mesmo esquema do FrameWriter).
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<int> todo;
+    std::vector<int> done;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    // Estatísticas (HUD e modo headless).
+    long long generated = 0, evicted = 0;
+    int resident = 0, missing = 0;
+    double updateMs = 0.0;                  // Custo de update() no thread do desenho, último frame.
+
+    static long long key(int tx, int tz) { return ((long long)tx << 32) ^ (unsigned int)tz; }
+
+    void init() {
+        int n = std::max(1, (int)((size_t)groundCacheMB * 1024 * 1024 / GROUND_TILE_BYTES));
+        slots.resize(n);
+        std::vector<GLuint> ids(n);
+        glGenTextures(n, ids.data());
+        for(int i=0;i<n;i++){
+            slots[i].tex = ids[i];
+            glState.bindTexture(ids[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8, GROUND_TILE_TEXELS, GROUND_TILE_TEXELS, 0,
+                         GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        bool pbo = glHasPBO && !useImmediateMode;
+        for(int j=0;j<GROUND_MAX_INFLIGHT;j++){
+            if(pbo) glf.GenBuffers(1, &jobs[j].pbo);
+            else jobs[j].staging.resize(GROUND_TILE_BYTES);
+            freeJobs.push_back(j);
+        }
+        streakPattern.resize(GROUND_TILE_TEXELS + 37);
+        for(int i=0;i<GROUND_TILE_TEXELS+37;i++) streakPattern[i] = (i % 37 < 8) ? 0xFF : 0x00;
+        int threads = std::max(1, std::min(4, (int)std::thread::hardware_concurrency() - 1));
+        for(int t=0;t<threads;t++) workers.emplace_back([this]() { work(); });
+        active = true;
+    }
+
+    void stop() {
+        if(!active) return;
+        { std::lock_guard<std::mutex> lk(mtx); stopping = true; }
+        cv.notify_all();
+        for(auto &t : workers) t.join();
+        workers.clear();
+        active = false;
+    }
+
+    // Thread auxiliar: gera os texels do bloco no destino do job.
+    void work() {
+        for(;;) {
+            int j;
+            {
+                std::unique_lock<std::mutex> lk(mtx);
+                cv.wait(lk, [this]() { return stopping || !todo.empty(); });
+                if(stopping) return;
+                j = todo.front();
+                todo.pop_front();
+            }
+            GroundJob &g = jobs[j];
+            generateAsphaltRows(g.dst, GROUND_TILE_TEXELS, asphaltSeed, 0, GROUND_TILE_TEXELS, streakPattern.data(),
+                                (g.tx + GROUND_TILE_BIAS) * GROUND_TILE_TEXELS, (g.tz + GROUND_TILE_BIAS) * GROUND_TILE_TEXELS);
+            std::lock_guard<std::mutex> lk(mtx);
+            done.push_back(j);
+        }
+    }
+
+    // Slot para um bloco novo: vazio ou o usado há mais tempo (nunca um pedido neste frame).
+    int evictLRU() {
+        int best = -1;
+        for(int i=0;i<(int)slots.size();i++){
+            const GroundSlot &sl = slots[i];
+            if(sl.state == GroundSlot::PENDING || (sl.state == GroundSlot::READY && sl.lastUsed == frame)) continue;
+            if(sl.state == GroundSlot::EMPTY) return i;
+            if(best < 0 || sl.lastUsed < slots[best].lastUsed) best = i;
+        }
+        if(best >= 0) { slotOf.erase(key(slots[best].tx, slots[best].tz)); slots[best].state = GroundSlot::EMPTY; evicted++; resident--; }
+        return best;
+    }
+
+    // Entrega o bloco (tx, tz) às threads auxiliares.
+    void request(int tx, int tz) {
+        int slot = evictLRU();
+        if(slot < 0) return;
+        int j = freeJobs.back();
+        freeJobs.pop_back();
+        GroundJob &g = jobs[j];
+        g.slot = slot; g.tx = tx; g.tz = tz;
+        g.mapped = false;
+        if(g.pbo) {
+            glf.BindBuffer(GL_PIXEL_UNPACK_BUFFER, g.pbo);
+            glf.BufferData(GL_PIXEL_UNPACK_BUFFER, GROUND_TILE_BYTES, NULL, GL_STREAM_DRAW); // Descarta o conteúdo anterior.
+            g.dst = (unsigned char*)glf.MapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+            glf.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            g.mapped = g.dst != nullptr;
+        }
+        if(!g.mapped) { g.staging.resize(GROUND_TILE_BYTES); g.dst = g.staging.data(); }
+        GroundSlot &sl = slots[slot];
+        sl.tx = tx; sl.tz = tz; sl.state = GroundSlot::PENDING; sl.lastUsed = frame;
+        slotOf[key(tx, tz)] = slot;
+        { std::lock_guard<std::mutex> lk(mtx); todo.push_back(j); }
+        cv.notify_one();
+    }
+
+    // Copia um bloco gerado para a textura do seu slot.
+    void upload(int j) {
+        GroundJob &g = jobs[j];
+        GroundSlot &sl = slots[g.slot];
+        glState.bindTexture(sl.tex);
+        if(g.mapped) {
+            glf.BindBuffer(GL_PIXEL_UNPACK_BUFFER, g.pbo);
+            glf.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GROUND_TILE_TEXELS, GROUND_TILE_TEXELS, GL_LUMINANCE, GL_UNSIGNED_BYTE, (const void*)0);
+            glf.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GROUND_TILE_TEXELS, GROUND_TILE_TEXELS, GL_LUMINANCE, GL_UNSIGNED_BYTE, g.dst);
+        }
+        sl.state = GroundSlot::READY;
+        generated++;
+        resident++;
+        freeJobs.push_back(j);
+    }
+
+    /**
+     * Uma vez por frame (thread do desenho): envia blocos prontos, marca os visíveis como usados e
+     * pede os que faltam, do mais perto para o mais longe. Nunca espera as threads auxiliares.
+     */
+    void update(const Frustum &f, float cx, float cz) {
+        auto t0 = std::chrono::steady_clock::now();
+        frame++;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            uploads.insert(uploads.end(), done.begin(), done.end());
+            done.clear();
+        }
+        int n = std::min((int)uploads.size(), GROUND_UPLOADS_PER_FRAME);
+        for(int i=0;i<n;i++) upload(uploads[i]);
+        uploads.erase(uploads.begin(), uploads.begin() + n);
+
+        // Blocos dentro do raio e do frustum, ordenados pela distância à câmera.
+        struct Want { float d; int tx, tz; bool operator<(const Want &o) const { return d < o.d; } };
+        static std::vector<Want> want;
+        want.clear();
+        const float half = GROUND_TILE_M * 0.5f, bound = GROUND_TILE_M * 0.7072f;
+        int x0 = (int)floorf((std::max(cx - GROUND_VIEW_RADIUS, f.minX)) / GROUND_TILE_M);
+        int x1 = (int)floorf((std::min(cx + GROUND_VIEW_RADIUS, f.maxX)) / GROUND_TILE_M);
+        int z0 = (int)floorf((std::max(cz - GROUND_VIEW_RADIUS, f.minZ)) / GROUND_TILE_M);
+        int z1 = (int)floorf((std::min(cz + GROUND_VIEW_RADIUS, f.maxZ)) / GROUND_TILE_M);
+        for(int tz=z0;tz<=z1;tz++)
+            for(int tx=x0;tx<=x1;tx++){
+                float mx = tx * GROUND_TILE_M + half, mz = tz * GROUND_TILE_M + half;
+                float d = sqrtf((mx - cx) * (mx - cx) + (mz - cz) * (mz - cz));
+                if(d > GROUND_VIEW_RADIUS + bound || !f.sphereVisible(mx, 0.0f, mz, bound)) continue;
+                want.push_back(Want{d, tx, tz});
+            }
+        std::sort(want.begin(), want.end());
+
+        visible.clear();
+        missing = 0;
+        for(const Want &w : want){
+            auto it = slotOf.find(key(w.tx, w.tz));
+            if(it != slotOf.end()) {
+                GroundSlot &sl = slots[it->second];
+                sl.lastUsed = frame;
+                if(sl.state == GroundSlot::READY) { visible.push_back(it->second); continue; }
+            } else if(!freeJobs.empty()) request(w.tx, w.tz);
+            missing++;
+        }
+        updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+} ground;
+
+void groundStop() { ground.stop(); }
+
+/**
+ * Desenha o chão do mundo aberto: textura base até GROUND_FAR em volta da câmera e, por cima,
+ * os blocos prontos (uma chamada por bloco, cada um com sua textura).
+ */
+void drawGroundStreamed(const Camera &c) {
+    ground.update(viewFrustum, c.x, c.z);
+    glState.enable(GL_TEXTURE_2D);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glNormal3f(0, 1, 0);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    // Base: coordenadas de textura presas ao mundo, relativas a um período perto da câmera (precisão).
+    float ox = floorf(c.x / GROUND_BASE_REPEAT_M) * GROUND_BASE_REPEAT_M;
+    float oz = floorf(c.z / GROUND_BASE_REPEAT_M) * GROUND_BASE_REPEAT_M;
+    float bx0 = c.x - GROUND_FAR, bx1 = c.x + GROUND_FAR, bz0 = c.z - GROUND_FAR, bz1 = c.z + GROUND_FAR;
+    float u0 = (bx0 - ox) / GROUND_BASE_REPEAT_M, u1 = (bx1 - ox) / GROUND_BASE_REPEAT_M;
+    float v0 = (bz1 - oz) / GROUND_BASE_REPEAT_M, v1 = (bz0 - oz) / GROUND_BASE_REPEAT_M;
+    float base[20] = {bx0, 0, bz1, u0, v0,  bx1, 0, bz1, u1, v0,  bx1, 0, bz0, u1, v1,  bx0, 0, bz0, u0, v1};
+    glState.bindTexture(texAsphalt);
+    glState.enable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.0f, 1.0f); // Atrás dos blocos, no mesmo plano.
+    glVertexPointer(3, GL_FLOAT, 5 * sizeof(float), base);
+    glTexCoordPointer(2, GL_FLOAT, 5 * sizeof(float), base + 3);
+    glDrawArrays(GL_QUADS, 0, 4);
+    glState.disable(GL_POLYGON_OFFSET_FILL);
+    renderStats.drawCalls++;
+
+    // Blocos: texel (0, 0) no canto (menor x, menor z).
+    static std::vector<float> verts;
+    verts.clear();
+    for(int i : ground.visible){
+        float x0 = ground.slots[i].tx * GROUND_TILE_M, z0 = ground.slots[i].tz * GROUND_TILE_M;
+        float x1 = x0 + GROUND_TILE_M, z1 = z0 + GROUND_TILE_M;
+        float q[20] = {x0, 0, z0, 0, 0,  x0, 0, z1, 0, 1,  x1, 0, z1, 1, 1,  x1, 0, z0, 1, 0};
+        verts.insert(verts.end(), q, q + 20);
+    }
+    if(!verts.empty()) {
+        glVertexPointer(3, GL_FLOAT, 5 * sizeof(float), verts.data());
+        glTexCoordPointer(2, GL_FLOAT, 5 * sizeof(float), verts.data() + 3);
+        for(size_t k=0;k<ground.visible.size();k++){
+            glState.bindTexture(ground.slots[ground.visible[k]].tex);
+            glDrawArrays(GL_QUADS, (GLint)(k * 4), 4);
+        }
+        renderStats.drawCalls += (int)ground.visible.size();
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glState.disable(GL_TEXTURE_2D);
+}
+
+// ----------------------- Profiler por estágio ---------------------
+//
+// Compilado só com -DPROFILER=1; sem ele as macros PROFILE_* somem e não há custo.
+// Cada estágio do frame (física, luzes, chão, cones, carro, HUD) é medido com steady_clock
+// e, quando há GL 3.3, também com timestamps de GPU (glQueryCounter), lidos alguns frames
+// depois para não bloquear. Os frames completos vão para um ring buffer de tamanho fixo
+// (um produtor, índice atômico). O HUD mostra p50/p95/p99 e o ring é salvo em CSV na saída.
+// Com a thread de simulação, a física não passa pelo frame: cada passo soma seu tempo num
+// contador atômico, que o frame seguinte recolhe como o estágio "fisica".
+
+#ifndef PROFILER
+#define PROFILER 0
+#endif
+
+enum ProfStage { PROF_PHYSICS, PROF_LIGHTING, PROF_GROUND, PROF_CONES, PROF_CAR, PROF_HUD, PROF_STAGES };
+
+#if PROFILER
+const char *PROF_NAMES[PROF_STAGES] = {"fisica", "luzes", "chao", "cones", "carro", "hud"};
+const int PROF_RING = 4096;       // Frames guardados (potência de 2).
+const int PROF_WINDOW = 512;      // Frames usados nos percentis do HUD.
+const int PROF_GPU_LATENCY = 4;   // Frames de atraso antes de ler as queries de GPU.
+
+// Tempos de um frame por estágio (ms); gpuMs < 0 quando indisponível.
+struct ProfFrame {
+    unsigned long long frame;
+    float cpuMs[PROF_STAGES];
+    float gpuMs[PROF_STAGES];
+};
+
+struct Profiler {
+    ProfFrame ring[PROF_RING];
+    std::atomic<unsigned long long> published{0}; // Frames já escritos no ring.
+    ProfFrame current = {};                       // Frame em andamento.
+    unsigned long long frameCount = 0;
+
+    // Queries de timestamp de GPU: [slot][estágio][início/fim]; o slot guarda o frame medido.
+    bool gpu = false;
+    GLuint queries[PROF_GPU_LATENCY][PROF_STAGES][2];
+    bool issued[PROF_GPU_LATENCY][PROF_STAGES];
+    ProfFrame slotFrame[PROF_GPU_LATENCY];
+    bool slotBusy[PROF_GPU_LATENCY];
+
+    std::atomic<long long> simThreadNs{0};         // Física na thread de simulação desde o último frame.
+    std::string summaryCpu, summaryGpu;            // Linhas do HUD, refeitas a cada 0,5 s.
+    double lastSummary = 0.0;                      // Instante (s) da última atualização das linhas.
+    std::string csvPath = "profile.csv";
+} prof;
+
+// Escreve um frame completo no ring e o publica para leitores.
+void profPublish(const ProfFrame &f) {
+    unsigned long long n = prof.published.load(std::memory_order_relaxed);
+    prof.ring[n & (PROF_RING - 1)] = f;
+    prof.published.store(n + 1, std::memory_order_release);
+}
+
+// Cria as queries de GPU se o contexto suportar (chamada após initMeshes/loadGLFunctions).
+void profInitGpu() {
+    if(!glf.GenQueries || !glf.QueryCounter || !glf.GetQueryObjectiv || !glf.GetQueryObjectui64v) return;
+    glf.GenQueries(PROF_GPU_LATENCY * PROF_STAGES * 2, &prof.queries[0][0][0]);
+    memset(prof.issued, 0, sizeof(prof.issued));
+    memset(prof.slotBusy, 0, sizeof(prof.slotBusy));
+    prof.gpu = true;
+}
+
+// Mede um estágio: tempo de CPU sempre; timestamps de GPU se gl=true e houver suporte.
+struct ProfScope {
+    ProfStage stage;
+    bool gl;
+    std::chrono::steady_clock::time_point t0;
+    ProfScope(ProfStage s, bool useGl) : stage(s), gl(useGl && prof.gpu) {
+        if(gl) {
+            int slot = (int)(prof.frameCount % PROF_GPU_LATENCY);
+            glf.QueryCounter(prof.queries[slot][stage][0], GL_TIMESTAMP);
+        }
+        t0 = std::chrono::steady_clock::now();
+    }
+    ~ProfScope() {
+        prof.current.cpuMs[stage] += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if(gl) {
+            int slot = (int)(prof.frameCount % PROF_GPU_LATENCY);
+            glf.QueryCounter(prof.queries[slot][stage][1], GL_TIMESTAMP);
+            prof.issued[slot][stage] = true;
+        }
+    }
+};
+
+// Mede um passo de física na thread de simulação (sem GPU; não toca em prof.current).
+struct ProfSimScope {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    ~ProfSimScope() {
+        prof.simThreadNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - t0).count(), std::memory_order_relaxed);
+    }
+};
+
+// Lê as queries do slot (se prontas) e publica o frame correspondente.
+void profCollectSlot(int slot) {
+    if(!prof.slotBusy[slot]) return;
+    ProfFrame &f = prof.slotFrame[slot];
+    for(int s=0;s<PROF_STAGES;s++){
+        if(!prof.issued[slot][s]) continue;
+        GLint ready = 0;
+        glf.GetQueryObjectiv(prof.queries[slot][s][1], GL_QUERY_RESULT_AVAILABLE, &ready);
+        if(ready) {
+            GLuint64 a = 0, b = 0;
+            glf.GetQueryObjectui64v(prof.queries[slot][s][0], GL_QUERY_RESULT, &a);
+            glf.GetQueryObjectui64v(prof.queries[slot][s][1], GL_QUERY_RESULT, &b);
+            f.gpuMs[s] = (float)((b - a) / 1e6);
+        }
+        prof.issued[slot][s] = false;
+    }
+    profPublish(f);
+    prof.slotBusy[slot] = false;
+}
+
+// p50/p95/p99 de um estágio nos últimos PROF_WINDOW frames publicados.
+void profPercentiles(int stage, bool gpu, float out[3]) {
+    unsigned long long n = prof.published.load(std::memory_order_acquire);
+    unsigned long long count = std::min<unsigned long long>(n, PROF_WINDOW);
+    static std::vector<float> v;
+    v.clear();
+    for(unsigned long long i=n-count;i<n;i++){
+        const ProfFrame &f = prof.ring[i & (PROF_RING - 1)];
+        float ms = gpu ? f.gpuMs[stage] : f.cpuMs[stage];
+        if(ms >= 0.0f) v.push_back(ms);
+    }
+    const float q[3] = {0.50f, 0.95f, 0.99f};
+    for(int k=0;k<3;k++){
+        if(v.empty()) { out[k] = 0.0f; continue; }
+        size_t idx = std::min(v.size() - 1, (size_t)(q[k] * v.size()));
+        std::nth_element(v.begin(), v.begin() + idx, v.end());
+        out[k] = v[idx];
+    }
+}
+
+// Refaz as linhas do HUD no máximo a cada 0,5 s (evita ordenar a janela todo frame).
+void profUpdateSummary() {
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if(now - prof.lastSummary < 0.5) return;
+    prof.lastSummary = now;
+    char buf[512];
+    for(int gpu=0;gpu<2;gpu++){
+        if(gpu && !prof.gpu) { prof.summaryGpu.clear(); break; }
+        int len = snprintf(buf, sizeof(buf), "%s p50/p95/p99 ms:", gpu ? "GPU" : "CPU");
+        for(int s=0;s<PROF_STAGES;s++){
+            if(gpu && s == PROF_PHYSICS) continue;
+            float p[3];
+            profPercentiles(s, gpu != 0, p);
+            len += snprintf(buf + len, sizeof(buf) - len, "  %s %.2f/%.2f/%.2f", PROF_NAMES[s], p[0], p[1], p[2]);
+        }
+        (gpu ? prof.summaryGpu : prof.summaryCpu) = buf;
+    }
+}
+
+// Fecha o frame atual: com GPU ele espera as queries; sem GPU é publicado direto.
+void profEndFrame() {
+    prof.current.frame = prof.frameCount;
+    prof.current.cpuMs[PROF_PHYSICS] += prof.simThreadNs.exchange(0, std::memory_order_relaxed) / 1e6f;
+    if(prof.gpu) {
+        int slot = (int)(prof.frameCount % PROF_GPU_LATENCY);
+        ProfFrame &f = prof.slotFrame[slot];
+        f = prof.current;
+        for(int s=0;s<PROF_STAGES;s++) f.gpuMs[s] = -1.0f;
+        prof.slotBusy[slot] = true;
+        // O próximo slot será reutilizado no frame seguinte: coleta o que ele mediu.
+        profCollectSlot((int)((prof.frameCount + 1) % PROF_GPU_LATENCY));
+    } else {
+        for(int s=0;s<PROF_STAGES;s++) prof.current.gpuMs[s] = -1.0f;
+        profPublish(prof.current);
+    }
+    prof.current = ProfFrame();
+    prof.frameCount++;
+    profUpdateSummary();
+}
+
+// Salva os frames do ring em CSV (registrado com atexit). Frames ainda esperando queries de
+// GPU entram sem os tempos de GPU, já que o contexto GL pode não existir mais na saída.
+void profWriteCsv() {
+    for(int k=1;k<=PROF_GPU_LATENCY;k++){
+        int slot = (int)((prof.frameCount + k) % PROF_GPU_LATENCY);
+        if(prof.slotBusy[slot]) { profPublish(prof.slotFrame[slot]); prof.slotBusy[slot] = false; }
+    }
+    FILE *fp = fopen(prof.csvPath.c_str(), "w");
+    if(!fp) return;
+    fprintf(fp, "frame");
+    for(int s=0;s<PROF_STAGES;s++) fprintf(fp, ",%s_cpu_ms", PROF_NAMES[s]);
+    for(int s=0;s<PROF_STAGES;s++) fprintf(fp, ",%s_gpu_ms", PROF_NAMES[s]);
+    fprintf(fp, "\n");
+    unsigned long long n = prof.published.load(std::memory_order_acquire);
+    unsigned long long first = n > (unsigned long long)PROF_RING ? n - PROF_RING : 0;
+    for(unsigned long long i=first;i<n;i++){
+        const ProfFrame &f = prof.ring[i & (PROF_RING - 1)];
+        fprintf(fp, "%llu", f.frame);
+        for(int s=0;s<PROF_STAGES;s++) fprintf(fp, ",%.4f", f.cpuMs[s]);
+        for(int s=0;s<PROF_STAGES;s++){
+            if(f.gpuMs[s] >= 0.0f) fprintf(fp, ",%.4f", f.gpuMs[s]);
+            else fprintf(fp, ",");
+        }
+        fprintf(fp, "\n");
+    }
+    fclose(fp);
+    printf("Perfil: %llu frames salvos em %s\n", n - first, prof.csvPath.c_str());
+}
+
+#define PROF_CONCAT2(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT2(a, b)
+#define PROFILE_SCOPE(stage) ProfScope PROF_CONCAT(profScope_, __LINE__)(stage, false)
+#define PROFILE_GL_SCOPE(stage) ProfScope PROF_CONCAT(profScope_, __LINE__)(stage, true)
+#define PROFILE_SIM_SCOPE() ProfSimScope PROF_CONCAT(profSimScope_, __LINE__)
+#define PROFILE_END_FRAME() profEndFrame()
+#else
+#define PROFILE_SIM_SCOPE()
+#define PROFILE_SCOPE(stage)
+#define PROFILE_GL_SCOPE(stage)
+#define PROFILE_END_FRAME()
+#endif
+
+// ----------------------- Inicialização da cena --------------------
+
+/**
+ * Configura as posições dos cones para formar um corredor.
+ */
+void setupConesStraightCorridor() {
+    cones.clear();
+    float startZ = 2.0f;
+    for(int i=0;i<NUM_PAIRS;i++){
+        float z = startZ - i * PAIR_SPACING;
+        cones.emplace_back(-CORRIDOR_HALF_WIDTH, z); // Esquerda
+        cones.emplace_back( CORRIDOR_HALF_WIDTH, z); // Direita
+    }
+    // Adiciona um cone marcador extra para o fim da baliza.
+    cones.emplace_back(0.0f, startZ - NUM_PAIRS * PAIR_SPACING - 1.5f);
+    rebuildConeGrid();
+}
+
+// ----------------------- Luzes e GL states -------------------------
+
+/**
+ * Configura as luzes e o modelo de iluminação do OpenGL.
+ */
+void setupLighting() {
+    glState.enable(GL_LIGHTING);
+    glState.enable(GL_LIGHT0);
+    glState.enable(GL_COLOR_MATERIAL); // Permite que glColor altere as propriedades de material.
+    glState.colorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
+
+    // Luz Ambiente (ilumina a cena uniformemente).
+    GLfloat amb[] = {0.25f,0.25f,0.25f,1.0f};
+    glState.lightModelfv(GL_LIGHT_MODEL_AMBIENT, amb);
+
+    // Luz Direcional (simula o sol).
+    GLfloat col[] = {1.0f,0.95f,0.85f,1.0f}; // Cor branca/amarelada
+    GLfloat pos[] = {0.2f,1.0f,0.3f,0.0f};  // w=0 indica luz direcional.
+    glState.lightfv(GL_LIGHT0, GL_DIFFUSE, col);
+    glState.lightfv(GL_LIGHT0, GL_SPECULAR, col);
+    glState.lightfv(GL_LIGHT0, GL_POSITION, pos);
+
+    // Configura o material padrão para o brilho especular (para reflexos em cones/carro).
+    GLfloat spec[] = {0.2f,0.2f,0.2f,1.0f};
+    glState.materialfv(GL_FRONT, GL_SPECULAR, spec);
+    glState.materialf(GL_FRONT, GL_SHININESS, 32.0f);
+}
+
+// ----------------------- Baliza automática (A* híbrido) ------------------------
+//
+// Planeja um caminho sem colisão da pose atual do carro até a vaga usando o modelo de bicicleta
+// de stepCar (WHEEL_BASE, esterço até MAX_WHEEL_DEG, ré mais lenta que a frente). A busca é um
+// A* híbrido: os nós guardam a pose contínua, mas cada célula do reticulado (x, z, direção)
+// aceita só o melhor custo. Os sucessores vêm de primitivas pré-calculadas (arcos de esterço
+// fixo, para frente e de ré) e a heurística é a distância na grade 2D até a vaga contornando
+// os cones (Dijkstra a partir da vaga). Cada rodada retira vários nós da fila e as threads de
+// um pool persistente expandem as primitivas deles em paralelo; a fusão na fila e no reticulado
+// é sequencial. Planos levam 1-3 ms, então o padrão é uma thread (--plan-threads N para mais).
+// A região de busca tem no máximo PLAN_MAX_CELLS células: com a vaga mais longe que isso o plano
+// falha sem alocar nada ("vaga longe demais").
+// O carro segue o caminho com pure pursuit, acionando as mesmas setas do teclado.
+
+const int PLAN_HEADINGS = 72;          // Direções do reticulado (5 graus).
+const float PLAN_CELL = 0.25f;         // Lado da célula do reticulado e da heurística (m).
+const int PLAN_SUBSTEPS = 8;           // Amostras por primitiva.
+const float PLAN_SAMPLE = 0.1f;        // Espaçamento das amostras (m).
+const float PLAN_STEP = PLAN_SUBSTEPS * PLAN_SAMPLE; // Comprimento de cada primitiva (m).
+const int PLAN_STEERS = 5;             // Esterços por sentido: -1, -1/2, 0, 1/2, 1 x MAX_WHEEL_DEG.
+const int PLAN_PRIMS = 2 * PLAN_STEERS;
+const float PLAN_MARGIN = 0.12f;       // Folga do carro contra os cones (erro de seguimento).
+const float PLAN_REVERSE_COST = 1.5f;  // Peso do comprimento andado de ré.
+const float PLAN_SWITCH_COST = 2.0f;   // Custo de cada troca de sentido (m equivalentes).
+const float PLAN_STEER_COST = 0.05f;   // Custo por m com esterço e por mudança de esterço.
+const float PLAN_WINDOW = 6.0f;        // Folga da região de busca em volta do início e da vaga (m).
+const float PLAN_GOAL_INSET = 0.3f;    // O centro precisa ficar tão dentro assim da vaga (m).
+const float PLAN_GOAL_HEADING = 10.0f; // Tolerância de alinhamento com o percurso na vaga (graus).
+const int PLAN_MAX_NODES = 400000;     // Limite de nós gerados por plano.
+const size_t PLAN_MAX_CELLS = 1 << 19; // Células da região de busca (~180 m x 180 m; o reticulado
+                                       // usa PLAN_HEADINGS índices de 4 bytes por célula, ~150 MB).
+const size_t PLAN_NO_KEY = (size_t)-1; // Chave de reticulado inválida.
+const float PLAN_H_WEIGHT = 1.6f;      // A* ponderado: custo no máximo 1,6x o ótimo, bem menos nós.
+const int PLAN_BATCH_PER_THREAD = 8;   // Nós por rodada e por thread (com uma thread, 2: lotes
+                                       // maiores tiram o A* da ordem e expandem mais nós).
+const int PLAN_JOB_CHUNK = PLAN_PRIMS; // Expansões que uma thread pega do contador de cada vez.
+const float PLAN_INF = 1e30f;
+
+// Primitiva de movimento: arco de esterço e sentido fixos, amostrado a partir da origem com
+// direção 0 (+Z). Ângulos em radianos.
+struct PlanPrimitive {
+    int steer;                  // Índice 0..PLAN_STEERS-1 (PLAN_STEERS/2 = reto).
+    int dir;                    // +1 frente, -1 ré.
+    float cost;                 // Custo base do comprimento (ré pesa mais, esterço um pouco).
+    float dx[PLAN_SUBSTEPS], dz[PLAN_SUBSTEPS], dh[PLAN_SUBSTEPS];
+};
+
+/**
+ * Gera as primitivas integrando o modelo de bicicleta de stepCar em forma fechada:
+ * curvatura tan(esterço) / WHEEL_BASE, x = (1 - cos(k s)) / k, z = sin(k s) / k.
+ */
+std::vector<PlanPrimitive> buildPlanPrimitives() {
+    std::vector<PlanPrimitive> prims;
+    for(int dir : {1, -1})
+        for(int s=0;s<PLAN_STEERS;s++){
+            PlanPrimitive p;
+            p.steer = s;
+            p.dir = dir;
+            float steerDeg = MAX_WHEEL_DEG * (2.0f * s / (PLAN_STEERS - 1) - 1.0f);
+            float k = tanf(steerDeg * (PI/180.0f)) / WHEEL_BASE;
+            p.cost = PLAN_STEP * ((dir < 0 ? PLAN_REVERSE_COST : 1.0f) + (s != PLAN_STEERS/2 ? PLAN_STEER_COST : 0.0f));
+            for(int i=0;i<PLAN_SUBSTEPS;i++){
+                float d = dir * PLAN_SAMPLE * (i + 1);
+                p.dh[i] = k * d;
+                p.dx[i] = fabsf(k) > 1e-6f ? (1.0f - cosf(k * d)) / k : 0.0f;
+                p.dz[i] = fabsf(k) > 1e-6f ? sinf(k * d) / k : d;
+            }
+            prims.push_back(p);
+        }
+    return prims;
+}
+const std::vector<PlanPrimitive> planPrimitives = buildPlanPrimitives();
+
+// Ponto do caminho planejado; 'dir' é o sentido do movimento que chega nele.
+struct PathPoint {
+    float x, z, heading; // heading em graus, contínuo com o do carro.
+    int dir;
+};
+
+// Resultado de um plano (exibido no HUD e no benchmark).
+struct PlanStats {
+    bool found = false;
+    double ms = 0.0;
+    int expanded = 0, generated = 0, threads = 1;
+    float length = 0.0f;
+    int cusps = 0;          // Trocas de sentido.
+    bool tooFar = false;    // Região de busca acima de PLAN_MAX_CELLS: nada foi alocado.
+};
+
+/**
+ * Testa a caixa do carro (com PLAN_MARGIN) na pose dada contra os cones em pé da grade.
+ * Só lê a grade: várias threads podem chamar ao mesmo tempo.
+ */
+template<class Grid>
+bool planPoseHitsCone(const Grid &grid, float x, float z, float sn, float co) {
+    const float hw = CAR_HALF_WIDTH + PLAN_MARGIN, hl = CAR_HALF_LENGTH + PLAN_MARGIN;
+    float ex = fabsf(co) * hw + fabsf(sn) * hl + CONE_RADIUS;
+    float ez = fabsf(sn) * hw + fabsf(co) * hl + CONE_RADIUS;
+    bool hit = false;
+    grid.query(x - ex, z - ez, x + ex, z + ez, [&](int i) {
+        float dx = cones[i].first - x, dz = cones[i].second - z;
+        float lx = dx * co - dz * sn, lz = dx * sn + dz * co;
+        float qx = lx - std::max(-hw, std::min(hw, lx)), qz = lz - std::max(-hl, std::min(hl, lz));
+        if(qx*qx + qz*qz < CONE_RADIUS*CONE_RADIUS) hit = true;
+    });
+    return hit;
+}
+
+inline bool planPoseFree(float x, float z, float hr) {
+    float sn = sinf(hr), co = cosf(hr);
+    return coneIndex.valid() ? !planPoseHitsCone(coneIndex, x, z, sn, co) : !planPoseHitsCone(coneGrid, x, z, sn, co);
+}
+
+// Estado da busca; os vetores são reaproveitados entre planos.
+struct ParkingPlanner {
+    struct Node {
+        float x, z, h, g;   // Pose (h em radianos, contínuo) e custo acumulado.
+        int parent, prim;   // prim = -1 no nó inicial.
+        bool closed;        // Expandido ou substituído por um caminho melhor.
+    };
+    struct Succ {
+        float x, z, h, g, f;
+        size_t key;         // Célula do reticulado; PLAN_NO_KEY = inválido.
+    };
+    float minX = 0, minZ = 0;
+    int nx = 0, nz = 0;
+    std::vector<float> heuristic;   // Distância 2D até a vaga por célula (PLAN_INF = inalcançável).
+    std::vector<unsigned char> nearCone; // 1 = algum cone pode tocar o carro com centro nesta célula.
+    std::vector<int> lattice;       // Nó dono de cada (célula, direção); -1 = livre.
+    std::vector<Node> nodes;
+    std::vector<int> batch;
+    std::vector<Succ> succ;
+
+    // Pool: as auxiliares dormem na condition variable até a próxima rodada e pegam blocos de
+    // PLAN_JOB_CHUNK expansões do contador; as threads ficam vivas entre planos.
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv, doneCv;
+    unsigned long long generation = 0;
+    int pending = 0;
+    bool stopping = false;
+    std::atomic<int> nextJob{0};
+
+    ~ParkingPlanner() { stopWorkers(); }
+
+    // Heurística na posição (x, z); PLAN_INF fora da região ou atrás de cones.
+    float heuristicAt(float x, float z) const {
+        int ix = (int)floorf((x - minX) / PLAN_CELL), iz = (int)floorf((z - minZ) / PLAN_CELL);
+        if(ix < 0 || iz < 0 || ix >= nx || iz >= nz) return PLAN_INF;
+        return heuristic[(size_t)iz * nx + ix];
+    }
+    size_t latticeKey(float x, float z, float h) const {
+        int ix = (int)floorf((x - minX) / PLAN_CELL), iz = (int)floorf((z - minZ) / PLAN_CELL);
+        if(ix < 0 || iz < 0 || ix >= nx || iz >= nz) return PLAN_NO_KEY;
+        int ih = (int)floorf(h * (PLAN_HEADINGS / (2.0f * PI)) + 0.5f) % PLAN_HEADINGS;
+        if(ih < 0) ih += PLAN_HEADINGS;
+        return ((size_t)iz * nx + ix) * PLAN_HEADINGS + ih;
+    }
+
+    bool setupRegion(const Car &start);
+    void buildHeuristic();
+    void startWorkers(int threads);
+    void stopWorkers();
+    void workerLoop(unsigned long long seen);
+    void runJobs();
+    void expand(int job);
+    bool isGoal(const Node &n) const;
+    bool plan(const Car &start, int threads, std::vector<PathPoint> &path, PlanStats &st);
+};
+
+/**
+ * Região de busca: caixa que contém o início e a vaga com PLAN_WINDOW de folga, limitada ao
+ * chão do percurso (a mesma caixa em que stepCar mantém o carro).
+ * @return false se a caixa passa de PLAN_MAX_CELLS células (vaga longe demais do carro).
+ */
+bool ParkingPlanner::setupRegion(const Car &start) {
+    float x0 = std::min(start.x, course.goalMinX) - PLAN_WINDOW, x1 = std::max(start.x, course.goalMaxX) + PLAN_WINDOW;
+    float z0 = std::min(start.z, course.goalMinZ) - PLAN_WINDOW, z1 = std::max(start.z, course.goalMaxZ) + PLAN_WINDOW;
+    x0 = std::max(x0, course.groundMinX); x1 = std::min(x1, course.groundMaxX);
+    z0 = std::max(z0, course.groundMinZ); z1 = std::min(z1, course.groundMaxZ);
+    minX = x0; minZ = z0;
+    // Contas em double: um chão enorme passaria do alcance de int antes do teste.
+    double cx = std::max(1.0, ceil(((double)x1 - x0) / PLAN_CELL)), cz = std::max(1.0, ceil(((double)z1 - z0) / PLAN_CELL));
+    if(cx * cz > (double)PLAN_MAX_CELLS) { nx = nz = 0; return false; }
+    nx = (int)cx;
+    nz = (int)cz;
+    return true;
+}
+
+/**
+ * Dijkstra 8-conexo a partir das células da vaga. Uma célula é bloqueada quando seu centro
+ * está a menos de CONE_RADIUS + CAR_HALF_WIDTH de um cone (o carro colidiria em qualquer
+ * direção), menos meia célula para não fechar passagens estreitas. Na mesma passada marca as
+ * células perto de cones (raio do círculo que envolve o carro): longe delas, expand() pula o
+ * teste exato de colisão.
+ */
+void ParkingPlanner::buildHeuristic() {
+    const size_t n = (size_t)nx * nz;
+    heuristic.assign(n, PLAN_INF);
+    nearCone.assign(n, 0);
+    std::vector<unsigned char> blocked(n, 0);
+    const float reach = CONE_RADIUS + CAR_HALF_WIDTH - 0.5f * PLAN_CELL;
+    const float hw = CAR_HALF_WIDTH + PLAN_MARGIN, hl = CAR_HALF_LENGTH + PLAN_MARGIN;
+    const float near = sqrtf(hw*hw + hl*hl) + CONE_RADIUS + 0.75f * PLAN_CELL; // 0,75 > meia diagonal.
+    auto mark = [&](int i) {
+        float cx = cones[i].first, cz = cones[i].second;
+        int ix0 = std::max(0, (int)floorf((cx - near - minX) / PLAN_CELL)), ix1 = std::min(nx - 1, (int)floorf((cx + near - minX) / PLAN_CELL));
+        int iz0 = std::max(0, (int)floorf((cz - near - minZ) / PLAN_CELL)), iz1 = std::min(nz - 1, (int)floorf((cz + near - minZ) / PLAN_CELL));
+        for(int iz=iz0;iz<=iz1;iz++)
+            for(int ix=ix0;ix<=ix1;ix++){
+                float dx = minX + (ix + 0.5f) * PLAN_CELL - cx, dz = minZ + (iz + 0.5f) * PLAN_CELL - cz;
+                float d2 = dx*dx + dz*dz;
+                size_t c = (size_t)iz * nx + ix;
+                if(d2 < near*near) nearCone[c] = 1;
+                if(d2 < reach*reach) blocked[c] = 1;
+            }
+    };
+    float x1 = minX + nx * PLAN_CELL, z1 = minZ + nz * PLAN_CELL;
+    if(coneIndex.valid()) coneIndex.query(minX - near, minZ - near, x1 + near, z1 + near, mark);
+    else coneGrid.query(minX - near, minZ - near, x1 + near, z1 + near, mark);
+
+    typedef std::pair<float,size_t> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+    for(int iz=0;iz<nz;iz++)
+        for(int ix=0;ix<nx;ix++){
+            float x = minX + (ix + 0.5f) * PLAN_CELL, z = minZ + (iz + 0.5f) * PLAN_CELL;
+            size_t c = (size_t)iz * nx + ix;
+            if(!blocked[c] && x >= course.goalMinX + PLAN_GOAL_INSET && x <= course.goalMaxX - PLAN_GOAL_INSET &&
+               z >= course.goalMinZ + PLAN_GOAL_INSET && z <= course.goalMaxZ - PLAN_GOAL_INSET) {
+                heuristic[c] = 0.0f;
+                open.push(Item(0.0f, c));
+            }
+        }
+    const float diag = PLAN_CELL * 1.41421356f;
+    while(!open.empty()) {
+        Item it = open.top(); open.pop();
+        if(it.first > heuristic[it.second]) continue;
+        int ix = (int)(it.second % nx), iz = (int)(it.second / nx);
+        for(int dz=-1;dz<=1;dz++)
+            for(int dx=-1;dx<=1;dx++){
+                int jx = ix + dx, jz = iz + dz;
+                if((dx == 0 && dz == 0) || jx < 0 || jz < 0 || jx >= nx || jz >= nz) continue;
+                size_t c = (size_t)jz * nx + jx;
+                if(blocked[c]) continue;
+                float d = it.first + (dx && dz ? diag : PLAN_CELL);
+                if(d < heuristic[c]) { heuristic[c] = d; open.push(Item(d, c)); }
+            }
+    }
+}
+
+bool ParkingPlanner::isGoal(const Node &n) const {
+    if(n.x < course.goalMinX + PLAN_GOAL_INSET || n.x > course.goalMaxX - PLAN_GOAL_INSET ||
+       n.z < course.goalMinZ + PLAN_GOAL_INSET || n.z > course.goalMaxZ - PLAN_GOAL_INSET) return false;
+    // Alinhado com a direção de saída do percurso, de frente ou de ré.
+    float d = fmodf(fabsf(n.h * (180.0f/PI) - course.startHeading), 180.0f);
+    return std::min(d, 180.0f - d) <= PLAN_GOAL_HEADING;
+}
+
+/**
+ * Expande a primitiva (job % PLAN_PRIMS) do nó batch[job / PLAN_PRIMS] em succ[job].
+ * Só lê nós, heurística e cones; roda em paralelo durante uma rodada.
+ */
+void ParkingPlanner::expand(int job) {
+    const Node &n = nodes[batch[job / PLAN_PRIMS]];
+    const PlanPrimitive &p = planPrimitives[job % PLAN_PRIMS];
+    Succ &s = succ[job];
+    s.key = PLAN_NO_KEY;
+    float sn = sinf(n.h), co = cosf(n.h);
+    const int last = PLAN_SUBSTEPS - 1;
+    s.x = n.x + p.dx[last] * co + p.dz[last] * sn;
+    s.z = n.z - p.dx[last] * sn + p.dz[last] * co;
+    s.h = n.h + p.dh[last];
+    float h = heuristicAt(s.x, s.z);
+    if(h >= PLAN_INF) return; // Fora da região, sobre um cone ou sem saída até a vaga.
+    size_t key = latticeKey(s.x, s.z, s.h);
+    if(key == PLAN_NO_KEY) return;
+    // Colisão nas amostras ímpares (a cada 0,2 m) e na pose final.
+    for(int i=1;i<PLAN_SUBSTEPS;i+=2){
+        float x = n.x + p.dx[i] * co + p.dz[i] * sn, z = n.z - p.dx[i] * sn + p.dz[i] * co;
+        if(heuristicAt(x, z) >= PLAN_INF) return;
+        int ix = (int)floorf((x - minX) / PLAN_CELL), iz = (int)floorf((z - minZ) / PLAN_CELL);
+        if(nearCone[(size_t)iz * nx + ix] && !planPoseFree(x, z, n.h + p.dh[i])) return;
+    }
+    s.g = n.g + p.cost;
+    if(n.prim >= 0) {
+        const PlanPrimitive &q = planPrimitives[n.prim];
+        if(q.dir != p.dir) s.g += PLAN_SWITCH_COST;
+        s.g += PLAN_STEER_COST * abs(q.steer - p.steer);
+    }
+    s.f = s.g + PLAN_H_WEIGHT * h;
+    s.key = key;
+}
+
+// Deixa o pool com threads - 1 auxiliares (a thread que planeja é a outra).
+void ParkingPlanner::startWorkers(int threads) {
+    if((int)workers.size() == threads - 1) return;
+    stopWorkers();
+    stopping = false;
+    // As novas threads partem da geração atual: só acordam na próxima rodada.
+    for(int t=1;t<threads;t++) workers.emplace_back([this, seen = generation]() { workerLoop(seen); });
+}
+
+void ParkingPlanner::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for(auto &w : workers) w.join();
+    workers.clear();
+}
+
+void ParkingPlanner::workerLoop(unsigned long long seen) {
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+        runJobs();
+        std::lock_guard<std::mutex> lock(mtx);
+        if(--pending == 0) doneCv.notify_one();
+    }
+}
+
+// Expande blocos de succ até o contador passar do fim.
+void ParkingPlanner::runJobs() {
+    const int n = (int)succ.size();
+    for(int j; (j = nextJob.fetch_add(PLAN_JOB_CHUNK, std::memory_order_relaxed)) < n; )
+        for(int k=j, e=std::min(n, j + PLAN_JOB_CHUNK);k<e;k++) expand(k);
+}
+
+/**
+ * Planeja da pose 'start' até a vaga do percurso com 'threads' threads expandindo nós.
+ * @return true e o caminho amostrado a cada PLAN_SAMPLE em 'path' se encontrou.
+ */
+bool ParkingPlanner::plan(const Car &start, int threads, std::vector<PathPoint> &path, PlanStats &st) {
+    auto t0 = std::chrono::steady_clock::now();
+    st = PlanStats();
+    st.threads = threads = std::max(1, threads);
+    path.clear();
+    if(!setupRegion(start)) {
+        st.tooFar = true;
+        st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        return false;
+    }
+    buildHeuristic();
+    lattice.assign((size_t)nx * nz * PLAN_HEADINGS, -1);
+    nodes.clear();
+
+    float h0 = start.heading * (PI/180.0f);
+    typedef std::pair<float,int> Item;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> open;
+    size_t startKey = latticeKey(start.x, start.z, h0);
+    if(startKey != PLAN_NO_KEY && heuristicAt(start.x, start.z) < PLAN_INF && planPoseFree(start.x, start.z, h0)) {
+        nodes.push_back(Node{start.x, start.z, h0, 0.0f, -1, -1, false});
+        lattice[startKey] = 0;
+        open.push(Item(heuristicAt(start.x, start.z), 0));
+    }
+
+    startWorkers(threads);
+    const int batchMax = threads > 1 ? PLAN_BATCH_PER_THREAD * threads : 2;
+    int goal = -1;
+    while(!open.empty() && goal < 0 && (int)nodes.size() < PLAN_MAX_NODES) {
+        batch.clear();
+        while((int)batch.size() < batchMax && !open.empty()) {
+            int id = open.top().second; open.pop();
+            if(nodes[id].closed) continue; // Substituído por um caminho melhor na mesma célula.
+            nodes[id].closed = true;
+            if(isGoal(nodes[id])) { goal = id; break; }
+            batch.push_back(id);
+        }
+        if(goal >= 0 || batch.empty()) break;
+        st.expanded += (int)batch.size();
+
+        succ.resize(batch.size() * PLAN_PRIMS);
+        nextJob.store(0, std::memory_order_relaxed);
+        if(!workers.empty()) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                pending = (int)workers.size();
+                generation++;
+            }
+            cv.notify_all();
+        }
+        runJobs();
+        if(!workers.empty()) {
+            std::unique_lock<std::mutex> lock(mtx);
+            doneCv.wait(lock, [this]() { return pending == 0; });
+        }
+
+        for(size_t j=0;j<succ.size();j++){
+            const Succ &s = succ[j];
+            if(s.key == PLAN_NO_KEY) continue;
+            int &owner = lattice[s.key];
+            if(owner >= 0) {
+                Node &o = nodes[owner];
+                if(o.closed || o.g <= s.g) continue;
+                o.closed = true;
+            }
+            owner = (int)nodes.size();
+            nodes.push_back(Node{s.x, s.z, s.h, s.g, batch[j / PLAN_PRIMS], (int)(j % PLAN_PRIMS), false});
+            open.push(Item(s.f, owner));
+            st.generated++;
+        }
+    }
+
+    if(goal >= 0) {
+        std::vector<int> chain;
+        for(int id=goal; id>=0; id=nodes[id].parent) chain.push_back(id);
+        std::reverse(chain.begin(), chain.end());
+        const Node &s = nodes[chain[0]];
+        path.push_back(PathPoint{s.x, s.z, start.heading, chain.size() > 1 ? planPrimitives[nodes[chain[1]].prim].dir : 1});
+        for(size_t k=1;k<chain.size();k++){
+            const Node &from = nodes[nodes[chain[k]].parent];
+            const PlanPrimitive &p = planPrimitives[nodes[chain[k]].prim];
+            float sn = sinf(from.h), co = cosf(from.h);
+            for(int i=0;i<PLAN_SUBSTEPS;i++)
+                path.push_back(PathPoint{from.x + p.dx[i] * co + p.dz[i] * sn, from.z - p.dx[i] * sn + p.dz[i] * co,
+                                         (from.h + p.dh[i]) * (180.0f/PI), p.dir});
+            if(k > 1 && planPrimitives[nodes[chain[k-1]].prim].dir != p.dir) st.cusps++;
+        }
+        st.length = (path.size() - 1) * PLAN_SAMPLE;
+        st.found = true;
+    }
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return st.found;
+}
+
+// ---- Seguimento do caminho ----
+
+const float FOLLOW_LOOKAHEAD = 1.0f;    // Distância do ponto alvo do pure pursuit (m).
+const float FOLLOW_SPEED = 2.0f;        // Velocidade de cruzeiro para frente (m/s).
+const float FOLLOW_REVERSE_SPEED = 1.2f;
+const float FOLLOW_DECEL = 2.0f;        // Desaceleração planejada antes de cada parada (m/s^2).
+const float FOLLOW_STOP = 0.1f;         // Distância que conta como chegada ao fim do trecho (m).
+const float FOLLOW_STEER_LAG = 5.0f;    // Atraso de esterço (graus) que limita a velocidade...
+const float FOLLOW_CREEP = 0.5f;        // ... a este valor (m/s).
+const float FOLLOW_MAX_ERROR = 1.0f;    // Acima disso o caminho é replanejado.
+const int FOLLOW_MAX_REPLANS = 3;
+
+// Piloto automático: caminho atual, trecho (mesmo sentido) em andamento e último plano.
+// O caminho é imutável depois de planejado e compartilhado com os snapshots do desenho.
+struct Autopilot {
+    bool active = false;
+    std::shared_ptr<const std::vector<PathPoint>> path;
+    int segStart = 0, segEnd = 0, nearest = 0;
+    int replans = 0;
+    PlanStats stats;
+    const char *status = "P para planejar";
+} autopilot;
+ParkingPlanner parkingPlanner;
+int plannerThreads = 1;        // --plan-threads N; 0 = todas as threads do processador.
+bool autoParkAtStart = false;  // --autopark: planeja e segue logo ao iniciar.
+
+int planThreadCount() {
+    return plannerThreads > 0 ? plannerThreads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Último ponto do trecho que começa em 'start' (antes da próxima troca de sentido).
+int pathSegmentEnd(const std::vector<PathPoint> &path, int start) {
+    int j = start + 1;
+    while(j + 1 < (int)path.size() && path[j + 1].dir == path[start + 1].dir) j++;
+    return std::min(j, (int)path.size() - 1);
+}
+
+/**
+ * Planeja da pose do carro e liga o piloto automático se houver caminho.
+ */
+bool startAutopilot(Autopilot &ap, ParkingPlanner &planner, const Car &c, int threads) {
+    auto path = std::make_shared<std::vector<PathPoint>>();
+    ap.active = planner.plan(c, threads, *path, ap.stats) && path->size() > 1;
+    ap.path = path;
+    ap.segStart = ap.nearest = 0;
+    if(ap.active) ap.segEnd = pathSegmentEnd(*path, 0);
+    ap.status = ap.active ? "seguindo" : ap.stats.tooFar ? "vaga longe demais" : "sem caminho";
+    return ap.active;
+}
+
+/**
+ * Um passo do seguidor: pure pursuit no trecho atual para o esterço e perfil de velocidade
+ * que para no fim de cada trecho. Devolve as setas que o motorista apertaria.
+ */
+CarInput autopilotInput(Autopilot &ap, ParkingPlanner &planner, const Car &c) {
+    CarInput in;
+    if(!ap.active) return in;
+    const std::vector<PathPoint> &path = *ap.path;
+    int dir = path[ap.segStart + 1].dir;
+
+    // Ponto mais próximo, procurado para frente dentro do trecho.
+    auto dist2 = [&](int i) { float dx = path[i].x - c.x, dz = path[i].z - c.z; return dx*dx + dz*dz; };
+    int best = ap.nearest;
+    for(int i=ap.nearest;i<=ap.segEnd && i<=ap.nearest + 20;i++) if(dist2(i) < dist2(best)) best = i;
+    ap.nearest = best;
+    if(dist2(best) > FOLLOW_MAX_ERROR * FOLLOW_MAX_ERROR) {
+        if(ap.replans++ >= FOLLOW_MAX_REPLANS || !startAutopilot(ap, planner, c, planThreadCount())) {
+            ap.active = false;
+            ap.status = "abortado";
+        }
+        return in;
+    }
+
+    // Distância restante até o fim do trecho, medida no sentido do movimento.
+    const PathPoint &end = path[ap.segEnd];
+    float hr = c.heading * (PI/180.0f), fx = sinf(hr) * dir, fz = cosf(hr) * dir;
+    float remaining = ap.segEnd - best > 5 ? (ap.segEnd - best) * PLAN_SAMPLE : (end.x - c.x) * fx + (end.z - c.z) * fz;
+    float along = c.speed * dir; // Velocidade no sentido do trecho.
+    if(remaining < FOLLOW_STOP && fabsf(c.speed) < 0.05f) {
+        if(ap.segEnd == (int)path.size() - 1) {
+            ap.active = false;
+            ap.status = course.inGoal(c.x, c.z) ? "estacionado" : "fim do caminho";
+            return in;
+        }
+        ap.segStart = ap.nearest = ap.segEnd;
+        ap.segEnd = pathSegmentEnd(path, ap.segStart);
+        return in;
+    }
+
+    // Esterço: pure pursuit; a mesma fórmula vale de ré (ver stepCar: a direção gira com o sinal da velocidade).
+    int target = best;
+    while(target < ap.segEnd && sqrtf(dist2(target)) < FOLLOW_LOOKAHEAD) target++;
+    float tx = path[target].x, tz = path[target].z;
+    float d = sqrtf(dist2(target));
+    if(d < FOLLOW_LOOKAHEAD) { // Perto do fim: estende o trecho em linha reta.
+        float eh = end.heading * (PI/180.0f);
+        tx += sinf(eh) * dir * (FOLLOW_LOOKAHEAD - d);
+        tz += cosf(eh) * dir * (FOLLOW_LOOKAHEAD - d);
+    }
+    float dx = tx - c.x, dz = tz - c.z;
+    float side = dx * cosf(hr) - dz * sinf(hr);
+    float want = atanf(2.0f * WHEEL_BASE * side / std::max(dx*dx + dz*dz, 1e-4f)) * (180.0f/PI);
+    want = std::max(-MAX_WHEEL_DEG, std::min(MAX_WHEEL_DEG, want));
+    if(c.wheelAngle < want - 1.0f) in.left = true;
+    else if(c.wheelAngle > want + 1.0f) in.right = true;
+
+    // Velocidade: cruzeiro limitado pela distância de frenagem até o fim do trecho.
+    float cruise = dir > 0 ? FOLLOW_SPEED : FOLLOW_REVERSE_SPEED;
+    float goal = remaining < FOLLOW_STOP ? 0.0f : std::min(cruise, sqrtf(2.0f * FOLLOW_DECEL * remaining));
+    // O esterço gira a WHEEL_SPEED_DEG: anda devagar enquanto as rodas não alcançam o desejado.
+    if(fabsf(want - c.wheelAngle) > FOLLOW_STEER_LAG) goal = std::min(goal, FOLLOW_CREEP);
+    bool push = along < goal - 0.05f, brake = along > goal + 0.25f;
+    if(push) { if(dir > 0) in.up = true; else in.down = true; }
+    else if(brake) { if(dir > 0) in.down = true; else in.up = true; }
+    return in;
+}
+
+/**
+ * Desenha o caminho planejado sobre o chão: verde para frente, vermelho de ré.
+ */
+void drawPlannedPath(const std::vector<PathPoint> &path) {
+    if(path.size() < 2) return;
+    static std::vector<float> verts;
+    verts.clear();
+    for(const PathPoint &p : path) { verts.push_back(p.x); verts.push_back(0.03f); verts.push_back(p.z); }
+    glState.disable(GL_LIGHTING);
+    glLineWidth(3.0f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, 0, verts.data());
+    for(int s=0;s+1<(int)path.size();){
+        int e = pathSegmentEnd(path, s);
+        if(path[s + 1].dir > 0) glColor3f(0.2f, 0.9f, 0.3f);
+        else glColor3f(0.95f, 0.25f, 0.2f);
+        glDrawArrays(GL_LINE_STRIP, s, e - s + 1);
+        renderStats.drawCalls++;
+        s = e;
+    }
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glLineWidth(1.0f);
+    glState.enable(GL_LIGHTING);
+}
+
+// ----------------------- Telemetria (gravação e replay) -------------------------
+//
+// Cada passo de física vira um registro binário de 28 bytes (estado do carro após o passo e
+// entradas aplicadas). updatePhysics só copia o registro para um ring buffer de um produtor e
+// um consumidor, sem travas; uma thread gravadora esvazia o ring em blocos grandes (um fwrite
+// por bloco), então a simulação nunca espera o disco. Se a gravadora ficar para trás e o
+// ring encher, o registro é descartado e contado. Formato:
+//   TelemetryHeader | TelemetryRecord * n   (ordem de bytes da máquina que gravou)
+// O cabeçalho guarda a frequência da física e o estado inicial do carro; --replay refaz a
+// simulação com as entradas gravadas e confere o estado a cada passo.
+
+const char TELEMETRY_MAGIC[8] = {'B','A','L','I','Z','A','T','L'};
+const uint32_t TELEMETRY_VERSION = 1;
+const size_t TELEMETRY_RING = 1 << 16;     // Registros no ring (~4,5 min a 240 Hz).
+const size_t TELEMETRY_BATCH = 4096;       // Registros por escrita (112 KB).
+const int TELEMETRY_POLL_MS = 20;          // Espera da gravadora quando o ring está vazio.
+const double TELEMETRY_FLUSH_SEC = 0.5;    // Bloco incompleto é gravado depois deste tempo.
+const unsigned char TL_AUTOPILOT = 16, TL_RESET = 32, TL_REWIND = 64; // Bits de 'flags' além de IN_*.
+
+struct TelemetryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;          // sizeof(TelemetryRecord) de quem gravou.
+    uint32_t physicsHz;
+    float startX, startZ, startHeading, startSpeed, startWheelAngle;
+    uint64_t records;             // Preenchidos ao fechar o arquivo.
+    uint64_t dropped;
+};
+static_assert(sizeof(TelemetryHeader) == 56, "cabecalho de telemetria sem preenchimento");
+
+struct TelemetryRecord {
+    uint32_t step;                // Índice do passo de física (buracos = registros descartados).
+    float x, z, heading, speed, wheelAngle;
+    uint8_t flags;                // IN_UP/IN_DOWN/IN_LEFT/IN_RIGHT | TL_AUTOPILOT | TL_RESET | TL_REWIND.
+    uint8_t pad[3];
+};
+static_assert(sizeof(TelemetryRecord) == 28, "registro de telemetria compacto");
+
+struct TelemetryRecorder {
+    SpscRing<TelemetryRecord, TELEMETRY_RING> ring;
+    FILE *fp = nullptr;
+    TelemetryHeader header = {};
+    std::thread writer;
+    std::atomic<bool> running{false};
+    std::atomic<unsigned long long> written{0}; // Registros já no disco.
+    unsigned long long dropped = 0;             // Só o produtor mexe.
+    unsigned long long writes = 0;              // Chamadas de fwrite (só a gravadora mexe).
+
+    uint32_t nextStep = 0;                      // Índice do próximo passo (conta também os descartados).
+
+    bool start(const char *path, const Car &c, int hz) {
+        fp = fopen(path, "wb");
+        if(!fp) return false;
+        setvbuf(fp, NULL, _IONBF, 0); // Os blocos já são grandes: um fwrite = uma escrita.
+        memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+        header.version = TELEMETRY_VERSION;
+        header.recordSize = sizeof(TelemetryRecord);
+        header.physicsHz = (uint32_t)hz;
+        header.startX = c.x; header.startZ = c.z; header.startHeading = c.heading;
+        header.startSpeed = c.speed; header.startWheelAngle = c.wheelAngle;
+        fwrite(&header, sizeof(header), 1, fp);
+        running.store(true, std::memory_order_release);
+        writer = std::thread([this]() { run(); });
+        return true;
+    }
+
+    // Chamado a cada passo de física (thread da simulação) com o estado após o passo; nunca bloqueia.
+    void record(const Car &c, unsigned char flags) {
+        if(!fp) return;
+        TelemetryRecord r = {nextStep++, c.x, c.z, c.heading, c.speed, c.wheelAngle, flags, {0, 0, 0}};
+        if(!ring.push(r)) dropped++;
+    }
+
+    void run() {
+        std::vector<TelemetryRecord> block(TELEMETRY_BATCH);
+        size_t used = 0;
+        auto lastFlush = std::chrono::steady_clock::now();
+        for(;;) {
+            bool stopping = !running.load(std::memory_order_acquire);
+            size_t n = ring.pop(&block[used], TELEMETRY_BATCH - used);
+            used += n;
+            auto now = std::chrono::steady_clock::now();
+            bool stale = std::chrono::duration<double>(now - lastFlush).count() > TELEMETRY_FLUSH_SEC;
+            if(used > 0 && (used == TELEMETRY_BATCH || stale || (stopping && n == 0))) {
+                fwrite(block.data(), sizeof(TelemetryRecord), used, fp);
+                written.fetch_add(used, std::memory_order_relaxed);
+                writes++;
+                used = 0;
+                lastFlush = now;
+            }
+            if(stopping && n == 0 && used == 0) return;
+            if(n == 0) std::this_thread::sleep_for(std::chrono::milliseconds(TELEMETRY_POLL_MS));
+        }
+    }
+
+    // Esvazia o ring, completa o cabeçalho com as contagens e fecha o arquivo.
+    void stop() {
+        if(!fp) return;
+        running.store(false, std::memory_order_release);
+        writer.join();
+        header.records = written.load();
+        header.dropped = dropped;
+        fseek(fp, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, fp);
+        fclose(fp);
+        fp = nullptr;
+        printf("Telemetria: %llu registros gravados em %llu escritas, %llu descartados\n",
+               (unsigned long long)header.records, writes, dropped);
+    }
+} telemetry;
+std::string telemetryPath;        // --record arquivo.
+bool telemetryResetPending = false; // 'r' antes do próximo passo (vira TL_RESET).
+
+void telemetryStop() { telemetry.stop(); }
+
+// Confere o cabeçalho e o tamanho de um arquivo de telemetria; retorna a mensagem de erro ou NULL.
+const char *validateTelemetry(const MappedFile &f) {
+    if(f.size < sizeof(TelemetryHeader)) return "arquivo menor que o cabecalho";
+    const TelemetryHeader &hd = *(const TelemetryHeader*)f.data;
+    if(memcmp(hd.magic, TELEMETRY_MAGIC, sizeof(hd.magic)) != 0) return "nao e um arquivo de telemetria";
+    if(hd.version != TELEMETRY_VERSION) return "versao de formato desconhecida";
+    if(hd.recordSize != sizeof(TelemetryRecord)) return "tamanho de registro diferente";
+    if(hd.physicsHz == 0) return "frequencia de fisica invalida";
+    return NULL;
+}
+
+// Registros completos do arquivo (um arquivo interrompido pode não ter o cabeçalho final).
+inline size_t telemetryRecordCount(const MappedFile &f) {
+    return (f.size - sizeof(TelemetryHeader)) / sizeof(TelemetryRecord);
+}
+
+// Replay: entradas vindas do arquivo em vez do teclado, com conferência do estado.
+struct TelemetryReplay {
+    MappedFile file;
+    const TelemetryRecord *recs = nullptr;
+    size_t count = 0, next = 0;
+    unsigned long long step = 0;       // Passos desde o início do replay.
+    unsigned char lastFlags = 0;       // Entradas repetidas nos buracos do arquivo.
+    long divergences = 0, resyncs = 0;
+    int physicsHz = 0;                 // Frequência gravada (substitui --hz).
+    bool active = false;
+} replay;
+
+/**
+ * Abre o arquivo de --replay; a simulação só começa em beginReplay (depois de initScene).
+ */
+bool loadReplay(const char *path) {
+    if(!replay.file.open(path)) { fprintf(stderr, "Nao foi possivel abrir a telemetria %s\n", path); return false; }
+    if(const char *err = validateTelemetry(replay.file)) {
+        fprintf(stderr, "Telemetria invalida (%s): %s\n", path, err);
+        replay.file.close();
+        return false;
+    }
+    const TelemetryHeader &hd = *(const TelemetryHeader*)replay.file.data;
+    replay.recs = (const TelemetryRecord*)(replay.file.data + sizeof(TelemetryHeader));
+    replay.count = telemetryRecordCount(replay.file);
+    replay.physicsHz = (int)hd.physicsHz; // O replay só é exato com o mesmo passo.
+    return true;
+}
+
+// Põe o carro no estado inicial gravado e liga o replay.
+void beginReplay() {
+    const TelemetryHeader &hd = *(const TelemetryHeader*)replay.file.data;
+    car.x = hd.startX; car.z = hd.startZ; car.heading = hd.startHeading;
+    car.speed = hd.startSpeed; car.wheelAngle = hd.startWheelAngle;
+    prevCar = car;
+    replay.next = 0; replay.step = 0;
+    replay.divergences = replay.resyncs = 0;
+    replay.active = replay.count > 0;
+}
+
+// Põe o carro na pose inicial do percurso e levanta os cones (tecla 'r' e TL_RESET no replay).
+void resetCarAndCones() {
+    car.x = course.startX; car.z = course.startZ; car.heading = course.startHeading; car.speed=0; car.wheelAngle=0;
+    prevCar = car; // Evita interpolar a partir da pose antiga.
+    rebuildConeGrid(); // Levanta os cones derrubados.
+}
+
+inline CarInput inputFromFlags(unsigned char f) {
+    return CarInput{(f & IN_UP) != 0, (f & IN_DOWN) != 0, (f & IN_LEFT) != 0, (f & IN_RIGHT) != 0};
+}
+inline unsigned char flagsFromInput(const CarInput &in) {
+    return (in.up ? IN_UP : 0) | (in.down ? IN_DOWN : 0) | (in.left ? IN_LEFT : 0) | (in.right ? IN_RIGHT : 0);
+}
+
+/**
+ * Entrada do passo atual no replay. Nos buracos (registros descartados) repete a última
+ * entrada; o estado é conferido no passo seguinte e, se divergir, ressincronizado.
+ */
+CarInput replayInput() {
+    const TelemetryRecord *r = replay.next < replay.count ? &replay.recs[replay.next] : nullptr;
+    if(r && r->step == replay.step) {
+        if(r->flags & TL_RESET) resetCarAndCones();
+        replay.lastFlags = r->flags;
+    }
+    return inputFromFlags(replay.lastFlags);
+}
+
+// Depois do passo: compara com o registro gravado e avança.
+void replayCheck() {
+    if(replay.next < replay.count && replay.recs[replay.next].step == replay.step) {
+        const TelemetryRecord &r = replay.recs[replay.next++];
+        if(memcmp(&r.x, &car.x, sizeof(float)) || memcmp(&r.z, &car.z, sizeof(float)) ||
+           memcmp(&r.heading, &car.heading, sizeof(float)) || memcmp(&r.speed, &car.speed, sizeof(float)) ||
+           memcmp(&r.wheelAngle, &car.wheelAngle, sizeof(float))) {
+            if(replay.next > 1 && replay.recs[replay.next - 2].step + 1 != r.step) replay.resyncs++;
+            else if(!(r.flags & TL_REWIND)) replay.divergences++; // Passo rebobinado: o estado só é copiado.
+            car.x = r.x; car.z = r.z; car.heading = r.heading; car.speed = r.speed; car.wheelAngle = r.wheelAngle;
+        }
+    }
+    replay.step++;
+    if(replay.next == replay.count) {
+        replay.active = false;
+        printf("Replay: %zu registros, %ld divergencias, %ld ressincronizacoes apos descartes\n",
+               replay.count, replay.divergences, replay.resyncs);
+    }
+}
+
+/**
+ * Leitor: projeto --telemetry-csv entrada.tlm saida.csv
+ * Converte o log para CSV (um passo por linha) e resume descartes e buracos.
+ */
+int runTelemetryCsv(const char *in, const char *out) {
+    MappedFile f;
+    if(!f.open(in)) { fprintf(stderr, "Nao foi possivel abrir %s\n", in); return 1; }
+    if(const char *err = validateTelemetry(f)) { fprintf(stderr, "Telemetria invalida (%s): %s\n", in, err); return 1; }
+    FILE *fp = fopen(out, "w");
+    if(!fp) { fprintf(stderr, "Nao foi possivel criar %s\n", out); return 1; }
+    const TelemetryHeader &hd = *(const TelemetryHeader*)f.data;
+    const TelemetryRecord *recs = (const TelemetryRecord*)(f.data + sizeof(TelemetryHeader));
+    size_t n = telemetryRecordCount(f);
+    long gaps = 0;
+    fprintf(fp, "step,t,x,z,heading,speed,wheelAngle,up,down,left,right,autopilot,reset\n");
+    for(size_t i=0;i<n;i++){
+        const TelemetryRecord &r = recs[i];
+        if(i > 0 && r.step != recs[i-1].step + 1) gaps++;
+        fprintf(fp, "%u,%.6f,%.6f,%.6f,%.4f,%.4f,%.4f,%d,%d,%d,%d,%d,%d\n", r.step, (double)r.step / hd.physicsHz,
+                r.x, r.z, r.heading, r.speed, r.wheelAngle, (r.flags & IN_UP) != 0, (r.flags & IN_DOWN) != 0,
+                (r.flags & IN_LEFT) != 0, (r.flags & IN_RIGHT) != 0, (r.flags & TL_AUTOPILOT) != 0, (r.flags & TL_RESET) != 0);
+    }
+    fclose(fp);
+    printf("%s: %zu registros a %u Hz (%.1f s), %llu descartados na gravacao, %ld buracos -> %s\n", in, n,
+           hd.physicsHz, n ? (double)(recs[n-1].step + 1) / hd.physicsHz : 0.0, (unsigned long long)hd.dropped, gaps, out);
+    return 0;
+}
+
+// ----------------------- Input handlers ---------------------------
+//
+// Os callbacks do GLUT não mexem no estado da simulação: cada tecla vira um evento com o
+// instante em que chegou, numa fila SPSC. A simulação consome a fila no início de cada passo
+// (processInputEvents) e aplica, em ordem, os eventos que chegaram até o instante do passo.
+
+enum InputEventType : unsigned char { EV_KEY_DOWN, EV_KEY_UP, EV_SPECIAL_DOWN, EV_SPECIAL_UP };
+
+struct InputEvent {
+    InputEventType type;
+    int key;                                   // Caractere (EV_KEY_*) ou GLUT_KEY_* (EV_SPECIAL_*).
+    std::chrono::steady_clock::time_point time;
+};
+
+bool rewindHeld = false;          // Tecla B (ver "Rebobinagem").
+bool rewindJumpPending = false;   // Tecla V, atendida no próximo passo.
+bool courseEvalPending = false;   // Tecla M: começa a avaliar o percurso no próximo passo.
+bool courseEvalRunning = false;   // Avaliação no pool, ainda sem resultado (só a simulação mexe).
+
+const size_t INPUT_QUEUE = 256;
+SpscRing<InputEvent, INPUT_QUEUE> inputEvents;
+unsigned long long inputsApplied = 0;          // Eventos já aplicados (só a simulação mexe).
+
+/**
+ * Latência entrada->tela, medida no thread do desenho: guarda o instante de cada evento
+ * enfileirado e, quando o primeiro frame feito de um snapshot que já o aplicou é apresentado,
+ * registra a diferença. Percentis das últimas LATENCY_WINDOW amostras.
+ */
+const int LATENCY_WINDOW = 512;
+struct LatencyProbe {
+    std::chrono::steady_clock::time_point sent[INPUT_QUEUE * 4];
+    unsigned long long pushed = 0, measured = 0;
+    unsigned long long dropped = 0;            // Fila cheia: o evento se perde.
+    float window[LATENCY_WINDOW] = {};
+    long long samples = 0;
+    float p50 = 0, p95 = 0, maxMs = 0;         // Refeitos a cada amostra.
+
+    void queued(std::chrono::steady_clock::time_point t) { sent[pushed++ % (INPUT_QUEUE * 4)] = t; }
+    // 'applied' = inputsApplied do snapshot desenhado; 'now' = fim da apresentação do frame.
+    void presented(unsigned long long applied, std::chrono::steady_clock::time_point now) {
+        if(applied <= measured) return;
+        measured = std::max(measured, applied > INPUT_QUEUE * 4 ? applied - INPUT_QUEUE * 4 : 0);
+        for(;measured<applied;measured++)
+            window[samples++ % LATENCY_WINDOW] =
+                std::chrono::duration<float, std::milli>(now - sent[measured % (INPUT_QUEUE * 4)]).count();
+        int n = (int)std::min<long long>(samples, LATENCY_WINDOW);
+        std::vector<float> v(window, window + n);
+        std::sort(v.begin(), v.end());
+        p50 = v[n / 2]; p95 = v[std::min(n - 1, n * 95 / 100)]; maxMs = v.back();
+    }
+} inputLatency;
+
+// Lado do GLUT: enfileira o evento com o instante atual.
+void pushInputEvent(InputEventType type, int key) {
+    auto now = std::chrono::steady_clock::now();
+    if(inputEvents.push(InputEvent{type, key, now})) inputLatency.queued(now);
+    else inputLatency.dropped++;
+}
+
+/**
+ * Aplica um evento ao estado da simulação (o que os callbacks faziam antes diretamente).
+ */
+void applyInputEvent(const InputEvent &e) {
+    bool down = e.type == EV_KEY_DOWN || e.type == EV_SPECIAL_DOWN;
+    if(e.type == EV_KEY_DOWN || e.type == EV_KEY_UP) {
+        switch(e.key) {
+            case 'w': camForward=down; break;
+            case 's': camBack=down; break;
+            case 'a': camLeft=down; break;
+            case 'd': camRight=down; break;
+            case 'q': camUp=down; break;
+            case 'e': camDown=down; break;
+            case 'r': // Reseta posições da câmera e do carro.
+                if(!down) break;
+                resetCarAndCones();
+                cam = Camera();
+                prevCam = cam;
+                autopilot = Autopilot();
+                telemetryResetPending = true;
+                break;
+            case 'c': // Câmera segue o carro (ou volta a olhar a origem).
+                if(!down) break;
+                followCar = !followCar;
+                break;
+            case 'b': rewindHeld = down; break; // Segurada: volta no tempo.
+            case 'v': if(down) rewindJumpPending = true; break; // Volta REWIND_JUMP_SEC segundos.
+            case 'm': if(down) courseEvalPending = true; break; // Avaliação Monte Carlo do percurso.
+            case 'p': // Planeja a baliza da pose atual e liga o piloto automático (ou desliga).
+                if(!down) break;
+                if(autopilot.active) { autopilot.active = false; autopilot.status = "desligado"; }
+                else { autopilot.replans = 0; startAutopilot(autopilot, parkingPlanner, car, planThreadCount()); }
+                break;
+            default: break;
+        }
+        return;
+    }
+    if(down && autopilot.active) { autopilot.active = false; autopilot.status = "desligado (setas)"; } // O motorista assume.
+    switch(e.key) {
+        case GLUT_KEY_UP: keyUp=down; break;      // Acelerar
+        case GLUT_KEY_DOWN: keyDown=down; break;  // Ré/Freio
+        case GLUT_KEY_LEFT: keyLeft=down; break;  // Virar esquerda
+        case GLUT_KEY_RIGHT: keyRight=down; break; // Virar direita
+    }
+}
+
+/**
+ * Aplica os eventos que chegaram até 'until' (os mais novos ficam para o passo seguinte).
+ */
+void processInputEvents(std::chrono::steady_clock::time_point until) {
+    while(const InputEvent *e = inputEvents.peek()) {
+        if(e->time > until) break;
+        applyInputEvent(*e);
+        inputEvents.discard();
+        inputsApplied++;
+    }
+}
+
+/**
+ * Função de callback chamada quando uma tecla regular (como WASD, ESC) é pressionada.
+ * (Corrigido: Renomeado de keyDown para keyboardDown para evitar conflito).
+ */
+void keyboardDown(unsigned char key, int x, int y) {
+    if(key == 27) exit(0); // ASCII 27 é ESC (a thread de simulação é parada no atexit).
+    pushInputEvent(EV_KEY_DOWN, key);
+}
+
+/**
+ * Função de callback chamada quando uma tecla regular é liberada.
+ * (Corrigido: Renomeado de keyUp para keyboardUp para evitar conflito).
+ */
+void keyboardUp(unsigned char key, int x, int y) {
+    pushInputEvent(EV_KEY_UP, key);
+}
+
+/**
+ * Função de callback chamada quando uma tecla especial (como setas) é pressionada.
+ */
+void specialDown(int key, int x, int y) {
+    pushInputEvent(EV_SPECIAL_DOWN, key);
+}
+/**
+ * Função de callback chamada quando uma tecla especial é liberada.
+ */
+void specialUp(int key, int x, int y) {
+    pushInputEvent(EV_SPECIAL_UP, key);
+}
+
+// ----------------------- Physics & update ------------------------
+
+int prevTime = 0; // Armazena o tempo da última atualização.
+double simTime = 0.0; // Tempo simulado acumulado (s).
+
+// Seno e cosseno em float por polinômio (coeficientes do cephes, erro de ~1 ulp): reduz o ângulo
+// ao quadrante mais próximo e avalia os dois polinômios em [-pi/4, pi/4]. vsincos() no lote SoA
+// faz exatamente as mesmas operações na mesma ordem (sem FMA), então stepCar e o kernel SIMD
+// produzem trajetórias idênticas bit a bit sem depender da sinf/cosf/tanf da libm.
+const float SC_ROUND = 12582912.0f; // 1.5*2^23: somar e subtrair arredonda para o inteiro mais próximo.
+const float SC_2_PI = 0.636619772f; // 2/pi
+const float SC_PIO2_1 = 1.5703125f, SC_PIO2_2 = 4.837512969970703125e-4f, SC_PIO2_3 = 7.54978995489188216e-8f;
+const float SC_S1 = -1.6666654611e-1f, SC_S2 = 8.3321608736e-3f, SC_S3 = -1.9515295891e-4f;
+const float SC_C1 = 4.166664568298827e-2f, SC_C2 = -1.388731625493765e-3f, SC_C3 = 2.443315711809948e-5f;
+
+inline void fastSinCos(float x, float &s, float &c) {
+    float t = (x * SC_2_PI + SC_ROUND) - SC_ROUND; // Múltiplo de pi/2 mais próximo.
+    float r = ((x - t * SC_PIO2_1) - t * SC_PIO2_2) - t * SC_PIO2_3;
+    float z = r * r;
+    float ps = r + r * z * (SC_S1 + z * (SC_S2 + z * SC_S3));
+    float pc = (1.0f - 0.5f * z) + z * z * (SC_C1 + z * (SC_C2 + z * SC_C3));
+    int q = (int)t & 3;
+    s = (q & 1) ? pc : ps;
+    c = (q & 1) ? ps : pc;
+    if(q >= 2) s = -s;
+    if(q == 1 || q == 2) c = -c;
+}
+
+/**
+ * Avança um carro em dt segundos: esterço, velocidade, modelo de bicicleta e limites.
+ * É o caminho de referência; o motor em lote (SoA) precisa reproduzir exatamente este resultado.
+ */
+void stepCar(Car &c, const CarInput &in, const CarParams &p, float dt) {
+    // 1. Controle do Ângulo de Esterço (Rodas Dianteiras)
+    if(in.left) c.wheelAngle += WHEEL_SPEED_DEG * dt;
+    else if(in.right) c.wheelAngle -= WHEEL_SPEED_DEG * dt;
+    else {
+        // Auto-centralização do volante (lento).
+        if(c.wheelAngle > 1.0f) c.wheelAngle -= 60.0f*dt;
+        else if(c.wheelAngle < -1.0f) c.wheelAngle += 60.0f*dt;
+        else c.wheelAngle = 0.0f;
+    }
+    // Limita o ângulo de esterço.
+    if(c.wheelAngle > p.maxWheelDeg) c.wheelAngle = p.maxWheelDeg;
+    if(c.wheelAngle < -p.maxWheelDeg) c.wheelAngle = -p.maxWheelDeg;
+
+    // 2. Controle da Velocidade (Aceleração e Freio/Fricção)
+    if(in.up) c.speed += CAR_ACCEL * dt;  // Acelera
+    else if(in.down) c.speed -= CAR_ACCEL * dt; // Ré ou freio
+    else {
+        // Fricção/Arrasto: Se não estiver acelerando, a velocidade cai.
+        if(c.speed > 0.0f) { c.speed -= p.friction * dt; if(c.speed < 0) c.speed = 0.0f; }
+        else if(c.speed < 0.0f) { c.speed += p.friction * dt; if(c.speed > 0) c.speed = 0.0f; }
+    }
+    // Limita a velocidade máxima.
+    if(c.speed > MAX_SPEED) c.speed = MAX_SPEED;
+    if(c.speed < MAX_REVERSE) c.speed = MAX_REVERSE;
+
+    // 3. Atualização da Posição e Direção (Modelo de Bicicleta Simplificado)
+    float steerRad = c.wheelAngle * (PI/180.0f); // Converte esterço para radianos.
+    if(fabsf(steerRad) > 1e-4f) {
+        // R = Distância entre eixos / tan(ângulo de esterço) -> Raio de Curva
+        float ss, sc;
+        fastSinCos(steerRad, ss, sc);
+        float R = p.wheelBase / (ss / sc);
+        // Calcula a velocidade angular (deg/s).
+        float angVel = (c.speed / R) * (180.0f/PI);
+        c.heading += angVel * dt; // Atualiza o ângulo de direção.
+    }
+    // Move o carro na direção atual (heading).
+    float hr = c.heading * (PI/180.0f); // Converte heading para radianos.
+    float hs, hc;
+    fastSinCos(hr, hs, hc);
+    c.x += hs * c.speed * dt;  // Movimento X = sin(heading) * velocidade * dt
+    c.z += hc * c.speed * dt;  // Movimento Z = cos(heading) * velocidade * dt
+
+    // 4. Limites de Borda: o chão do percurso (nenhum no mundo aberto)
+    if(openWorld) return;
+    if(c.x > course.groundMaxX) c.x = course.groundMaxX;
+    if(c.x < course.groundMinX) c.x = course.groundMinX;
+    if(c.z > course.groundMaxZ) c.z = course.groundMaxZ;
+    if(c.z < course.groundMinZ) c.z = course.groundMinZ;
+}
+
+// Teclas da câmera num passo (a rebobinagem guarda este byte e refaz a câmera com ele).
+const unsigned char CAM_FORWARD = 1, CAM_BACK = 2, CAM_LEFT = 4, CAM_RIGHT = 8, CAM_UP = 16, CAM_DOWN = 32,
+                    CAM_FOLLOW = 64;
+
+unsigned char cameraFlags() {
+    return (camForward ? CAM_FORWARD : 0) | (camBack ? CAM_BACK : 0) | (camLeft ? CAM_LEFT : 0) |
+           (camRight ? CAM_RIGHT : 0) | (camUp ? CAM_UP : 0) | (camDown ? CAM_DOWN : 0) | (followCar ? CAM_FOLLOW : 0);
+}
+
+/**
+ * Avança a câmera em dt segundos com as teclas 'f' (CAM_*), depois do passo do carro 'c'.
+ */
+void stepCamera(Camera &cm, unsigned char f, const Car &c, float dt) {
+    float cs = cm.speed * dt;
+    // Movimento simples nos eixos globais X e Z (seguindo o carro, só a altura).
+    if(!(f & CAM_FOLLOW)) {
+        if(f & CAM_FORWARD) { cm.z -= cs; }
+        if(f & CAM_BACK) { cm.z += cs; }
+        if(f & CAM_LEFT) { cm.x -= cs; }
+        if(f & CAM_RIGHT) { cm.x += cs; }
+        cm.tx = 0.0f; cm.ty = 0.5f; cm.tz = 0.0f; // Olha a origem.
+    }
+    // Movimento vertical.
+    if(f & CAM_UP) { cm.y += cs; }
+    if(f & CAM_DOWN) { cm.y -= cs; if(cm.y < 0.5f) cm.y = 0.5f; } // Limita a altura mínima.
+    if(f & CAM_FOLLOW) {
+        // Câmera atrás do carro, suavizada para não tremer com o esterço.
+        float hr = c.heading * (PI/180.0f), k = 1.0f - expf(-dt / CAM_FOLLOW_TAU);
+        cm.x += (c.x - sinf(hr) * CAM_FOLLOW_DIST - cm.x) * k;
+        cm.z += (c.z - cosf(hr) * CAM_FOLLOW_DIST - cm.z) * k;
+        cm.tx = c.x; cm.ty = 0.5f; cm.tz = c.z;
+    }
+}
+
+unsigned char lastCarInput = 0; // IN_* aplicados no último passo (rebobinagem).
+
+/**
+ * Atualiza o estado físico do carro e da câmera. Chamada a cada passo fixo (simulationStep).
+ * @param dt Duração do passo de física (em segundos).
+ */
+void updatePhysics(float dt) {
+    // --- Lógica do Carro ---
+    // Entradas: arquivo de replay, piloto automático ou teclado.
+    bool autoDriven = autopilot.active && !replay.active;
+    CarInput in = replay.active ? replayInput() : autoDriven ? autopilotInput(autopilot, parkingPlanner, car)
+                                                           : CarInput{keyUp, keyDown, keyLeft, keyRight};
+    bool replaying = replay.active;
+    stepCar(car, in, DEFAULT_CAR_PARAMS, dt);
+    if(replaying) replayCheck();
+    lastCarInput = flagsFromInput(in);
+
+    // --- Lógica da Câmera ---
+    stepCamera(cam, cameraFlags(), car, dt);
+    telemetry.record(car, flagsFromInput(in) | (autoDriven ? TL_AUTOPILOT : 0) | (telemetryResetPending ? TL_RESET : 0));
+    telemetryResetPending = false;
+    simTime += dt;
+
+    // --- Colisão com os cones ---
+    updateConeCollisions(simTime);
+}
+
+// ----------------------- Avaliação do percurso (Monte Carlo) -------------------------
+//
+// Mede a dificuldade do percurso atual simulando milhares de motoristas aleatórios da pose
+// inicial até a vaga, com stepCar e a colisão contra os cones em pé. Cada tentativa sorteia
+// trechos de 0,1 a 0,5 s com acelerador (frente, solto, ré) e esterço (esquerda, reto, direita);
+// ao entrar na vaga o motorista freia até parar, e parar dentro dela é estacionar. A nota
+// premia estacionar cedo e penaliza cada cone tocado; as falhas contam a distância até a vaga.
+// As tentativas rodam em threads com roubo de trabalho: cada thread começa com uma faixa de
+// índices e, quando a sua acaba, rouba a metade final da faixa de outra. O gerador de cada
+// tentativa é semeado pelo índice, então o resultado não depende do número de threads nem da
+// ordem; o laço quente só usa memória da própria thread, alocada antes. As threads são de um
+// pool persistente: a tecla M só dispara a avaliação e o passo da simulação recolhe o resultado
+// quando fica pronto, sem esperar.
+
+const float EVAL_DT = 1.0f / 60.0f;      // Passo das tentativas (o do modo batch).
+const float EVAL_MAX_SEC = 20.0f;        // Tentativa sem estacionar até aqui é falha.
+const int EVAL_CHUNK = 16;               // Tentativas retiradas da faixa por vez.
+const int EVAL_PATH_EVERY = 3;           // Passos entre pontos guardados da trajetória.
+int evalRollouts = 10000;                // --eval-rollouts N (tecla M e --eval-course).
+int evalThreads = 0;                     // --eval-threads N (tecla M); 0 = todas as do processador.
+
+int evalThreadCount() {
+    return evalThreads > 0 ? evalThreads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Resumo de uma avaliação (HUD, --eval-course).
+struct CourseEvalStats {
+    int rollouts = 0, threads = 0;
+    int parked = 0, parkedClean = 0;     // Estacionou; estacionou sem tocar em cones.
+    double meanHits = 0.0;               // Cones tocados por tentativa.
+    double parkP50 = 0.0, parkP95 = 0.0; // Tempo até estacionar (s), entre as que estacionaram.
+    double meanMissDist = 0.0;           // Distância final até a vaga nas falhas (m).
+    float bestScore = 0.0f;
+    int bestIndex = -1, bestHits = 0;
+    float bestTime = 0.0f;
+    long long steps = 0, steals = 0;
+    double ms = 0.0;
+};
+
+struct CourseEval {
+    CourseEvalStats stats;
+    std::shared_ptr<const std::vector<PathPoint>> best; // Melhor trajetória (desenhada como o plano).
+} courseEval;
+
+// Resultado de uma tentativa (uma posição por índice: as threads não disputam nada).
+struct RolloutResult {
+    float score, time, missDist;
+    int hits;
+    bool parked;
+};
+
+// splitmix64: semente de cada tentativa e gerador do motorista.
+inline uint64_t splitmix64(uint64_t &s) {
+    uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Memória de trabalho de uma thread, alocada antes das tentativas.
+struct RolloutScratch {
+    std::vector<ConeHit> hits;
+    std::vector<unsigned char> touched;  // Por cone: já tocado nesta tentativa.
+    std::vector<int> touchedList;
+    std::vector<PathPoint> path, bestPath;
+    float bestScore = -1e30f;
+    int bestIndex = -1;
+    long long steps = 0, steals = 0;
+
+    void init(size_t coneCount, int maxSteps) {
+        hits.reserve(64);
+        touched.assign(coneCount, 0);
+        touchedList.reserve(coneCount);
+        path.reserve(maxSteps / EVAL_PATH_EVERY + 2);
+        bestPath.reserve(maxSteps / EVAL_PATH_EVERY + 2);
+    }
+};
+
+// Faixa de tentativas de uma thread: a dona tira do começo, as outras roubam do fim.
+struct RolloutRange {
+    std::mutex mtx;
+    int begin = 0, end = 0;
+};
+
+/**
+ * Simula a tentativa 'index' a partir de 'start' e guarda a trajetória em s.path.
+ */
+template<class Grid>
+RolloutResult runRollout(const Grid &grid, const Car &start, uint64_t seed, int index, RolloutScratch &s) {
+    uint64_t rng = seed ^ (uint64_t)index * 0xD1B54A32D192ED03ull;
+    splitmix64(rng);
+    const int maxSteps = (int)(EVAL_MAX_SEC / EVAL_DT);
+    Car c = start;
+    CarInput in;
+    int segment = 0, hits = 0;
+    bool parked = false;
+    int step = 0;
+    s.path.clear();
+    s.path.push_back(PathPoint{c.x, c.z, c.heading, 1});
+    for(; step < maxSteps; step++){
+        if(course.inGoal(c.x, c.z)) {
+            // Na vaga: freia (seta contrária ao movimento) até parar.
+            if(fabsf(c.speed) <= CAR_ACCEL * EVAL_DT) { parked = true; break; }
+            in = CarInput{c.speed < 0, c.speed > 0, false, false};
+            segment = 0;
+        } else if(segment-- <= 0) {
+            uint64_t r = splitmix64(rng);
+            segment = 6 + (int)(r % 25);              // 0,1 a 0,5 s.
+            int throttle = (int)(r >> 8 & 0xFF), steer = (int)(r >> 16 & 0xFF);
+            in.up = throttle < 140;                   // ~55% frente, ~25% solto, ~20% ré.
+            in.down = throttle >= 204;
+            in.left = steer < 64;                     // 25% esquerda, 50% reto, 25% direita.
+            in.right = steer >= 192;
+        }
+        stepCar(c, in, DEFAULT_CAR_PARAMS, EVAL_DT);
+        queryConeHits(grid, cones.data(), c, s.hits);
+        for(const ConeHit &h : s.hits)
+            if(!s.touched[h.cone]) { s.touched[h.cone] = 1; s.touchedList.push_back(h.cone); hits++; }
+        if(step % EVAL_PATH_EVERY == 0) s.path.push_back(PathPoint{c.x, c.z, c.heading, c.speed < 0 ? -1 : 1});
+    }
+    s.path.push_back(PathPoint{c.x, c.z, c.heading, c.speed < 0 ? -1 : 1});
+    for(int i : s.touchedList) s.touched[i] = 0;
+    s.touchedList.clear();
+    s.steps += step;
+
+    RolloutResult r;
+    r.parked = parked;
+    r.hits = hits;
+    r.time = step * EVAL_DT;
+    float gx = 0.5f * (course.goalMinX + course.goalMaxX), gz = 0.5f * (course.goalMinZ + course.goalMaxZ);
+    r.missDist = parked ? 0.0f : hypotf(c.x - gx, c.z - gz);
+    r.score = parked ? 1000.0f - 200.0f * hits - 10.0f * r.time : -10.0f * r.missDist - 200.0f * hits;
+    return r;
+}
+
+// Pool persistente da avaliação: as threads ficam vivas entre avaliações e dormem na condition
+// variable. start() copia os cones em pé (a simulação continua derrubando os seus) e volta logo;
+// cada thread participante percorre a sua faixa e a última a terminar agrega o resultado, que
+// poll() recolhe no passo da simulação e wait() espera (--eval-course).
+struct CourseEvaluator {
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv, doneCv;
+    unsigned long long generation = 0;
+    int pending = 0;
+    bool stopping = false, running = false, done = false;
+    std::atomic<bool> cancel{false};   // Saída do programa no meio de uma avaliação.
+
+    // Avaliação em andamento: só as threads do pool mexem enquanto 'running'.
+    ConeGrid grid;                       // Cópia da grade dos cones em pé (percurso gerado)...
+    ConeCellIndex index;                 // ...ou do índice do arquivo, com 'knocked' copiado.
+    std::vector<unsigned char> knocked;
+    Car startPose;
+    uint64_t seed = 1;
+    int rollouts = 0, threads = 0;
+    std::chrono::steady_clock::time_point t0;
+    std::vector<RolloutResult> results;
+    std::vector<RolloutScratch> scratch;
+    std::vector<RolloutRange> ranges;
+    CourseEval result;
+
+    ~CourseEvaluator() { stopWorkers(); }
+
+    void start(int rolloutCount, int threadCount, uint64_t rolloutSeed = 1);
+    bool poll(CourseEval &out);
+    void wait(CourseEval &out);
+    void startWorkers(int n);
+    void stopWorkers();
+    void workerLoop(int t, unsigned long long seen);
+    void runRange(int t);
+    void finish();
+} courseEvaluator;
+
+/**
+ * Começa a avaliar o percurso atual (cones em pé) com 'rollouts' tentativas da pose inicial do
+ * percurso em 'threads' threads do pool. Não espera: o resultado sai em poll() ou wait().
+ */
+void CourseEvaluator::start(int rolloutCount, int threadCount, uint64_t rolloutSeed) {
+    t0 = std::chrono::steady_clock::now();
+    rollouts = std::max(1, rolloutCount);
+    threads = std::max(1, std::min(threadCount, rollouts));
+    seed = rolloutSeed;
+    startPose = Car();
+    startPose.x = course.startX; startPose.z = course.startZ; startPose.heading = course.startHeading;
+    if(coneIndex.valid()) {
+        knocked = coneKnocked;
+        index = coneIndex;
+        index.knocked = knocked.data();
+        grid.clear();
+    } else {
+        grid = coneGrid;
+        index.clear();
+    }
+    const int maxSteps = (int)(EVAL_MAX_SEC / EVAL_DT);
+    results.assign(rollouts, RolloutResult());
+    scratch.assign(threads, RolloutScratch());
+    ranges = std::vector<RolloutRange>(threads);
+    for(int t=0;t<threads;t++){
+        scratch[t].init(cones.size(), maxSteps);
+        ranges[t].begin = (int)((long long)rollouts * t / threads);
+        ranges[t].end = (int)((long long)rollouts * (t + 1) / threads);
+    }
+    startWorkers(threads);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = true;
+        done = false;
+        pending = threads;
+        generation++;
+    }
+    cv.notify_all();
+}
+
+// Se a avaliação terminou, copia o resultado para 'out' e libera o pool para a próxima.
+bool CourseEvaluator::poll(CourseEval &out) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!done) return false;
+    out = result;
+    done = false;
+    return true;
+}
+
+// Espera a avaliação em andamento e copia o resultado para 'out'.
+void CourseEvaluator::wait(CourseEval &out) {
+    std::unique_lock<std::mutex> lock(mtx);
+    doneCv.wait(lock, [&]() { return !running; });
+    out = result;
+    done = false;
+}
+
+// Deixa o pool com pelo menos 'n' threads (só cresce; só é chamada sem avaliação em andamento).
+void CourseEvaluator::startWorkers(int n) {
+    if((int)workers.size() >= n) return;
+    stopWorkers();
+    stopping = false;
+    cancel = false;
+    // As novas threads partem da geração atual: só acordam na próxima avaliação.
+    for(int t=0;t<n;t++) workers.emplace_back([this, t, seen = generation]() { workerLoop(t, seen); });
+}
+
+void CourseEvaluator::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cancel = true;
+    cv.notify_all();
+    for(auto &w : workers) w.join();
+    workers.clear();
+}
+
+void CourseEvaluator::workerLoop(int t, unsigned long long seen) {
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [&]() { return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+            if(t >= threads) continue;   // Pool maior que a avaliação: esta thread fica de fora.
+        }
+        runRange(t);
+        std::lock_guard<std::mutex> lock(mtx);
+        if(--pending == 0) {
+            if(!cancel) finish();
+            running = false;
+            done = true;
+            doneCv.notify_all();
+        }
+    }
+}
+
+// Tentativas da thread 't': a sua faixa em blocos de EVAL_CHUNK e, quando acaba, roubos.
+void CourseEvaluator::runRange(int t) {
+    RolloutScratch &s = scratch[t];
+    RolloutRange &own = ranges[t];
+    while(!cancel.load(std::memory_order_relaxed)) {
+        int begin, end;
+        {
+            std::lock_guard<std::mutex> lock(own.mtx);
+            begin = own.begin;
+            end = std::min(own.end, begin + EVAL_CHUNK);
+            own.begin = end;
+        }
+        if(begin >= end) {
+            // Faixa vazia: rouba a metade final da maior faixa das outras threads.
+            int victim = -1, most = 0;
+            for(int k=1;k<threads;k++){
+                RolloutRange &r = ranges[(t + k) % threads];
+                std::lock_guard<std::mutex> lock(r.mtx);
+                if(r.end - r.begin > most) { most = r.end - r.begin; victim = (t + k) % threads; }
+            }
+            if(victim < 0) return;
+            RolloutRange &r = ranges[victim];
+            int from, to;
+            {
+                std::lock_guard<std::mutex> lock(r.mtx);
+                int left = r.end - r.begin;
+                if(left <= 0) continue;
+                from = r.end - (left + 1) / 2;
+                to = r.end;
+                r.end = from;
+            }
+            std::lock_guard<std::mutex> lock(own.mtx);
+            own.begin = from;
+            own.end = to;
+            s.steals++;
+            continue;
+        }
+        for(int i=begin;i<end;i++){
+            RolloutResult r = index.valid() ? runRollout(index, startPose, seed, i, s)
+                                            : runRollout(grid, startPose, seed, i, s);
+            results[i] = r;
+            // Melhor da thread: nota maior e, no empate, o menor índice (independe da ordem).
+            if(r.score > s.bestScore || (r.score == s.bestScore && i < s.bestIndex)) {
+                s.bestScore = r.score;
+                s.bestIndex = i;
+                s.bestPath.assign(s.path.begin(), s.path.end());
+            }
+        }
+    }
+}
+
+// Agrega as tentativas (chamada pela última thread a terminar, com mtx travado).
+void CourseEvaluator::finish() {
+    // Agregados na ordem dos índices (somas iguais com qualquer número de threads).
+    CourseEvalStats st;
+    st.rollouts = rollouts;
+    st.threads = threads;
+    std::vector<float> parkTimes;
+    double hitSum = 0, missSum = 0;
+    for(const RolloutResult &r : results){
+        hitSum += r.hits;
+        if(r.parked) {
+            st.parked++;
+            if(r.hits == 0) st.parkedClean++;
+            parkTimes.push_back(r.time);
+        } else missSum += r.missDist;
+    }
+    st.meanHits = hitSum / rollouts;
+    st.meanMissDist = st.parked < rollouts ? missSum / (rollouts - st.parked) : 0.0;
+    if(!parkTimes.empty()) {
+        std::sort(parkTimes.begin(), parkTimes.end());
+        st.parkP50 = parkTimes[parkTimes.size() / 2];
+        st.parkP95 = parkTimes[parkTimes.size() * 95 / 100];
+    }
+    const RolloutScratch *best = nullptr;
+    for(const RolloutScratch &s : scratch){
+        st.steps += s.steps;
+        st.steals += s.steals;
+        if(s.bestIndex >= 0 && (!best || s.bestScore > best->bestScore ||
+                                (s.bestScore == best->bestScore && s.bestIndex < best->bestIndex))) best = &s;
+    }
+    st.bestScore = best->bestScore;
+    st.bestIndex = best->bestIndex;
+    st.bestHits = results[best->bestIndex].hits;
+    st.bestTime = results[best->bestIndex].time;
+    st.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    result.stats = st;
+    result.best = std::make_shared<std::vector<PathPoint>>(best->bestPath);
+}
+
+/**
+ * Avalia o percurso atual no pool e espera o resultado (--eval-course).
+ */
+void evaluateCourse(CourseEval &ev, int rollouts, int threads, uint64_t seed = 1) {
+    courseEvaluator.start(rollouts, threads, seed);
+    courseEvaluator.wait(ev);
+}
+
+// ----------------------- Estado da simulação e rebobinagem -------------------------
+//
+// saveSimState/restoreSimState copiam o estado inteiro da simulação (carro, câmera, cones
+// derrubados, piloto, teclas, tempo): é o que o lote usa para bifurcar simulações a partir de
+// um ponto de uma corrida (--batch ... --fork-at N, que também confere que retomar do estado
+// salvo refaz a corrida direta bit a bit).
+//
+// A rebobinagem guarda, num buffer de tamanho fixo (--rewind-sec, padrão 300 s), um keyframe
+// com carro, câmera, tempo e estatísticas dos cones a cada REWIND_KEYFRAME_STEPS passos e, por
+// passo, só um delta de 2 bytes com as entradas aplicadas (IN_* e CAM_*); os cones derrubados
+// vão para um log à parte. Como a física é determinística, o estado de qualquer passo sai do
+// keyframe anterior refazendo no máximo REWIND_KEYFRAME_STEPS passos de stepCar/stepCamera,
+// sem colisão (os cones vêm do log). Tecla B segurada volta REWIND_SPEED passos por passo;
+// V volta REWIND_JUMP_SEC segundos. Voltar descarta o futuro; um reset ('r') ou um replay
+// recomeçam a história.
+
+const int REWIND_KEYFRAME_STEPS = 240;  // Passos entre keyframes (1 s a 240 Hz).
+const int REWIND_SPEED = 2;             // Tecla B: passos desfeitos por passo de física.
+const double REWIND_JUMP_SEC = 5.0;     // Tecla V.
+const size_t REWIND_MAX_HITS = 1 << 14; // Cones derrubados guardados (o mais antigo limita a volta).
+int rewindSeconds = 300;                // --rewind-sec N
+
+/**
+ * Estado completo da simulação. Copiar é barato (os cones são um byte cada).
+ */
+struct SimState {
+    Car car, prevCar;
+    Camera cam, prevCam;
+    double simTime = 0.0;
+    ConeStats coneStats;
+    std::vector<unsigned char> coneKnocked;
+    Autopilot autopilot;
+    unsigned char carKeys = 0, camKeys = 0; // IN_* e CAM_* seguradas.
+};
+
+void saveSimState(SimState &s) {
+    s.car = car; s.prevCar = prevCar;
+    s.cam = cam; s.prevCam = prevCam;
+    s.simTime = simTime;
+    s.coneStats = coneStats;
+    s.coneKnocked = coneKnocked;
+    s.autopilot = autopilot;
+    s.carKeys = flagsFromInput(CarInput{keyUp, keyDown, keyLeft, keyRight});
+    s.camKeys = cameraFlags();
+}
+
+/**
+ * Põe a simulação no estado 's' (do mesmo percurso). Só os cones que mudaram geram eventos
+ * para o desenho. Recomeça a história da rebobinagem.
+ */
+void restoreSimState(const SimState &s) {
+    car = s.car; prevCar = s.prevCar;
+    cam = s.cam; prevCam = s.prevCam;
+    simTime = s.simTime;
+    for(size_t i=0;i<s.coneKnocked.size() && i<coneKnocked.size();i++) setConeKnocked((int)i, s.coneKnocked[i] != 0);
+    coneStats = s.coneStats;
+    autopilot = s.autopilot;
+    CarInput k = inputFromFlags(s.carKeys);
+    keyUp = k.up; keyDown = k.down; keyLeft = k.left; keyRight = k.right;
+    camForward = s.camKeys & CAM_FORWARD; camBack = s.camKeys & CAM_BACK;
+    camLeft = s.camKeys & CAM_LEFT; camRight = s.camKeys & CAM_RIGHT;
+    camUp = s.camKeys & CAM_UP; camDown = s.camKeys & CAM_DOWN;
+    followCar = s.camKeys & CAM_FOLLOW;
+    coneResets++; // A história anterior não vale para o estado restaurado.
+}
+
+// Compara dois estados bit a bit (carro, câmera, tempo, cones, piloto e teclas).
+bool sameSimState(const SimState &a, const SimState &b) {
+    return !memcmp(&a.car, &b.car, sizeof(Car)) && !memcmp(&a.prevCar, &b.prevCar, sizeof(Car)) &&
+           !memcmp(&a.cam, &b.cam, sizeof(Camera)) && !memcmp(&a.prevCam, &b.prevCam, sizeof(Camera)) &&
+           a.simTime == b.simTime && a.coneStats.knocked == b.coneStats.knocked &&
+           a.coneStats.lastHitTime == b.coneStats.lastHitTime && a.coneKnocked == b.coneKnocked &&
+           a.autopilot.active == b.autopilot.active && a.autopilot.path == b.autopilot.path &&
+           a.autopilot.segStart == b.autopilot.segStart && a.autopilot.nearest == b.autopilot.nearest &&
+           a.carKeys == b.carKeys && a.camKeys == b.camKeys;
+}
+
+struct RewindDelta { unsigned char car, cam; }; // IN_* e CAM_* do passo.
+
+// Estado reconstruído de um passo; os cones são os do log até 'hitEnd'.
+struct RewindPoint {
+    Car car;
+    Camera cam;
+    double simTime = 0.0;
+    ConeStats coneStats;
+    uint64_t hitEnd = 0;  // Índice absoluto do primeiro cone do log derrubado depois deste passo.
+};
+
+struct RewindHit { uint64_t step; int cone; float penetration; double time; };
+
+/**
+ * Buffers circulares de capacidade fixa indexados pelo passo absoluto desde o início da
+ * história: deltas[s % cap] é a entrada do passo s (estado s -> s+1), keys[(s / K) % capK] o
+ * estado no passo s múltiplo de K, hits[h % capH] os cones derrubados em ordem.
+ */
+struct RewindBuffer {
+    std::vector<RewindDelta> deltas;
+    std::vector<RewindPoint> keys;
+    std::vector<RewindHit> hits;
+    uint64_t first = 0, head = 0;       // Passos com delta: [first, head); 'head' é o estado atual.
+    uint64_t hitFirst = 0, hitHead = 0;
+    unsigned resets = 0;                // coneResets quando a história começou.
+    float dt = 0.0f;
+
+    void init(int hz, int seconds) {
+        dt = 1.0f / hz;
+        size_t steps = (size_t)std::max(1, seconds) * hz;
+        steps = (steps + REWIND_KEYFRAME_STEPS - 1) / REWIND_KEYFRAME_STEPS * REWIND_KEYFRAME_STEPS;
+        deltas.assign(steps, RewindDelta{0, 0});
+        keys.assign(steps / REWIND_KEYFRAME_STEPS + 1, RewindPoint());
+        hits.assign(REWIND_MAX_HITS, RewindHit{0, 0, 0.0f, 0.0});
+        restart();
+    }
+    bool ready() const { return !deltas.empty(); }
+    size_t bytes() const {
+        return deltas.size() * sizeof(RewindDelta) + keys.size() * sizeof(RewindPoint) + hits.size() * sizeof(RewindHit);
+    }
+    // Primeiro passo reconstruível (keyframe mais antigo ainda com todos os deltas).
+    uint64_t oldest() const {
+        uint64_t k = (first + REWIND_KEYFRAME_STEPS - 1) / REWIND_KEYFRAME_STEPS * REWIND_KEYFRAME_STEPS;
+        return std::min(k, head);
+    }
+    double seconds() const { return (head - oldest()) * (double)dt; }
+
+    RewindPoint current() const {
+        RewindPoint p;
+        p.car = car; p.cam = cam; p.simTime = simTime; p.coneStats = coneStats; p.hitEnd = hitHead;
+        return p;
+    }
+    // Recomeça a história no estado atual.
+    void restart() {
+        first = head = 0;
+        hitFirst = hitHead = 0;
+        resets = coneResets;
+        keys[0] = current();
+    }
+
+    /**
+     * Depois de um passo para frente: guarda o delta e os cones derrubados e, a cada
+     * REWIND_KEYFRAME_STEPS passos, um keyframe. Sem alocação.
+     */
+    void record(unsigned char carIn, unsigned char camIn, const std::vector<ConeHit> &stepHits) {
+        if(!ready()) return;
+        if(replay.active || resets != coneResets) { restart(); return; }
+        if(head - first == deltas.size()) first++;
+        deltas[head % deltas.size()] = RewindDelta{carIn, camIn};
+        for(const ConeHit &h : stepHits) {
+            if(hitHead - hitFirst == hits.size()) {
+                // Log cheio: passos até o cone descartado não podem mais ser refeitos.
+                first = std::max(first, hits[hitFirst % hits.size()].step + 1);
+                hitFirst++;
+            }
+            hits[hitHead++ % hits.size()] = RewindHit{head, h.cone, h.penetration, simTime};
+        }
+        head++;
+        if(head % REWIND_KEYFRAME_STEPS == 0) keys[(head / REWIND_KEYFRAME_STEPS) % keys.size()] = current();
+    }
+
+    /**
+     * Estado do passo 'step' (oldest() <= step <= head) sem mexer na simulação: parte do
+     * keyframe anterior e refaz os passos com os deltas.
+     */
+    void reconstruct(uint64_t step, RewindPoint &p) const {
+        uint64_t k = step / REWIND_KEYFRAME_STEPS * REWIND_KEYFRAME_STEPS;
+        p = keys[(k / REWIND_KEYFRAME_STEPS) % keys.size()];
+        for(uint64_t s=k;s<step;s++){
+            const RewindDelta &d = deltas[s % deltas.size()];
+            stepCar(p.car, inputFromFlags(d.car), DEFAULT_CAR_PARAMS, dt);
+            stepCamera(p.cam, d.cam, p.car, dt);
+            p.simTime += dt;
+            for(;p.hitEnd < hitHead && hits[p.hitEnd % hits.size()].step == s;p.hitEnd++) {
+                const RewindHit &h = hits[p.hitEnd % hits.size()];
+                p.coneStats.knocked++;
+                p.coneStats.lastPenetration = h.penetration;
+                p.coneStats.lastHitTime = h.time;
+            }
+        }
+    }
+
+    /**
+     * Volta a simulação para o passo 'step' (limitado à história) e descarta o que vinha depois.
+     * @param snap true: sem interpolação a partir do estado anterior (salto); false: rebobinar contínuo.
+     */
+    void seek(uint64_t step, bool snap) {
+        step = std::max(oldest(), std::min(step, head));
+        RewindPoint p;
+        reconstruct(step, p);
+        for(uint64_t h=p.hitEnd;h<hitHead;h++) setConeKnocked(hits[h % hits.size()].cone, false);
+        hitHead = p.hitEnd;
+        head = step;
+        car = p.car; cam = p.cam;
+        simTime = p.simTime;
+        coneStats = p.coneStats;
+        if(snap) { prevCar = car; prevCam = cam; }
+    }
+} rewindHistory;
+
+/**
+ * Teclas B/V no início do passo: em vez de avançar, volta na história. Desliga o piloto
+ * automático (o plano não sabe do salto). Retorna true se o passo foi usado para voltar.
+ */
+bool rewindControl() {
+    RewindBuffer &rw = rewindHistory;
+    if(!rw.ready() || replay.active || (!rewindHeld && !rewindJumpPending)) { rewindJumpPending = false; return false; }
+    if(autopilot.active) { autopilot.active = false; autopilot.status = "desligado (rebobinado)"; }
+    uint64_t back = rewindJumpPending ? (uint64_t)(REWIND_JUMP_SEC / rw.dt + 0.5) : (uint64_t)REWIND_SPEED;
+    rw.seek(rw.head > back ? rw.head - back : 0, rewindJumpPending);
+    rewindJumpPending = false;
+    telemetry.record(car, TL_REWIND);
+    return true;
+}
+
+// ----------------------- Snapshots da simulação -------------------------
+//
+// Tudo o que o desenho lê da simulação (carro, câmera, colisões, piloto automático,
+// telemetria) é copiado num snapshot imutável depois de cada passo e publicado por um triple
+// buffer; display() pega o mais recente sem travas. O estado de cada cone vai à parte, pelos
+// eventos de ConeView, para não copiar um vetor do tamanho do percurso a cada passo.
+
+struct SimSnapshot {
+    Car prevCar, car;
+    Camera prevCam, cam;
+    double simTime = 0.0;
+    std::chrono::steady_clock::time_point stepTime; // Instante real a que 'car' corresponde.
+    float alpha = 1.0f;                             // Interpolação calculada pelo relógio do loop.
+    ConeStats coneStats;
+    const char *autopilotStatus = "";
+    PlanStats planStats;
+    std::shared_ptr<const std::vector<PathPoint>> path;
+    CourseEvalStats evalStats;
+    std::shared_ptr<const std::vector<PathPoint>> evalPath; // Melhor tentativa da tecla M.
+    bool evalRunning = false;                       // Avaliação da tecla M em andamento.
+    unsigned long long telemetryDropped = 0;
+    bool replayActive = false;
+    size_t replayNext = 0;
+    long replayDivergences = 0;
+    unsigned long long inputsApplied = 0;           // Para a medição de latência (LatencyProbe).
+    double rewindSeconds = 0.0;                     // História disponível para rebobinar.
+    bool rewinding = false;
+};
+TripleBuffer<SimSnapshot> simSnapshots;
+
+/**
+ * Copia o estado atual da simulação para o triple buffer (lado da simulação).
+ * @param alpha Interpolação para o modo sem thread de simulação.
+ * @param stepTime Instante real correspondente ao passo mais recente.
+ */
+void publishSnapshot(float alpha, std::chrono::steady_clock::time_point stepTime) {
+    SimSnapshot &s = simSnapshots.writeSlot();
+    s.prevCar = prevCar; s.car = car;
+    s.prevCam = prevCam; s.cam = cam;
+    s.simTime = simTime;
+    s.stepTime = stepTime;
+    s.alpha = alpha;
+    s.coneStats = coneStats;
+    s.autopilotStatus = autopilot.status;
+    s.planStats = autopilot.stats;
+    s.path = autopilot.path;
+    s.evalStats = courseEval.stats;
+    s.evalPath = courseEval.best;
+    s.evalRunning = courseEvalRunning;
+    s.telemetryDropped = telemetry.dropped;
+    s.replayActive = replay.active;
+    s.replayNext = replay.next;
+    s.replayDivergences = replay.divergences;
+    s.inputsApplied = inputsApplied;
+    s.rewindSeconds = rewindHistory.seconds();
+    s.rewinding = rewindHeld && rewindHistory.ready() && !replay.active;
+    simSnapshots.publish();
+}
+
+// ----------------------- Relógio de simulação (passo fixo) -------------------------
+//
+// A física avança sempre em passos de 1/physicsHz segundos, independentemente da taxa de
+// quadros; o display() desenha a interpolação entre os dois últimos estados. Mesmas entradas
+// nos mesmos passos produzem exatamente a mesma trajetória. Sem a thread de simulação
+// (--single-thread e headless), o idleFunc do GLUT chama advanceSimulation antes de cada redesenho.
+
+int physicsHz = 240;                  // Frequência da física (configurável com --hz).
+const double MAX_CATCHUP_SEC = 0.25;  // Atraso máximo recuperado por chamada; o excesso é descartado.
+double simAccumulator = 0.0;          // Tempo real ainda não simulado (s).
+float renderAlpha = 1.0f;             // Fração entre prevCar/prevCam e car/cam usada no display().
+
+/**
+ * Um passo fixo: guarda o estado anterior (interpolação), aplica as entradas que chegaram até
+ * 'until' e avança a física (ou volta na história com B/V) e registra o passo para a rebobinagem.
+ */
+void simulationStep(float dt, std::chrono::steady_clock::time_point until) {
+    prevCar = car;
+    prevCam = cam;
+    processInputEvents(until);
+    if(courseEvalPending) {
+        // Roda no pool da avaliação; um M durante uma avaliação é ignorado.
+        courseEvalPending = false;
+        if(!courseEvalRunning) { courseEvaluator.start(evalRollouts, evalThreadCount()); courseEvalRunning = true; }
+    }
+    if(courseEvalRunning && courseEvaluator.poll(courseEval)) courseEvalRunning = false;
+    if(rewindControl()) return;
+    updatePhysics(dt);
+    rewindHistory.record(lastCarInput, cameraFlags(), lastConeHits);
+}
+
+/**
+ * Acumula o tempo real decorrido e executa quantos passos fixos couberem nele.
+ * @param frameSec Tempo real desde a chamada anterior (em segundos).
+ */
+void advanceSimulation(double frameSec) {
+    const float step = 1.0f / physicsHz;
+    if(frameSec < 0.0) frameSec = 0.0;
+    if(frameSec > MAX_CATCHUP_SEC) frameSec = MAX_CATCHUP_SEC; // Ex.: janela arrastada ou depurador.
+    simAccumulator += frameSec;
+    PROFILE_SCOPE(PROF_PHYSICS);
+    auto now = std::chrono::steady_clock::now();
+    while(simAccumulator >= step) {
+        simulationStep(step, now);
+        simAccumulator -= step;
+    }
+    renderAlpha = (float)(simAccumulator / step);
+    publishSnapshot(renderAlpha, now);
+}
+
+// Interpola linearmente dois estados do carro (heading não é normalizado, então o lerp é direto).
+Car lerpCar(const Car &a, const Car &b, float t) {
+    Car c = b;
+    c.x = a.x + (b.x - a.x) * t;
+    c.z = a.z + (b.z - a.z) * t;
+    c.heading = a.heading + (b.heading - a.heading) * t;
+    c.speed = a.speed + (b.speed - a.speed) * t;
+    c.wheelAngle = a.wheelAngle + (b.wheelAngle - a.wheelAngle) * t;
+    return c;
+}
+
+// Interpola linearmente duas posições da câmera.
+Camera lerpCamera(const Camera &a, const Camera &b, float t) {
+    Camera c = b;
+    c.x = a.x + (b.x - a.x) * t;
+    c.y = a.y + (b.y - a.y) * t;
+    c.z = a.z + (b.z - a.z) * t;
+    c.tx = a.tx + (b.tx - a.tx) * t;
+    c.ty = a.ty + (b.ty - a.ty) * t;
+    c.tz = a.tz + (b.tz - a.tz) * t;
+    return c;
+}
+
+// ----------------------- Thread de simulação -------------------------
+//
+// Na janela a física roda por padrão numa thread própria, no ritmo de physicsHz pelo relógio
+// real: um frame lento não atrasa a simulação e um plano demorado do piloto automático não
+// congela o desenho. Ela consome a fila de entradas, publica um snapshot por passo e manda os
+// cones derrubados pela fila de ConeView; o display() só lê. Enquanto a thread roda, todo o
+// estado da simulação (car, cam, cones derrubados, piloto, replay, telemetria) é só dela.
+// --single-thread volta ao loop do GLUT (para comparar a latência entrada->tela no HUD).
+
+bool simThreadEnabled = true;          // --single-thread desliga.
+bool simThreadRunning = false;         // Só o thread principal mexe (antes de criar/depois de juntar).
+std::atomic<bool> simThreadStop{false};
+std::thread simThread;
+
+void simThreadMain() {
+    typedef std::chrono::steady_clock Clock;
+    const float dt = 1.0f / physicsHz;
+    const Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dt));
+    const Clock::duration maxLag = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(MAX_CATCHUP_SEC));
+    Clock::time_point next = Clock::now() + step;
+    while(!simThreadStop.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_until(next);
+        if(Clock::now() - next > maxLag) next = Clock::now(); // Atraso grande: descarta, como advanceSimulation.
+        {
+            PROFILE_SIM_SCOPE();
+            simulationStep(dt, next);
+        }
+        publishSnapshot(1.0f, next);
+        next += step;
+    }
+}
+
+void stopSimThread() {
+    if(!simThreadRunning) return;
+    simThreadStop.store(true, std::memory_order_release);
+    simThread.join();
+    simThreadRunning = false;
+    coneEventsQueued = false;
+    drainConeEvents();
+}
+
+// Passa a simulação para a thread própria (depois de initScene; para no atexit).
+void startSimThread() {
+    coneEventsQueued = true;
+    simThreadStop.store(false);
+    simThreadRunning = true;
+    simThread = std::thread(simThreadMain);
+    atexit(stopSimThread);
+}
+
+/**
+ * Snapshot mais recente e a interpolação para o instante atual. Com a thread de simulação o
+ * desenho fica um passo atrás do relógio, entre prevCar (stepTime - passo) e car (stepTime).
+ * Não espera pela simulação: teclas que chegaram logo antes do frame e ainda não foram
+ * aplicadas aparecem no frame seguinte (ver a latência entrada->tela no README).
+ */
+const SimSnapshot &acquireSnapshot(float &alpha) {
+    const SimSnapshot *s = &simSnapshots.read();
+    drainConeEvents();
+    alpha = s->alpha;
+    if(simThreadRunning) {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - s->stepTime).count() * physicsHz;
+        alpha = (float)std::max(0.0, std::min(1.0, t));
+    }
+    return *s;
+}
+
+// ----------------------- Simulação em lote (headless, SoA) -------------------------
+//
+// Avança milhares de carros independentes sem janela, para varreduras de parâmetros do
+// modelo de bicicleta. O estado fica em estrutura-de-arrays (um vetor por campo) e o kernel
+// processa SIMD_W carros por vez, inclusive o seno/cosseno (vsincos, gêmea de fastSinCos), então
+// as trajetórias são idênticas bit a bit às de stepCar().
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+// Expande 4 bytes de entrada em inteiros de 32 bits e testa um bit por faixa (máscara ~0 ou 0).
+inline __m128i vbytes4(const unsigned char *p) {
+    int w;
+    memcpy(&w, p, 4);
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(w), zero), zero);
+}
+inline __m128 vbit4(__m128i v, int bit) {
+    __m128i m = _mm_set1_epi32(bit);
+    return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(v, m), m));
+}
+#endif
+
+#if defined(__AVX__)
+typedef __m256 vfloat;
+const int SIMD_W = 8;
+inline vfloat vload(const float *p) { return _mm256_loadu_ps(p); }
+inline void vstore(float *p, vfloat a) { _mm256_storeu_ps(p, a); }
+inline vfloat vset(float f) { return _mm256_set1_ps(f); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+inline vfloat vgt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+inline vfloat vlt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline vfloat vxor(vfloat a, vfloat b) { return _mm256_xor_ps(a, b); }
+inline vfloat vandnot(vfloat m, vfloat a) { return _mm256_andnot_ps(m, a); }
+inline vfloat vsel(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, m); }
+inline vfloat vbits(const unsigned char *p, int bit) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(vbit4(vbytes4(p), bit)), vbit4(vbytes4(p + 4), bit), 1);
+}
+#define HAVE_SIMD_BATCH 1
+#elif defined(__SSE2__) || defined(_M_X64)
+typedef __m128 vfloat;
+const int SIMD_W = 4;
+inline vfloat vload(const float *p) { return _mm_loadu_ps(p); }
+inline void vstore(float *p, vfloat a) { _mm_storeu_ps(p, a); }
+inline vfloat vset(float f) { return _mm_set1_ps(f); }
+inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat vgt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+inline vfloat vlt(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+inline vfloat vxor(vfloat a, vfloat b) { return _mm_xor_ps(a, b); }
+inline vfloat vandnot(vfloat m, vfloat a) { return _mm_andnot_ps(m, a); }
+inline vfloat vsel(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+inline vfloat vbits(const unsigned char *p, int bit) { return vbit4(vbytes4(p), bit); }
+#define HAVE_SIMD_BATCH 1
+#else
+const int SIMD_W = 1;
+#define HAVE_SIMD_BATCH 0
+#endif
+
+#if HAVE_SIMD_BATCH
+/**
+ * fastSinCos em SIMD_W faixas. O quadrante sai em float (t - 4*floor(t/4)) porque AVX sem AVX2
+ * não tem operações inteiras de 256 bits; os valores calculados são os mesmos da versão escalar.
+ */
+inline void vsincos(vfloat x, vfloat &s, vfloat &c) {
+    const vfloat round = vset(SC_ROUND), one = vset(1.0f), signBit = vset(-0.0f);
+    vfloat t = vsub(vadd(vmul(x, vset(SC_2_PI)), round), round);
+    vfloat r = vsub(vsub(vsub(x, vmul(t, vset(SC_PIO2_1))), vmul(t, vset(SC_PIO2_2))), vmul(t, vset(SC_PIO2_3)));
+    vfloat z = vmul(r, r);
+    vfloat ps = vadd(r, vmul(vmul(r, z), vadd(vset(SC_S1), vmul(z, vadd(vset(SC_S2), vmul(z, vset(SC_S3)))))));
+    vfloat pc = vadd(vsub(one, vmul(vset(0.5f), z)),
+                     vmul(vmul(z, z), vadd(vset(SC_C1), vmul(z, vadd(vset(SC_C2), vmul(z, vset(SC_C3)))))));
+    vfloat t4 = vmul(t, vset(0.25f));
+    vfloat f = vsub(vadd(t4, round), round);
+    f = vsel(vgt(f, t4), vsub(f, one), f);
+    vfloat q = vsub(t, vmul(f, vset(4.0f)));                                   // 0..3
+    vfloat odd = vlt(vandnot(signBit, vsub(vandnot(signBit, vsub(q, vset(2.0f))), one)), vset(0.5f));
+    vfloat sv = vsel(odd, pc, ps), cv = vsel(odd, ps, pc);
+    s = vsel(vgt(q, vset(1.5f)), vxor(sv, signBit), sv);                       // quadrantes 2 e 3
+    c = vsel(vlt(vandnot(signBit, vsub(q, vset(1.5f))), one), vxor(cv, signBit), cv); // 1 e 2
+}
+#endif
+
+// Estado de N carros em estrutura-de-arrays; os parâmetros varridos também são por carro.
+// A caixa de limites é copiada do chão do percurso em resize(), como a que stepCar usa.
+struct CarBatch {
+    int count = 0;
+    float minX = 0, maxX = 0, minZ = 0, maxZ = 0;
+    std::vector<float> x, z, heading, speed, wheelAngle;
+    std::vector<float> wheelBase, maxWheelDeg, friction;
+    std::vector<unsigned char> input;
+
+    void resize(int n) {
+        count = n;
+        for(std::vector<float> *v : {&x, &z, &heading, &speed, &wheelAngle, &wheelBase, &maxWheelDeg, &friction})
+            v->assign(n, 0.0f);
+        input.assign(n, 0);
+        minX = course.groundMinX; maxX = course.groundMaxX;
+        minZ = course.groundMinZ; maxZ = course.groundMaxZ;
+    }
+    void setCar(int i, const Car &c, const CarParams &p) {
+        x[i] = c.x; z[i] = c.z; heading[i] = c.heading; speed[i] = c.speed; wheelAngle[i] = c.wheelAngle;
+        wheelBase[i] = p.wheelBase; maxWheelDeg[i] = p.maxWheelDeg; friction[i] = p.friction;
+    }
+    Car getCar(int i) const {
+        Car c;
+        c.x = x[i]; c.z = z[i]; c.heading = heading[i]; c.speed = speed[i]; c.wheelAngle = wheelAngle[i];
+        return c;
+    }
+    CarParams getParams(int i) const {
+        CarParams p;
+        p.wheelBase = wheelBase[i]; p.maxWheelDeg = maxWheelDeg[i]; p.friction = friction[i];
+        return p;
+    }
+    CarInput getInput(int i) const {
+        unsigned char b = input[i];
+        return CarInput{(b & IN_UP) != 0, (b & IN_DOWN) != 0, (b & IN_LEFT) != 0, (b & IN_RIGHT) != 0};
+    }
+};
+
+/**
+ * Avança os carros [begin, end) do lote em um passo dt, usando as entradas em b.input.
+ * As operações seguem a mesma ordem de stepCar() (sem FMA), por isso o resultado é idêntico.
+ */
+void stepCarBatch(CarBatch &b, int begin, int end, float dt) {
+    int i = begin;
+#if HAVE_SIMD_BATCH
+    const vfloat signBit = vset(-0.0f);
+    const vfloat zero = vset(0.0f);
+    const vfloat wheelStep = vset(WHEEL_SPEED_DEG * dt);
+    const vfloat centerStep = vset(60.0f*dt);
+    const vfloat accelStep = vset(CAR_ACCEL * dt);
+    const vfloat vdt = vset(dt);
+
+    for(; i + SIMD_W <= end; i += SIMD_W) {
+        // Máscaras de entrada por faixa direto dos bytes de b.input.
+        vfloat up = vbits(&b.input[i], IN_UP), down = vbits(&b.input[i], IN_DOWN);
+        vfloat left = vbits(&b.input[i], IN_LEFT), right = vbits(&b.input[i], IN_RIGHT);
+
+        // 1. Esterço com auto-centralização e limite por carro.
+        vfloat w = vload(&b.wheelAngle[i]);
+        vfloat center = vsel(vgt(w, vset(1.0f)), vsub(w, centerStep),
+                        vsel(vlt(w, vset(-1.0f)), vadd(w, centerStep), zero));
+        w = vsel(left, vadd(w, wheelStep), vsel(right, vsub(w, wheelStep), center));
+        vfloat maxW = vload(&b.maxWheelDeg[i]);
+        w = vmin(w, maxW);
+        w = vmax(w, vxor(maxW, signBit));
+        vstore(&b.wheelAngle[i], w);
+
+        // 2. Velocidade: aceleração, ré ou fricção até parar.
+        vfloat s = vload(&b.speed[i]);
+        vfloat fr = vmul(vload(&b.friction[i]), vdt);
+        vfloat sPos = vsub(s, fr);
+        sPos = vsel(vlt(sPos, zero), zero, sPos);
+        vfloat sNeg = vadd(s, fr);
+        sNeg = vsel(vgt(sNeg, zero), zero, sNeg);
+        vfloat coast = vsel(vgt(s, zero), sPos, vsel(vlt(s, zero), sNeg, s));
+        s = vsel(up, vadd(s, accelStep), vsel(down, vsub(s, accelStep), coast));
+        s = vmin(s, vset(MAX_SPEED));
+        s = vmax(s, vset(MAX_REVERSE));
+        vstore(&b.speed[i], s);
+
+        // 3. Direção pelo modelo de bicicleta (tan = sen/cos, como em stepCar).
+        vfloat steer = vmul(w, vset(PI/180.0f));
+        vfloat turning = vgt(vandnot(signBit, steer), vset(1e-4f));
+        vfloat ss, sc;
+        vsincos(steer, ss, sc);
+        vfloat R = vdiv(vload(&b.wheelBase[i]), vdiv(ss, sc));
+        vfloat angVel = vmul(vdiv(s, R), vset(180.0f/PI));
+        vfloat h = vload(&b.heading[i]);
+        h = vsel(turning, vadd(h, vmul(angVel, vdt)), h);
+        vstore(&b.heading[i], h);
+
+        // Posição e limites de borda.
+        vfloat hs, hc;
+        vsincos(vmul(h, vset(PI/180.0f)), hs, hc);
+        vfloat x = vadd(vload(&b.x[i]), vmul(vmul(hs, s), vdt));
+        vfloat z = vadd(vload(&b.z[i]), vmul(vmul(hc, s), vdt));
+        x = vmax(vmin(x, vset(b.maxX)), vset(b.minX));
+        z = vmax(vmin(z, vset(b.maxZ)), vset(b.minZ));
+        vstore(&b.x[i], x);
+        vstore(&b.z[i], z);
+    }
+#endif
+    // Restante (ou todos, sem SIMD) pelo caminho escalar de referência.
+    for(; i < end; i++) {
+        Car c = b.getCar(i);
+        stepCar(c, b.getInput(i), b.getParams(i), dt);
+        b.setCar(i, c, b.getParams(i));
+    }
+}
+
+/**
+ * Entrada determinística do carro i no passo 'step': troca de manobra a cada 90 passos.
+ */
+unsigned char batchInputFor(unsigned int i, int step) {
+    unsigned int h = i * 0x9E3779B1u ^ (unsigned int)(step / 90) * 0x85EBCA77u;
+    h ^= h >> 15; h *= 0x2C1B3C6Du; h ^= h >> 12;
+    return (unsigned char)(h & 0x0F);
+}
+
+/**
+ * Inicializa o lote com a pose 'start' (padrão: inicial do carro) e uma grade de varredura
+ * sobre WHEEL_BASE, MAX_WHEEL_DEG e FRICTION (8 valores de cada).
+ */
+void setupBatchSweep(CarBatch &b, int n, const Car &start = Car()) {
+    b.resize(n);
+    for(int i=0;i<n;i++){
+        CarParams p;
+        p.wheelBase = WHEEL_BASE * (0.75f + 0.5f * (i % 8) / 7.0f);
+        p.maxWheelDeg = MAX_WHEEL_DEG * (0.5f + ((i / 8) % 8) / 7.0f);
+        p.friction = FRICTION * (0.5f + ((i / 64) % 8) / 7.0f);
+        b.setCar(i, start, p);
+    }
+}
+
+// Tamanho do bloco de carros processado por vez (8 vetores x 1024 floats cabem no cache L2).
+const int BATCH_BLOCK = 1024;
+
+/**
+ * Roda 'steps' passos para todos os carros do lote. Cada bloco de BATCH_BLOCK carros é
+ * simulado por inteiro (todos os passos) antes do próximo, e as threads dividem os blocos
+ * entre si por um contador atômico; carros são independentes, então não há sincronização.
+ */
+void runCarBatch(CarBatch &b, int steps, float dt, int numThreads) {
+    int numBlocks = (b.count + BATCH_BLOCK - 1) / BATCH_BLOCK;
+    std::atomic<int> nextBlock(0);
+    auto worker = [&]() {
+        for(int blk = nextBlock++; blk < numBlocks; blk = nextBlock++) {
+            int begin = blk * BATCH_BLOCK;
+            int end = std::min(begin + BATCH_BLOCK, b.count);
+            for(int s=0;s<steps;s++){
+                for(int i=begin;i<end;i++) b.input[i] = batchInputFor(i, s);
+                stepCarBatch(b, begin, end, dt);
+            }
+        }
+    };
+    if(numThreads <= 1) { worker(); return; }
+    std::vector<std::thread> pool;
+    for(int t=0;t<numThreads;t++) pool.emplace_back(worker);
+    for(auto &th : pool) th.join();
+}
+
+/**
+ * Modo batch: projeto --batch [carros] [passos] [threads] [--fork-at passo]
+ * Simula o lote, repete a mesma simulação carro a carro com stepCar() para conferir as
+ * trajetórias e imprime carros-passo por segundo dos dois caminhos. Com --fork-at, a
+ * simulação completa (cones, câmera) roda o roteiro do carro 0 até o passo dado e todos os
+ * carros do lote partem do estado salvo ali (saveSimState). A bifurcação é conferida: a
+ * simulação segue direto por mais 'passos', volta ao estado salvo (restoreSimState), refaz o
+ * mesmo trecho e os dois estados finais têm de ser idênticos.
+ */
+int runBatchMode(int argc, char **argv) {
+    auto arg = [&](int k, int def) { return argc > k && argv[k][0] != '-' ? atoi(argv[k]) : def; };
+    int n = arg(2, 100000);
+    int steps = arg(3, 600);
+    int threads = arg(4, (int)std::thread::hardware_concurrency());
+    int forkAt = 0;
+    for(int i=2;i+1<argc;i++) if(strcmp(argv[i], "--fork-at") == 0) forkAt = std::max(0, atoi(argv[i+1]));
+    if(n < 1) n = 1;
+    if(steps < 1) steps = 1;
+    if(threads < 1) threads = 1;
+    const float dt = 0.016f; // Passo de ~60 Hz, o antigo passo padrão do timer do GLUT.
+
+    SimState fork;
+    bool forkOk = true;
+    if(forkAt > 0) {
+        setupConesStraightCorridor();
+        auto now = std::chrono::steady_clock::now();
+        auto drive = [&](int from, int to) {
+            for(int s=from;s<to;s++){
+                CarInput in = inputFromFlags(batchInputFor(0, s));
+                keyUp = in.up; keyDown = in.down; keyLeft = in.left; keyRight = in.right;
+                simulationStep(dt, now);
+            }
+        };
+        drive(0, forkAt);
+        saveSimState(fork);
+        printf("Bifurcado no passo %d: carro em (%.2f, %.2f) %.1f graus, %d cones derrubados\n", forkAt,
+               fork.car.x, fork.car.z, fork.car.heading, fork.coneStats.knocked);
+        SimState straight, resumed;
+        drive(forkAt, forkAt + steps);
+        saveSimState(straight);
+        restoreSimState(fork);
+        drive(forkAt, forkAt + steps);
+        saveSimState(resumed);
+        forkOk = sameSimState(straight, resumed);
+        printf("  retomada do estado salvo (%d passos, %d cones derrubados): %s\n", steps, resumed.coneStats.knocked,
+               forkOk ? "identica a corrida direta" : "DIVERGIU");
+    }
+
+    CarBatch b;
+    setupBatchSweep(b, n, fork.car);
+    auto t0 = std::chrono::steady_clock::now();
+    runCarBatch(b, steps, dt, threads);
+    auto t1 = std::chrono::steady_clock::now();
+    double batchSec = std::chrono::duration<double>(t1 - t0).count();
+
+    // Referência: mesmo cenário, um carro por vez pelo caminho escalar.
+    CarBatch ref;
+    setupBatchSweep(ref, n, fork.car);
+    int mismatches = 0;
+    auto t2 = std::chrono::steady_clock::now();
+    for(int i=0;i<n;i++){
+        Car c = ref.getCar(i);
+        CarParams p = ref.getParams(i);
+        for(int s=0;s<steps;s++){
+            unsigned char in = batchInputFor(i, s);
+            stepCar(c, CarInput{(in & IN_UP) != 0, (in & IN_DOWN) != 0, (in & IN_LEFT) != 0, (in & IN_RIGHT) != 0}, p, dt);
+        }
+        Car o = b.getCar(i);
+        if(memcmp(&c.x, &o.x, sizeof(float)) || memcmp(&c.z, &o.z, sizeof(float)) ||
+           memcmp(&c.heading, &o.heading, sizeof(float)) || memcmp(&c.speed, &o.speed, sizeof(float)) ||
+           memcmp(&c.wheelAngle, &o.wheelAngle, sizeof(float))) mismatches++;
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    double refSec = std::chrono::duration<double>(t3 - t2).count();
+
+    double total = (double)n * steps;
+    printf("Batch: %d carros x %d passos, %d threads, SIMD de %d faixas\n", n, steps, threads, SIMD_W);
+    printf("  lote (SoA):     %.3f s  %.2f M carros-passo/s\n", batchSec, total / batchSec / 1e6);
+    printf("  referencia:     %.3f s  %.2f M carros-passo/s\n", refSec, total / refSec / 1e6);
+    printf("  divergencias:   %d de %d carros\n", mismatches, n);
+    return mismatches == 0 && forkOk ? 0 : 1;
+}
+
+// ----------------------- Benchmarks (sem janela) --------------------------------
+
+/**
+ * Microbenchmark: texels/s da versão original (rand) contra a nova, de 256 a 8192.
+ */
+int runAsphaltBenchmark() {
+    printf("%6s %16s %16s %8s\n", "size", "rand (Mtex/s)", "hash (Mtex/s)", "ganho");
+    for(int size=256; size<=8192; size*=2){
+        std::vector<unsigned char> buf((size_t)size * size * 3);
+        double texels = (double)size * size;
+
+        auto t0 = std::chrono::steady_clock::now();
+        generateAsphaltProcRand(buf.data(), size);
+        auto t1 = std::chrono::steady_clock::now();
+        // A versão nova roda algumas vezes e fica com o melhor tempo (tamanhos pequenos são rápidos demais).
+        double best = 1e30;
+        for(int r=0;r<3;r++){
+            auto a = std::chrono::steady_clock::now();
+            generateAsphaltProc(buf.data(), size, asphaltSeed);
+            auto b = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(b - a).count());
+        }
+        double oldRate = texels / std::chrono::duration<double>(t1 - t0).count() / 1e6;
+        double newRate = texels / best / 1e6;
+        printf("%6d %16.1f %16.1f %7.1fx\n", size, oldRate, newRate, newRate / oldRate);
+    }
+    return 0;
+}
+
+/**
+ * Benchmark: custo por passo da colisão com grade contra força bruta, variando o número de
+ * cones (densidade constante de 1 cone a cada 4 m²; o carro anda em círculo no meio deles).
+ */
+int runConeBenchmark() {
+    printf("%9s %14s %14s %14s %8s\n", "cones", "montagem (ms)", "grade (us)", "bruta (us)", "iguais");
+    for(int n=1000; n<=1000000; n*=10){
+        std::vector<std::pair<float,float>> cs(n);
+        float half = sqrtf(n * 4.0f) * 0.5f;
+        for(int i=0;i<n;i++){
+            unsigned int h = asphaltHash(7, (unsigned)i, 0), g = asphaltHash(11, (unsigned)i, 0);
+            cs[i] = std::make_pair((h / 4294967296.0f * 2.0f - 1.0f) * half, (g / 4294967296.0f * 2.0f - 1.0f) * half);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        ConeGrid grid;
+        for(int i=0;i<n;i++) grid.insert(i, cs[i].first, cs[i].second);
+        auto t1 = std::chrono::steady_clock::now();
+
+        // Trajetória fixa: acelera virando à esquerda.
+        const int steps = 2000, bruteSteps = std::max(20, 20000000 / n);
+        std::vector<Car> path(steps);
+        Car c; c.x = 0; c.z = 0;
+        for(int s=0;s<steps;s++){ stepCar(c, CarInput{true, false, true, false}, DEFAULT_CAR_PARAMS, 1.0f/240); path[s] = c; }
+
+        std::vector<ConeHit> hits, ref;
+        long long total = 0;
+        auto t2 = std::chrono::steady_clock::now();
+        for(int s=0;s<steps;s++){ queryConeHits(grid, cs.data(), path[s], hits); total += hits.size(); }
+        auto t3 = std::chrono::steady_clock::now();
+        bool same = true;
+        for(int s=0;s<bruteSteps && s<steps;s++){
+            queryConeHitsBrute(cs.data(), cs.size(), path[s], ref);
+            queryConeHits(grid, cs.data(), path[s], hits);
+            if(ref.size() != hits.size()) same = false;
+        }
+        auto t4 = std::chrono::steady_clock::now();
+        double gridUs = std::chrono::duration<double, std::micro>(t3 - t2).count() / steps;
+        double bruteUs = std::chrono::duration<double, std::micro>(t4 - t3).count() / std::min(bruteSteps, steps) - gridUs;
+        printf("%9d %14.2f %14.3f %14.1f %8s\n", n, std::chrono::duration<double, std::milli>(t1 - t0).count(),
+               gridUs, bruteUs, same ? "sim" : "NAO");
+        (void)total;
+    }
+    return 0;
+}
+
+/**
+ * Benchmark do planejador: projeto --bench-planner [poses] [threads]
+ * Sorteia poses iniciais sem colisão (qualquer direção) antes do corredor padrão e, para 1, 2, 4...
+ * threads, mede o tempo de plano (p50/p95/máximo, ganho do p50 sobre uma thread) e simula o
+ * seguidor a 240 Hz para contar quantos carros terminam na vaga sem tocar em cones.
+ */
+int runPlannerBenchmark(int argc, char **argv) {
+    int n = argc > 2 ? std::max(1, atoi(argv[2])) : 200;
+    int maxThreads = argc > 3 ? std::max(1, atoi(argv[3])) : std::max(1, (int)std::thread::hardware_concurrency());
+    setupConesStraightCorridor();
+
+    std::vector<Car> starts;
+    for(unsigned i=0; (int)starts.size() < n; i++){
+        Car c;
+        c.x = (asphaltHash(3, i, 0) / 4294967296.0f * 2.0f - 1.0f) * 5.0f;
+        c.z = 4.0f + asphaltHash(5, i, 0) / 4294967296.0f * 8.0f;
+        c.heading = asphaltHash(9, i, 0) / 4294967296.0f * 360.0f;
+        if(planPoseFree(c.x, c.z, c.heading * (PI/180.0f))) starts.push_back(c);
+    }
+
+    printf("%d poses iniciais (x em [-5,5], z em [4,12], qualquer direcao)\n", n);
+    printf("%7s %8s %9s %9s %9s %10s %11s %11s %6s\n", "threads", "planos", "p50 (ms)", "p95 (ms)", "max (ms)",
+           "nos/plano", "manobras", "estacionou", "ganho");
+    double singleP50 = 0.0;
+    ParkingPlanner planner;
+    std::vector<ConeHit> hits;
+    const float dt = 1.0f / 240;
+    for(int threads=1; ; threads = std::min(threads * 2, maxThreads)){
+        std::vector<double> ms;
+        long long expanded = 0, cusps = 0;
+        int found = 0, parked = 0;
+        for(const Car &s : starts){
+            Autopilot ap;
+            bool ok = startAutopilot(ap, planner, s, threads);
+            ms.push_back(ap.stats.ms);
+            expanded += ap.stats.expanded;
+            if(!ok) continue;
+            found++;
+            cusps += ap.stats.cusps;
+            // Segue o caminho com a física de stepCar; qualquer contato com cone conta como falha.
+            Car c = s;
+            bool touched = false;
+            for(int k=0;k<60*240 && ap.active;k++){
+                stepCar(c, autopilotInput(ap, planner, c), DEFAULT_CAR_PARAMS, dt);
+                queryConeHits(coneGrid, cones.data(), c, hits);
+                if(!hits.empty()) touched = true;
+            }
+            if(!touched && !ap.active && course.inGoal(c.x, c.z)) parked++;
+        }
+        std::sort(ms.begin(), ms.end());
+        double p50 = ms[ms.size() / 2];
+        if(threads == 1) singleP50 = p50;
+        printf("%7d %4d/%-4d %9.2f %9.2f %9.2f %10lld %11.2f %6d/%-4d %5.2fx\n", threads, found, n,
+               p50, ms[ms.size() * 95 / 100], ms.back(), expanded / n,
+               found ? (double)cusps / found : 0.0, parked, found, singleP50 / p50);
+        if(threads == maxThreads) break;
+    }
+    return 0;
+}
+
+/**
+ * Benchmark da rebobinagem: projeto --bench-rewind [segundos]
+ * Dirige o roteiro do modo batch num campo de cones (com colisão) por 'segundos' de física,
+ * guardando SimStates de conferência; depois reconstrói cada um que ainda está na história,
+ * compara bit a bit, mede o custo de cada busca e faz uma volta de verdade ao mais antigo.
+ */
+int runRewindBenchmark(int argc, char **argv) {
+    int seconds = argc > 2 ? std::max(1, atoi(argv[2])) : 360;
+    // Campo de cones a cada 2,5 m: o roteiro derruba bastante (log de cones exercitado).
+    cones.clear();
+    for(float z=-22.0f; z<=14.0f; z+=2.5f)
+        for(float x=-9.0f; x<=9.0f; x+=2.5f) cones.emplace_back(x, z);
+    rebuildConeGrid();
+    RewindBuffer &rw = rewindHistory;
+    rw.init(physicsHz, rewindSeconds);
+    const float dt = 1.0f / physicsHz;
+    const int steps = seconds * physicsHz, every = 1013;
+    std::vector<std::pair<uint64_t, SimState>> checks;
+    auto now = std::chrono::steady_clock::now();
+    auto t0 = std::chrono::steady_clock::now();
+    for(int s=0;s<steps;s++){
+        CarInput in = inputFromFlags(batchInputFor(0, s));
+        keyUp = in.up; keyDown = in.down; keyLeft = in.left; keyRight = in.right;
+        simulationStep(dt, now);
+        if(s % every == every - 1) {
+            checks.emplace_back(rw.head, SimState());
+            saveSimState(checks.back().second);
+        }
+    }
+    double simSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    // Reconstrói cada conferência ainda na história sem mexer na simulação.
+    int tested = 0, mismatches = 0;
+    double sumUs = 0, maxUs = 0, sumFromStartMs = 0;
+    std::vector<unsigned char> knocked;
+    for(auto &c : checks) {
+        if(c.first < rw.oldest()) continue;
+        RewindPoint p;
+        auto a = std::chrono::steady_clock::now();
+        rw.reconstruct(c.first, p);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - a).count();
+        sumUs += us; maxUs = std::max(maxUs, us);
+        sumFromStartMs += simSec * 1000.0 * c.first / steps; // Custo de refazer do início.
+        knocked = coneKnocked;
+        for(uint64_t h=p.hitEnd;h<rw.hitHead;h++) knocked[rw.hits[h % rw.hits.size()].cone] = 0;
+        const SimState &e = c.second;
+        if(memcmp(&p.car, &e.car, sizeof(Car)) || memcmp(&p.cam, &e.cam, sizeof(Camera)) || p.simTime != e.simTime ||
+           p.coneStats.knocked != e.coneStats.knocked || p.coneStats.lastHitTime != e.coneStats.lastHitTime ||
+           knocked != e.coneKnocked) mismatches++;
+        tested++;
+    }
+
+    // Volta de verdade à conferência mais antiga da história e compara o estado restaurado.
+    bool seekOk = false;
+    for(auto &c : checks) {
+        if(c.first < rw.oldest()) continue;
+        rw.seek(c.first, true);
+        SimState got;
+        saveSimState(got);
+        seekOk = !memcmp(&got.car, &c.second.car, sizeof(Car)) && !memcmp(&got.cam, &c.second.cam, sizeof(Camera)) &&
+                 got.simTime == c.second.simTime && got.coneKnocked == c.second.coneKnocked;
+        break;
+    }
+
+    printf("Rebobinagem: %d s de fisica a %d Hz (%.2f s de CPU), %d cones derrubados de %d\n", seconds, physicsHz, simSec,
+           checks.empty() ? 0 : checks.back().second.coneStats.knocked, (int)cones.size());
+    printf("  buffer: %.0f KB fixos (%d s de deltas de %d bytes, keyframe a cada %d passos, %zu cones no log)\n",
+           rw.bytes() / 1024.0, rewindSeconds, (int)sizeof(RewindDelta), REWIND_KEYFRAME_STEPS, rw.hits.size());
+    printf("  busca: %d pontos conferidos, %d divergencias; %.1f us em media, max %.1f us (refazer do inicio: %.1f ms)\n",
+           tested, mismatches, tested ? sumUs / tested : 0.0, maxUs, tested ? sumFromStartMs / tested : 0.0);
+    printf("  volta ao ponto mais antigo: %s\n", seekOk ? "estado identico" : "DIVERGIU");
+    return mismatches == 0 && seekOk ? 0 : 1;
+}
+
+/**
+ * Avaliação do percurso: projeto --eval-course [tentativas] [threads]
+ * Roda a avaliação Monte Carlo do percurso atual (corredor padrão ou --course) com 1, 2, 4...
+ * threads, mede tentativas/s e confere que o resultado não muda com o número de threads.
+ */
+int runCourseEvalBenchmark(int argc, char **argv) {
+    int rollouts = argc > 2 && argv[2][0] != '-' ? std::max(1, atoi(argv[2])) : evalRollouts;
+    int maxThreads = argc > 3 && argv[3][0] != '-' ? std::max(1, atoi(argv[3])) : evalThreadCount();
+    if(cones.external) rebuildConeGrid();
+    else setupConesStraightCorridor();
+    printf("Avaliacao Monte Carlo: %d tentativas de ate %.0f s, %zu cones\n", rollouts, EVAL_MAX_SEC, cones.size());
+    printf("%7s %10s %14s %14s %8s %8s\n", "threads", "tempo (ms)", "tentativas/s", "passos/s", "roubos", "iguais");
+    CourseEval ref, ev;
+    for(int threads=1; ; threads = std::min(threads * 2, maxThreads)){
+        evaluateCourse(ev, rollouts, threads);
+        const CourseEvalStats &s = ev.stats;
+        if(threads == 1) ref = ev;
+        const CourseEvalStats &r = ref.stats;
+        bool same = s.parked == r.parked && s.parkedClean == r.parkedClean && s.meanHits == r.meanHits &&
+                    s.meanMissDist == r.meanMissDist && s.bestIndex == r.bestIndex && s.steps == r.steps &&
+                    ev.best->size() == ref.best->size();
+        printf("%7d %10.1f %14.0f %14.3g %8lld %8s\n", threads, s.ms, rollouts / (s.ms / 1000.0),
+               s.steps / (s.ms / 1000.0), s.steals, same ? "sim" : "NAO");
+        if(threads == maxThreads) break;
+    }
+    const CourseEvalStats &s = ev.stats;
+    printf("  estacionou: %.1f%% (%.1f%% sem tocar em cones); tempo p50 %.2f s, p95 %.2f s\n",
+           100.0 * s.parked / s.rollouts, 100.0 * s.parkedClean / s.rollouts, s.parkP50, s.parkP95);
+    printf("  cones tocados por tentativa: %.2f; falhas terminam a %.2f m da vaga\n", s.meanHits, s.meanMissDist);
+    printf("  melhor tentativa #%d: nota %.1f, %.2f s, %d cones, %zu pontos de trajetoria\n", s.bestIndex, s.bestScore,
+           s.bestTime, s.bestHits, ev.best->size());
+    return 0;
+}
+
+// ----------------------- HUD (Head-Up Display) ------------------------------------
+//
+// Na inicialização cada caractere da fonte GLUT Helvetica 12 é desenhado uma vez num
+// framebuffer e lido de volta para um atlas de glifos na CPU. Cada linha do HUD é composta
+// a partir do atlas só quando o texto muda e enviada à faixa da linha numa textura; o frame
+// desenha o HUD inteiro com um quad por linha, numa chamada. São duas cópias da textura,
+// alternadas por frame, para não sobrescrever uma faixa que o frame anterior ainda lê. As linhas dinâmicas guardam os valores
+// arredondados que exibem e só são reformatadas quando eles mudam.
+// --legacy-hud volta ao glutBitmapCharacter por caractere (para comparação).
+
+void *const HUD_FONT = GLUT_BITMAP_HELVETICA_12;
+const int HUD_FIRST_CHAR = 32, HUD_LAST_CHAR = 126, HUD_ATLAS_COLS = 16;
+const int HUD_MAX_LINES = 15;    // Faixas da textura do HUD (uma por linha).
+const int HUD_TEX_W = 2048;      // Largura máxima de uma linha em pixels (o que passar vira "...").
+const int HUD_TEX_COPIES = 2;
+
+// Atlas de glifos (alfa, linhas de baixo para cima): célula fixa, avanço próprio de cada glifo.
+struct GlyphAtlas {
+    std::vector<unsigned char> alpha;
+    int texW = 0, texH = 0;
+    int cellW = 0, cellH = 0;
+    int descent = 0;                                 // Pixels da célula abaixo da linha de base.
+    int advance[HUD_LAST_CHAR + 1] = {};
+} hudAtlas;
+
+// Cor de uma linha do HUD (multiplica o alfa composto do atlas).
+struct HudColor { float r, g, b; };
+const HudColor HUD_WHITE = {1.0f, 1.0f, 1.0f};
+const HudColor HUD_ALERT = {1.0f, 0.3f, 0.2f};    // Aviso de batida.
+const HudColor HUD_PROFILE = {1.0f, 1.0f, 0.6f};  // Linhas do profiler.
+
+// Uma linha do HUD: texto, cor, chave dos valores exibidos e faixa da textura onde foi composta.
+struct HudLine {
+    bool valid = false;
+    long long key[8] = {};
+    int y = 0;             // Linha de base na tela (depende da altura da janela).
+    int slot = -1;         // Faixa na textura do HUD.
+    int width = 0;         // Largura composta em pixels.
+    unsigned version = 0;  // Incrementada a cada recomposição.
+    bool clipped = false;  // Já avisou que o texto não cabe em HUD_TEX_W.
+    HudColor color = HUD_WHITE;
+    std::string text;
+    std::vector<unsigned char> band; // Alfa composto (HUD_TEX_W x cellH).
+};
+
+bool legacyHud = false;  // --legacy-hud: glutBitmapCharacter por caractere, sem cache.
+GLuint hudTex[HUD_TEX_COPIES] = {}; // Texturas com uma faixa de cellH pixels por linha.
+unsigned hudTexVersion[HUD_TEX_COPIES][HUD_MAX_LINES] = {}; // Versão de cada faixa já enviada.
+int hudTexH = 0, hudSlotsUsed = 0, hudTexCurrent = 0;
+HudLine hudInstructions, hudCar, hudCones, hudRender, hudCull, hudPlan, hudTelemetry, hudFrame, hudLatency, hudGround, hudRewind,
+        hudEval, hudProfCpu, hudProfGpu;
+// Linhas na ordem de desenho.
+const HudLine *const HUD_LINES[] = {&hudInstructions, &hudCar, &hudCones, &hudRender, &hudCull, &hudPlan, &hudTelemetry,
+                                    &hudFrame, &hudLatency, &hudGround, &hudRewind, &hudEval,
+#if PROFILER
+                                    &hudProfCpu, &hudProfGpu,
+#endif
+};
+
+// Tempo médio de frame (ms), exibido para comparar --legacy-hud com o atlas.
+struct FrameTiming {
+    std::chrono::steady_clock::time_point last;
+    double msSum = 0.0;
+    int samples = 0;
+    double ms = 0.0;   // Média dos últimos 120 frames.
+} frameTiming;
+
+int nextPow2(int v) { int p = 1; while(p < v) p <<= 1; return p; }
+
+/**
+ * Gera o atlas desenhando cada glifo com glutBitmapCharacter e lendo os pixels de volta.
+ * Usa um framebuffer offscreen quando disponível; senão, o back buffer antes do primeiro frame.
+ */
+void initHudAtlas() {
+    GlyphAtlas &a = hudAtlas;
+    int maxW = 0;
+    for(int c=HUD_FIRST_CHAR;c<=HUD_LAST_CHAR;c++){
+        a.advance[c] = glutBitmapWidth(HUD_FONT, c);
+        maxW = std::max(maxW, a.advance[c]);
+    }
+    int fontH = glutBitmapHeight(HUD_FONT);
+    a.cellW = maxW + 2;
+    a.cellH = fontH + 2;
+    a.descent = fontH / 4 + 1;
+    int rows = (HUD_LAST_CHAR - HUD_FIRST_CHAR + HUD_ATLAS_COLS) / HUD_ATLAS_COLS;
+    a.texW = HUD_ATLAS_COLS * a.cellW;
+    a.texH = rows * a.cellH;
+
+    GLuint fbo = 0, rb = 0;
+    if(glHasFBO) {
+        glf.GenFramebuffers(1, &fbo);
+        glf.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glf.GenRenderbuffers(1, &rb);
+        glf.BindRenderbuffer(GL_RENDERBUFFER, rb);
+        glf.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, a.texW, a.texH);
+        glf.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+    } else {
+        glDrawBuffer(GL_BACK);
+        glReadBuffer(GL_BACK);
+    }
+    glPushAttrib(GL_ALL_ATTRIB_BITS);
+    glViewport(0, 0, a.texW, a.texH);
+    glDisable(GL_LIGHTING); glDisable(GL_DEPTH_TEST); glDisable(GL_TEXTURE_2D);
+    glMatrixMode(GL_PROJECTION); glPushMatrix(); glLoadIdentity(); glOrtho(0, a.texW, 0, a.texH, -1, 1);
+    glMatrixMode(GL_MODELVIEW); glPushMatrix(); glLoadIdentity();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glColor3f(1, 1, 1);
+    for(int c=HUD_FIRST_CHAR;c<=HUD_LAST_CHAR;c++){
+        int i = c - HUD_FIRST_CHAR;
+        glRasterPos2i((i % HUD_ATLAS_COLS) * a.cellW + 1, (i / HUD_ATLAS_COLS) * a.cellH + a.descent);
+        glutBitmapCharacter(HUD_FONT, c);
+    }
+    a.alpha.assign((size_t)a.texW * a.texH, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, a.texW, a.texH, GL_RED, GL_UNSIGNED_BYTE, a.alpha.data());
+    glMatrixMode(GL_PROJECTION); glPopMatrix();
+    glMatrixMode(GL_MODELVIEW); glPopMatrix();
+    glPopAttrib();
+    if(fbo) {
+        glf.BindFramebuffer(GL_FRAMEBUFFER, 0);
+        glf.DeleteFramebuffers(1, &fbo);
+        glf.DeleteRenderbuffers(1, &rb);
+    }
+
+    // Textura das linhas: começa vazia, cada faixa é preenchida quando sua linha muda.
+    hudTexH = nextPow2(HUD_MAX_LINES * a.cellH);
+    std::vector<unsigned char> zero((size_t)HUD_TEX_W * hudTexH, 0);
+    glGenTextures(HUD_TEX_COPIES, hudTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(int t=0;t<HUD_TEX_COPIES;t++){
+        glState.bindTexture(hudTex[t]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, HUD_TEX_W, hudTexH, 0, GL_ALPHA, GL_UNSIGNED_BYTE, zero.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glState.bindTexture(0);
+}
+
+// Verdadeiro se os valores exibidos mudaram (ou se a linha ainda não foi montada).
+bool hudChanged(HudLine &l, int y, std::initializer_list<long long> key) {
+    bool changed = !l.valid || l.y != y || legacyHud;
+    int k = 0;
+    for(long long v : key) { if(l.key[k] != v) changed = true; l.key[k++] = v; }
+    return changed;
+}
+
+// Define o texto e a cor da linha e compõe seus pixels a partir do atlas. Texto mais largo que
+// HUD_TEX_W termina em "..." (com um aviso no stderr na primeira vez).
+void hudSetText(HudLine &l, int y, const char *text, HudColor color = HUD_WHITE) {
+    l.valid = true;
+    l.y = y;
+    l.color = color;
+    if(l.text == text && l.slot >= 0) return; // Só mudou a posição ou a cor.
+    l.text = text;
+    if(legacyHud) return;
+    if(l.slot < 0) {
+        if(hudSlotsUsed == HUD_MAX_LINES) return;
+        l.slot = hudSlotsUsed++;
+    }
+
+    const GlyphAtlas &a = hudAtlas;
+    auto glyph = [&](const char *p) {
+        int c = (unsigned char)*p;
+        return c < HUD_FIRST_CHAR || c > HUD_LAST_CHAR ? '?' : c;
+    };
+    int full = a.cellW;
+    for(const char *p = text; *p; ++p) full += a.advance[glyph(p)];
+    int limit = full > HUD_TEX_W ? HUD_TEX_W - 3 * a.advance['.'] : HUD_TEX_W;
+    if(full > HUD_TEX_W && !l.clipped) {
+        fprintf(stderr, "HUD: linha de %d px cortada em %d px: %s\n", full, HUD_TEX_W, text);
+        l.clipped = true;
+    }
+
+    std::vector<unsigned char> &band = l.band;
+    band.assign((size_t)HUD_TEX_W * a.cellH, 0);
+    int x = 0;
+    auto put = [&](int c) {
+        int i = c - HUD_FIRST_CHAR;
+        const unsigned char *cell = &a.alpha[(size_t)(i / HUD_ATLAS_COLS) * a.cellH * a.texW + (i % HUD_ATLAS_COLS) * a.cellW];
+        // Células vizinhas se sobrepõem (célula mais larga que o avanço): combina pelo máximo.
+        for(int row=0;row<a.cellH;row++)
+            for(int col=0;col<a.cellW;col++){
+                unsigned char &dst = band[(size_t)row * HUD_TEX_W + x + col];
+                dst = std::max(dst, cell[(size_t)row * a.texW + col]);
+            }
+        x += a.advance[c];
+    };
+    const char *p = text;
+    for(; *p && x + a.advance[glyph(p)] + a.cellW <= limit; ++p) put(glyph(p));
+    if(*p) for(int k=0;k<3;k++) put('.');
+    l.width = std::min(HUD_TEX_W, x + a.cellW);
+    l.version++;
+}
+
+// Acrescenta o quad da linha (x, y, u, v, r, g, b por vértice), enviando a faixa se a cópia atual da
+// textura (já ligada) estiver desatualizada. No modo antigo desenha caractere a caractere.
+void hudDraw(const HudLine &l, std::vector<float> &quads) {
+    if(legacyHud) {
+        glColor3f(l.color.r, l.color.g, l.color.b); // A cor vale a partir do glRasterPos.
+        glRasterPos2i(10, l.y);
+        for(char c : l.text) glutBitmapCharacter(HUD_FONT, c);
+        return;
+    }
+    if(l.slot < 0) return;
+    const GlyphAtlas &a = hudAtlas;
+    unsigned &uploaded = hudTexVersion[hudTexCurrent][l.slot];
+    if(uploaded != l.version) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, l.slot * a.cellH, HUD_TEX_W, a.cellH, GL_ALPHA, GL_UNSIGNED_BYTE, l.band.data());
+        uploaded = l.version;
+    }
+    float x0 = 9.0f, x1 = x0 + l.width, y0 = (float)(l.y - a.descent), y1 = y0 + a.cellH;
+    float u1 = (float)l.width / HUD_TEX_W;
+    float v0 = (float)(l.slot * a.cellH) / hudTexH, v1 = (float)((l.slot + 1) * a.cellH) / hudTexH;
+    float r = l.color.r, g = l.color.g, b = l.color.b;
+    float q[28] = {x0, y0, 0, v0, r, g, b,  x1, y0, u1, v0, r, g, b,  x1, y1, u1, v1, r, g, b,  x0, y1, 0, v1, r, g, b};
+    quads.insert(quads.end(), q, q + 28);
+}
+
+/**
+ * Atualiza o texto das linhas do HUD (posição, velocidade, controles) a partir do snapshot 's',
+ * numa tela de altura 'h'. Só compõe; quem desenha é drawHUD ou o rasterizador por software.
+ */
+void updateHudText(const SimSnapshot &s, int h) {
+    const Car &car = s.car;
+
+    // Texto de instruções.
+    if(hudChanged(hudInstructions, h-20, {}))
+        hudSetText(hudInstructions, h-20, "Setas: dirigir carro   P: baliza automatica   WASD/QE: mover camera   C: camera segue carro   B/V: rebobinar   M: avaliar percurso   R: resetar   ESC: sair");
+
+    // Estado atual do carro: reformata só quando os valores arredondados mudam.
+    char buf[512];
+    if(hudChanged(hudCar, h-36, {llroundf(car.x*100), llroundf(car.z*100), llroundf(car.heading*10),
+                                 llroundf(car.speed*100), llroundf(car.wheelAngle*10)})) {
+        snprintf(buf, sizeof(buf), "Carro: Pos (%.2f, %.2f) Direcao %.1f Velocidade %.2f Esterco %.1f",
+                  car.x, car.z, car.heading, car.speed, car.wheelAngle);
+        hudSetText(hudCar, h-36, buf);
+    }
+
+    // Cones derrubados; o aviso de batida fica na tela por 1 s após cada contato.
+    const ConeStats &coneStats = s.coneStats;
+    bool recentHit = s.simTime - coneStats.lastHitTime < 1.0;
+    bool inGoal = course.inGoal(car.x, car.z);
+    if(hudChanged(hudCones, h-52, {coneStats.knocked, (long long)cones.size(), recentHit,
+                                   recentHit ? llroundf(coneStats.lastPenetration*100) : 0, inGoal})) {
+        int len = snprintf(buf, sizeof(buf), "Cones derrubados: %d de %d%s", coneStats.knocked, (int)cones.size(),
+                           inGoal ? "   NA VAGA" : "");
+        if(recentHit) snprintf(buf + len, sizeof(buf) - len, "   BATEU!   penetracao %.2f m", coneStats.lastPenetration);
+        hudSetText(hudCones, h-52, buf, recentHit ? HUD_ALERT : HUD_WHITE);
+    }
+
+    // Custo de submissão da cena 3D no frame anterior.
+    if(hudChanged(hudRender, h-68, {useImmediateMode, glHasInstancing, renderStats.drawCalls,
+                                    llround(renderStats.submitMs*1000), glState.lastIssued, glState.lastSuppressed})) {
+        snprintf(buf, sizeof(buf), "Render: %s   draw calls %d   submit %.3f ms   estado GL: %d emitidas, %d suprimidas",
+                 useSoftRaster ? "software" : useImmediateMode ? "imediato" : glHasInstancing ? "retido/instanciado" : "retido/lote",
+                 renderStats.drawCalls, renderStats.submitMs, glState.lastIssued, glState.lastSuppressed);
+        hudSetText(hudRender, h-68, buf);
+    }
+
+    // Cones desenhados/descartados pelo frustum e por nível de detalhe (compare com --no-cull).
+    const RenderStats &rs = renderStats;
+    if(hudChanged(hudCull, h-84, {allowCulling, rs.conesDrawn, rs.conesCulled, rs.conesPerLod[0], rs.conesPerLod[1],
+                                  rs.carDrawn, rs.wheelLod})) {
+        snprintf(buf, sizeof(buf), "Culling %s: cones %d desenhados, %d descartados   LOD %d/%d/%d   carro %s (roda LOD %d)",
+                 allowCulling ? "ligado" : "desligado", rs.conesDrawn, rs.conesCulled,
+                 rs.conesPerLod[0], rs.conesPerLod[1], rs.conesPerLod[2],
+                 rs.carDrawn ? "visivel" : "fora", rs.wheelLod);
+        hudSetText(hudCull, h-84, buf);
+    }
+
+    // Piloto automático: estado e custo do último plano.
+    const PlanStats &ps = s.planStats;
+    size_t pathSize = s.path ? s.path->size() : 0;
+    if(hudChanged(hudPlan, h-100, {(long long)(intptr_t)s.autopilotStatus, llround(ps.ms*100), ps.expanded,
+                                   (long long)pathSize})) {
+        if(pathSize == 0) snprintf(buf, sizeof(buf), "Baliza automatica: %s", s.autopilotStatus);
+        else snprintf(buf, sizeof(buf), "Baliza automatica: %s   plano %.2f ms (%d threads, %d nos)   %.1f m, %d manobras",
+                      s.autopilotStatus, ps.ms, ps.threads, ps.expanded, ps.length, ps.cusps);
+        hudSetText(hudPlan, h-100, buf);
+    }
+
+    // Gravação (--record) e replay (--replay) da telemetria.
+    long long written = (long long)telemetry.written.load(std::memory_order_relaxed);
+    if(hudChanged(hudTelemetry, h-116, {telemetry.fp != nullptr, written, (long long)s.telemetryDropped,
+                                        s.replayActive, (long long)s.replayNext, s.replayDivergences})) {
+        int len = snprintf(buf, sizeof(buf), "Telemetria: %s", telemetry.fp ? "" : "desligada (--record arquivo)");
+        if(telemetry.fp) len += snprintf(buf + len, sizeof(buf) - len, "%lld registros gravados, %llu descartados",
+                                         written, s.telemetryDropped);
+        if(replay.count) snprintf(buf + len, sizeof(buf) - len, "   replay %zu/%zu%s, %ld divergencias",
+                                  s.replayNext, replay.count, s.replayActive ? "" : " (fim)", s.replayDivergences);
+        hudSetText(hudTelemetry, h-116, buf);
+    }
+
+    // Tempo médio de frame (compare com --legacy-hud).
+    if(hudChanged(hudFrame, h-132, {llround(frameTiming.ms*100)})) {
+        snprintf(buf, sizeof(buf), "Frame %.2f ms   texto: %s", frameTiming.ms,
+                 legacyHud ? "glutBitmapCharacter" : "atlas");
+        hudSetText(hudFrame, h-132, buf);
+    }
+
+    // Latência entrada->tela (compare com --single-thread).
+    const LatencyProbe &lp = inputLatency;
+    if(hudChanged(hudLatency, h-148, {simThreadRunning, lp.samples, (long long)lp.dropped})) {
+        int len = snprintf(buf, sizeof(buf), "Simulacao: %s   entrada->tela: ",
+                           simThreadRunning ? "thread propria" : "no loop do GLUT");
+        if(lp.samples) snprintf(buf + len, sizeof(buf) - len, "p50 %.1f ms, p95 %.1f ms, max %.1f ms (%lld eventos, %llu perdidos)",
+                                lp.p50, lp.p95, lp.maxMs, lp.samples, lp.dropped);
+        else snprintf(buf + len, sizeof(buf) - len, "aperte uma tecla");
+        hudSetText(hudLatency, h-148, buf);
+    }
+
+    // Chão do mundo aberto: blocos no cache, faltando e custo no thread do desenho.
+    const GroundStreamer &gs = ground;
+    if(hudChanged(hudGround, h-164, {openWorld, gs.resident, (long long)gs.visible.size(), gs.missing, gs.generated,
+                                     gs.evicted, llround(gs.updateMs*10)})) {
+        if(!openWorld) snprintf(buf, sizeof(buf), "Chao: quadrilatero do percurso (--open-world: blocos gerados sob demanda)");
+        else snprintf(buf, sizeof(buf), "Chao: %d blocos (%.1f de %d MB), %d visiveis, %d faltando, %lld gerados, %lld reaproveitados   %.1f ms/frame",
+                      gs.resident, gs.resident * (double)GROUND_TILE_BYTES / (1024 * 1024), groundCacheMB, (int)gs.visible.size(),
+                      gs.missing, gs.generated, gs.evicted, gs.updateMs);
+        hudSetText(hudGround, h-164, buf);
+    }
+
+    // Rebobinagem: história disponível e memória fixa do buffer.
+    if(hudChanged(hudRewind, h-180, {llround(s.rewindSeconds*10), s.rewinding})) {
+        snprintf(buf, sizeof(buf), "Rebobinar: %.1f s de historia (%.0f KB)%s", s.rewindSeconds,
+                 rewindHistory.bytes() / 1024.0, s.rewinding ? "   << REBOBINANDO" : "   B segurada: voltar   V: -5 s");
+        hudSetText(hudRewind, h-180, buf);
+    }
+
+    // Avaliação Monte Carlo do percurso (tecla M).
+    const CourseEvalStats &es = s.evalStats;
+    if(hudChanged(hudEval, h-196, {es.rollouts, es.parked, es.parkedClean, llround(es.ms), s.evalRunning})) {
+        if(s.evalRunning) snprintf(buf, sizeof(buf), "Avaliacao do percurso: simulando %d tentativas...", evalRollouts);
+        else if(es.rollouts == 0) snprintf(buf, sizeof(buf), "Avaliacao do percurso: M para simular %d tentativas", evalRollouts);
+        else snprintf(buf, sizeof(buf), "Avaliacao: %d tentativas em %.0f ms (%d threads)   estacionou %.1f%%, sem cones %.1f%%"
+                      "   p50 %.1f s   melhor %.1f s, %d cones", es.rollouts, es.ms, es.threads,
+                      100.0 * es.parked / es.rollouts, 100.0 * es.parkedClean / es.rollouts, es.parkP50,
+                      es.bestTime, es.bestHits);
+        hudSetText(hudEval, h-196, buf);
+    }
+
+#if PROFILER
+    // Percentis por estágio (profiler compilado com -DPROFILER=1); mudam a cada 0,5 s.
+    if(hudProfCpu.text != prof.summaryCpu || hudChanged(hudProfCpu, h-212, {}))
+        hudSetText(hudProfCpu, h-212, prof.summaryCpu.c_str(), HUD_PROFILE);
+    if(hudProfGpu.text != prof.summaryGpu || hudChanged(hudProfGpu, h-228, {}))
+        hudSetText(hudProfGpu, h-228, prof.summaryGpu.c_str(), HUD_PROFILE);
+#endif
+}
+
+/**
+ * Desenha informações de texto na tela (posição, velocidade, controles) a partir do snapshot 's'.
+ */
+void drawHUD(const SimSnapshot &s) {
+    int w = winW, h = winH;
+    if(legacyHud) { w = glutGet(GLUT_WINDOW_WIDTH); h = glutGet(GLUT_WINDOW_HEIGHT); }
+    updateHudText(s, h);
+
+    // Salva e configura a matriz de projeção para 2D (ortogonal)
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+      glLoadIdentity();
+      glOrtho(0,w,0,h,-1,1); // Projeção 2D de 0 a W e 0 a H.
+      glMatrixMode(GL_MODELVIEW);
+      glPushMatrix();
+        glLoadIdentity();
+        glState.disable(GL_LIGHTING); // Desabilita luz para que o texto não seja afetado.
+
+        if(!legacyHud) {
+            hudTexCurrent = (hudTexCurrent + 1) % HUD_TEX_COPIES;
+            glState.bindTexture(hudTex[hudTexCurrent]);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        }
+        std::vector<float> quads;
+        quads.reserve(HUD_MAX_LINES * 28);
+        for(const HudLine *l : HUD_LINES) hudDraw(*l, quads);
+
+        // Todas as linhas em uma chamada, a partir da textura do HUD.
+        if(!quads.empty()) {
+            glState.enable(GL_TEXTURE_2D);
+            glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+            glState.enable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glState.disable(GL_DEPTH_TEST); // Faixas de linhas vizinhas se sobrepõem em 2 pixels.
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glEnableClientState(GL_COLOR_ARRAY);
+            glVertexPointer(2, GL_FLOAT, 7 * sizeof(float), quads.data());
+            glTexCoordPointer(2, GL_FLOAT, 7 * sizeof(float), quads.data() + 2);
+            glColorPointer(3, GL_FLOAT, 7 * sizeof(float), quads.data() + 4);
+            glDrawArrays(GL_QUADS, 0, (GLsizei)(quads.size() / 7));
+            glDisableClientState(GL_VERTEX_ARRAY);
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+            glDisableClientState(GL_COLOR_ARRAY);
+            glState.disable(GL_BLEND);
+            glState.disable(GL_TEXTURE_2D);
+            glState.enable(GL_DEPTH_TEST);
+        }
+        glColor3f(1,1,1); // A cor corrente fica indefinida depois do array de cores (e no modo antigo).
+        glState.enable(GL_LIGHTING); // Reabilita a iluminação para a renderização 3D.
+      glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// Acumula o intervalo entre frames; a média é atualizada a cada 120 frames.
+void updateFrameTiming() {
+    auto now = std::chrono::steady_clock::now();
+    if(frameTiming.last.time_since_epoch().count() != 0)
+        frameTiming.msSum += std::chrono::duration<double, std::milli>(now - frameTiming.last).count();
+    frameTiming.last = now;
+    if(++frameTiming.samples == 120) {
+        frameTiming.ms = frameTiming.msSum / 120;
+        frameTiming.msSum = 0.0;
+        frameTiming.samples = 0;
+    }
+}
+
+// ----------------------- Rasterizador por software -------------------------
+//
+// Com --soft-raster a cena (chão texturizado, cones, carro e HUD) é desenhada só na CPU, sem
+// passar pelo pipeline fixo do GL: serve às máquinas sem GPU, onde a alternativa é o llvmpipe.
+// Reproduz renderScene: mesma projeção (gluPerspective 60°), a iluminação de setupLighting por
+// vértice (ambiente global + luz 0 difusa e especular, cor como material), textura em
+// GL_MODULATE com os filtros do GL (mipmap mais próximo, trilinear ou bilinear no nível 0),
+// profundidade GL_LESS e limpeza em (0,0,0,0). O frame fica na memória (RGBA, linhas de baixo
+// para cima, como o glReadPixels): o modo headless o entrega ao FrameWriter sem contexto GL e a
+// janela o mostra com glDrawPixels.
+// Cada frame tem duas fases no pool de threads (--soft-threads N; a thread do desenho é a 0):
+//   1. geometria: cada thread transforma e ilumina uma faixa contígua da lista de desenhos,
+//      recorta no plano perto e registra os triângulos nos blocos de 64x64 pixels que tocam;
+//   2. rasterização: as threads pegam blocos livres; cada bloco percorre as listas das threads
+//      em ordem (a ordem de submissão se mantém) e avalia 4 pixels por vez com SSE2 (sem SSE2,
+//      os mesmos passos em C++ escalar, pixel a pixel).
+// Cada aresta é avaliada a partir do seu vértice "menor": triângulos vizinhos calculam valores
+// exatamente opostos na aresta comum e a regra topo-esquerda não deixa furos nem pixels
+// repetidos. Fica de fora o caminho da baliza automática (linhas); --open-world usa o GL.
+
+const int SOFT_TILE = 64;          // Lado do bloco da rasterização (pixels).
+int softThreads = 0;               // --soft-threads N (0 = uma por núcleo).
+
+// Matrizes 4x4 por colunas, como as do GL; as operações multiplicam à direita, como glTranslatef.
+void mat4Identity(float m[16]) {
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = m[5] = m[10] = m[15] = 1.0f;
+}
+
+void mat4Mul(const float a[16], const float b[16], float out[16]) {
+    float r[16];
+    for(int col=0;col<4;col++)
+        for(int row=0;row<4;row++){
+            float s = 0;
+            for(int k=0;k<4;k++) s += a[k*4 + row] * b[col*4 + k];
+            r[col*4 + row] = s;
+        }
+    memcpy(out, r, sizeof(r));
+}
+
+void mat4Translate(float m[16], float x, float y, float z) {
+    for(int r=0;r<4;r++) m[12 + r] += m[r] * x + m[4 + r] * y + m[8 + r] * z;
+}
+
+void mat4Scale(float m[16], float x, float y, float z) {
+    for(int r=0;r<4;r++) { m[r] *= x; m[4 + r] *= y; m[8 + r] *= z; }
+}
+
+// Rotação em torno de +Y em graus (glRotatef(deg, 0, 1, 0)).
+void mat4RotateY(float m[16], float deg) {
+    float a = deg * (float)M_PI / 180.0f, c = cosf(a), s = sinf(a);
+    for(int r=0;r<4;r++){
+        float c0 = m[r], c2 = m[8 + r];
+        m[r] = c * c0 - s * c2;
+        m[8 + r] = s * c0 + c * c2;
+    }
+}
+
+// Mesma matriz de gluPerspective e de gluLookAt.
+void perspectiveMatrix(float m[16], double fovY, double aspect, double zNear, double zFar) {
+    double f = 1.0 / tan(fovY * M_PI / 360.0);
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = (float)(f / aspect);
+    m[5] = (float)f;
+    m[10] = (float)((zFar + zNear) / (zNear - zFar));
+    m[11] = -1.0f;
+    m[14] = (float)(2.0 * zFar * zNear / (zNear - zFar));
+}
+
+void lookAtMatrix(float m[16], const Camera &c) {
+    float f[3] = {c.tx - c.x, c.ty - c.y, c.tz - c.z};
+    float fl = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+    for(float &v : f) v /= fl;
+    float s[3] = {-f[2], 0.0f, f[0]};                       // f x (0, 1, 0)
+    float sl = sqrtf(s[0]*s[0] + s[2]*s[2]);
+    for(float &v : s) v /= sl;
+    float u[3] = {s[1]*f[2] - s[2]*f[1], s[2]*f[0] - s[0]*f[2], s[0]*f[1] - s[1]*f[0]};
+    mat4Identity(m);
+    for(int k=0;k<3;k++){ m[k*4] = s[k]; m[k*4 + 1] = u[k]; m[k*4 + 2] = -f[k]; }
+    mat4Translate(m, -c.x, -c.y, -c.z);
+}
+
+// Um desenho da lista do frame: malha (vértices em float), transformação e cor do material.
+struct SoftDraw {
+    const Mesh *mesh;
+    float model[16];
+    float color[3];
+    bool textured;   // Chão: cor branca modulada pela textura do asfalto.
+    bool cullBack;   // Malhas fechadas: as faces de trás nunca aparecem.
+};
+
+// Vértice transformado: posição de recorte e atributos (r, g, b, u, v).
+struct SoftVertex {
+    float clip[4];
+    float attr[5];
+};
+
+// Triângulo pronto para rasterizar (coordenadas de janela, y para cima).
+struct SoftTri {
+    int minX, minY, maxX, maxY;       // Pixels cobertos possíveis (inclusivo).
+    float ox[3], oy[3], dx[3], dy[3]; // Aresta i (oposta ao vértice i): origem canônica e direção.
+    float sign[3];                    // -1 quando a aresta é avaliada no sentido contrário.
+    bool topLeft[3];
+    float px, py;                     // Origem dos planos (vértice 0).
+    float plane[7][3];                // z, 1/w, r/w, g/w, b/w, u/w, v/w: valor na origem, d/dx, d/dy.
+    bool textured;
+};
+
+enum SoftPhase { SOFT_GEOMETRY, SOFT_RASTER };
+
+struct SoftRaster {
+    int width = 0, height = 0, tilesX = 0, tilesY = 0;
+    std::vector<uint32_t> color;      // RGBA8, linhas de baixo para cima.
+    std::vector<float> depth;
+    float proj[16], view[16];
+    float lightEye[3], halfEye[3];    // Direção da luz 0 e vetor médio (observador no infinito), no olho.
+    std::vector<SoftDraw> draws;
+    Mesh baked[BAKED_MESH_COUNT];     // Malhas de bakedMesh() com vértices em float.
+
+    // Textura do asfalto: cadeia de mipmaps de loadAsphaltChain. Cada texel de 'quads' guarda
+    // os 4 vizinhos da amostra bilinear (já com a repetição), um byte cada: uma leitura por pixel.
+    std::vector<unsigned char> tex;
+    std::vector<uint32_t> quads;
+    std::vector<size_t> levelOffset;
+    std::vector<int> levelSize;
+
+    // Por thread: vértices da malha em curso, triângulos montados e, por bloco, os que o tocam.
+    struct Bin {
+        std::vector<SoftVertex> verts;
+        std::vector<SoftTri> tris;
+        std::vector<std::vector<uint32_t>> tiles;
+    };
+    std::vector<Bin> bins;
+
+    // Pool: as auxiliares esperam uma nova geração e rodam a fase pedida com seu índice.
+    int threads = 1;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable cv, doneCv;
+    SoftPhase phase = SOFT_GEOMETRY;
+    unsigned long long generation = 0;
+    int pending = 0;
+    bool stopping = false;
+    std::atomic<int> nextTile{0};
+
+    // Estatísticas do último frame.
+    long long triangles = 0;
+    double geometryMs = 0.0, rasterMs = 0.0;
+
+    void init(int n) {
+        threads = std::max(1, n);
+        bins.resize(threads);
+        for(int k=0;k<BAKED_MESH_COUNT;k++){
+            const Mesh &src = bakedMesh(k);
+            Mesh &m = baked[k];
+            m = Mesh();
+            for(int v=0;v<src.vertexCount();v++){
+                float s[6];
+                meshVertex(src, v, s);
+                m.addVertex(s[0], s[1], s[2], s[3], s[4], s[5]);
+            }
+            m.indices = src.indices;
+        }
+        loadAsphaltChain(tex);
+        levelOffset.clear(); levelSize.clear();
+        size_t off = 0;
+        for(int s=asphaltTexSize;; s/=2){
+            levelOffset.push_back(off);
+            levelSize.push_back(s);
+            off += (size_t)s * s;
+            if(s <= 1 || !asphaltMipmaps) break;
+        }
+        quads.resize(off);
+        for(size_t l=0;l<levelSize.size();l++){
+            int s = levelSize[l];
+            const unsigned char *p = &tex[levelOffset[l]];
+            for(int j=0;j<s;j++)
+                for(int i=0;i<s;i++){
+                    int i1 = (i + 1) % s, j1 = (j + 1) % s;
+                    quads[levelOffset[l] + (size_t)j * s + i] = p[j * s + i] | p[j * s + i1] << 8 |
+                                                                p[j1 * s + i] << 16 | (uint32_t)p[j1 * s + i1] << 24;
+                }
+        }
+        for(int t=1;t<threads;t++) workers.emplace_back([this, t]() { workerLoop(t); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        for(auto &w : workers) w.join();
+        workers.clear();
+    }
+
+    void resize(int w, int h) {
+        if(w == width && h == height) return;
+        width = w; height = h;
+        tilesX = (w + SOFT_TILE - 1) / SOFT_TILE;
+        tilesY = (h + SOFT_TILE - 1) / SOFT_TILE;
+        color.assign((size_t)w * h, 0);
+        depth.assign((size_t)w * h, 1.0f);
+        for(Bin &b : bins) b.tiles.assign((size_t)tilesX * tilesY, {});
+    }
+
+    // Começa um frame: matrizes da câmera e direção da luz de setupLighting no espaço do olho.
+    void begin(int w, int h, const Camera &c) {
+        resize(w, h);
+        perspectiveMatrix(proj, 60.0, (double)w / h, 0.1, 300.0);
+        lookAtMatrix(view, c);
+        const float pos[3] = {0.2f, 1.0f, 0.3f};
+        float len = 0;
+        for(int r=0;r<3;r++){
+            lightEye[r] = view[r] * pos[0] + view[4 + r] * pos[1] + view[8 + r] * pos[2];
+            len += lightEye[r] * lightEye[r];
+        }
+        len = sqrtf(len);
+        for(float &v : lightEye) v /= len;
+        float hl = sqrtf(lightEye[0]*lightEye[0] + lightEye[1]*lightEye[1] + (lightEye[2] + 1)*(lightEye[2] + 1));
+        for(int r=0;r<3;r++) halfEye[r] = (lightEye[r] + (r == 2 ? 1.0f : 0.0f)) / hl;
+        draws.clear();
+    }
+
+    void add(const Mesh &m, const float model[16], float r, float g, float b, bool textured, bool cullBack) {
+        SoftDraw d;
+        d.mesh = &m;
+        memcpy(d.model, model, sizeof(d.model));
+        d.color[0] = r; d.color[1] = g; d.color[2] = b;
+        d.textured = textured;
+        d.cullBack = cullBack;
+        draws.push_back(d);
+    }
+
+    // Roda as duas fases e espera todas as threads.
+    void render() {
+        auto t0 = std::chrono::steady_clock::now();
+        runPhase(SOFT_GEOMETRY);
+        auto t1 = std::chrono::steady_clock::now();
+        nextTile.store(0, std::memory_order_relaxed);
+        runPhase(SOFT_RASTER);
+        auto t2 = std::chrono::steady_clock::now();
+        triangles = 0;
+        for(const Bin &b : bins) triangles += (long long)b.tris.size();
+        geometryMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        rasterMs = std::chrono::duration<double, std::milli>(t2 - t1).count();
+    }
+
+    void runPhase(SoftPhase p) {
+        if(threads > 1) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                phase = p;
+                pending = threads - 1;
+                generation++;
+            }
+            cv.notify_all();
+        }
+        doPhase(p, 0);
+        if(threads > 1) {
+            std::unique_lock<std::mutex> lock(mtx);
+            doneCv.wait(lock, [this]() { return pending == 0; });
+        }
+    }
+
+    void workerLoop(int index) {
+        unsigned long long seen = 0;
+        for(;;) {
+            SoftPhase p;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&]() { return stopping || generation != seen; });
+                if(stopping) return;
+                seen = generation;
+                p = phase;
+            }
+            doPhase(p, index);
+            std::lock_guard<std::mutex> lock(mtx);
+            if(--pending == 0) doneCv.notify_one();
+        }
+    }
+
+    void doPhase(SoftPhase p, int t) {
+        if(p == SOFT_GEOMETRY) geometry(t);
+        else for(int tile; (tile = nextTile.fetch_add(1, std::memory_order_relaxed)) < tilesX * tilesY; ) rasterTile(tile);
+    }
+
+    // Fase 1: desenhos [t*n/T, (t+1)*n/T) da lista.
+    void geometry(int t) {
+        Bin &bin = bins[t];
+        bin.tris.clear();
+        for(auto &tile : bin.tiles) tile.clear();
+        size_t n = draws.size();
+        for(size_t d = n * t / threads; d < n * (t + 1) / threads; d++) geometryDraw(draws[d], bin);
+    }
+
+    // Transforma e ilumina os vértices de um desenho (como o pipeline fixo, com GL_NORMALIZE).
+    void geometryDraw(const SoftDraw &d, Bin &bin) {
+        float mv[16], mvp[16];
+        mat4Mul(view, d.model, mv);
+        mat4Mul(proj, mv, mvp);
+        // Inversa transposta da parte 3x3 da modelview, a menos do determinante (normalizada depois).
+        auto e = [&](int r, int c) { return mv[c*4 + r]; };
+        float nm[3][3];
+        for(int r=0;r<3;r++)
+            for(int c=0;c<3;c++){
+                int r1 = (r + 1) % 3, r2 = (r + 2) % 3, c1 = (c + 1) % 3, c2 = (c + 2) % 3;
+                nm[r][c] = e(r1, c1) * e(r2, c2) - e(r1, c2) * e(r2, c1);
+            }
+        const Mesh &m = *d.mesh;
+        int nv = m.vertexCount();
+        bin.verts.resize(nv);
+        const float diffuse[3] = {1.0f, 0.95f, 0.85f};
+        for(int v=0;v<nv;v++){
+            const float *src = &m.verts[(size_t)v * 8];
+            SoftVertex &o = bin.verts[v];
+            for(int r=0;r<4;r++) o.clip[r] = mvp[r] * src[0] + mvp[4 + r] * src[1] + mvp[8 + r] * src[2] + mvp[12 + r];
+            float n[3], len = 0;
+            for(int r=0;r<3;r++) { n[r] = nm[r][0] * src[3] + nm[r][1] * src[4] + nm[r][2] * src[5]; len += n[r] * n[r]; }
+            len = len > 0 ? 1.0f / sqrtf(len) : 0.0f;
+            float nl = std::max(0.0f, (n[0] * lightEye[0] + n[1] * lightEye[1] + n[2] * lightEye[2]) * len);
+            float spec = 0.0f;
+            if(nl > 0) spec = 0.2f * powf(std::max(0.0f, (n[0] * halfEye[0] + n[1] * halfEye[1] + n[2] * halfEye[2]) * len), 32.0f);
+            for(int c=0;c<3;c++) o.attr[c] = std::min(1.0f, (0.25f + nl * diffuse[c]) * d.color[c] + spec * diffuse[c]);
+            o.attr[3] = src[6];
+            o.attr[4] = src[7];
+        }
+        for(size_t i=0;i+2<m.indices.size();i+=3){
+            const SoftVertex *tri[3] = {&bin.verts[m.indices[i]], &bin.verts[m.indices[i+1]], &bin.verts[m.indices[i+2]]};
+            clipAndSetup(tri, d, bin);
+        }
+    }
+
+    // Recorta no plano perto (z >= -w) e monta os triângulos resultantes (0, 1 ou 2).
+    void clipAndSetup(const SoftVertex *const v[3], const SoftDraw &d, Bin &bin) {
+        float dist[3];
+        int inside = 0;
+        for(int k=0;k<3;k++) { dist[k] = v[k]->clip[2] + v[k]->clip[3]; inside += dist[k] >= 0; }
+        if(inside == 0) return;
+        if(inside == 3) { setup(*v[0], *v[1], *v[2], d, bin); return; }
+        SoftVertex poly[4];
+        int n = 0;
+        for(int k=0;k<3;k++){
+            const SoftVertex &a = *v[k], &b = *v[(k + 1) % 3];
+            float da = dist[k], db = dist[(k + 1) % 3];
+            if(da >= 0) poly[n++] = a;
+            if((da >= 0) != (db >= 0)) {
+                float s = da / (da - db);
+                SoftVertex &c = poly[n++];
+                for(int r=0;r<4;r++) c.clip[r] = a.clip[r] + s * (b.clip[r] - a.clip[r]);
+                for(int r=0;r<5;r++) c.attr[r] = a.attr[r] + s * (b.attr[r] - a.attr[r]);
+            }
+        }
+        for(int k=1;k+1<n;k++) setup(poly[0], poly[k], poly[k + 1], d, bin);
+    }
+
+    // Projeta, descarta faces de trás e triângulos sem pixels, monta arestas e planos e registra nos blocos.
+    void setup(const SoftVertex &a, const SoftVertex &b, const SoftVertex &c, const SoftDraw &d, Bin &bin) {
+        const SoftVertex *v[3] = {&a, &b, &c};
+        float X[3], Y[3], Z[3], IW[3];
+        for(int k=0;k<3;k++){
+            IW[k] = 1.0f / v[k]->clip[3];
+            X[k] = (v[k]->clip[0] * IW[k] * 0.5f + 0.5f) * width;
+            Y[k] = (v[k]->clip[1] * IW[k] * 0.5f + 0.5f) * height;
+            Z[k] = v[k]->clip[2] * IW[k] * 0.5f + 0.5f;
+        }
+        double area = ((double)X[1] - X[0]) * ((double)Y[2] - Y[0]) - ((double)X[2] - X[0]) * ((double)Y[1] - Y[0]);
+        if(area == 0 || !std::isfinite(area)) return;
+        if(area < 0) {
+            if(d.cullBack) return;
+            // Sem descarte (chão): inverte para ficar no sentido anti-horário.
+            std::swap(v[1], v[2]); std::swap(X[1], X[2]); std::swap(Y[1], Y[2]);
+            std::swap(Z[1], Z[2]); std::swap(IW[1], IW[2]);
+            area = -area;
+        }
+        SoftTri t;
+        float minX = std::min(X[0], std::min(X[1], X[2])), maxX = std::max(X[0], std::max(X[1], X[2]));
+        float minY = std::min(Y[0], std::min(Y[1], Y[2])), maxY = std::max(Y[0], std::max(Y[1], Y[2]));
+        // Centros de pixel em x + 0.5: cobre x de ceil(min - 0.5) a floor(max - 0.5), dentro da tela.
+        t.minX = (int)ceilf(std::max(minX - 0.5f, 0.0f));
+        t.minY = (int)ceilf(std::max(minY - 0.5f, 0.0f));
+        t.maxX = (int)floorf(std::min(maxX - 0.5f, (float)(width - 1)));
+        t.maxY = (int)floorf(std::min(maxY - 0.5f, (float)(height - 1)));
+        if(t.minX > t.maxX || t.minY > t.maxY) return;
+        for(int i=0;i<3;i++){
+            int p = (i + 1) % 3, q = (i + 2) % 3;
+            // Dentro = à esquerda de p->q. Topo ou esquerda: descendo, ou na horizontal para a esquerda.
+            float ddx = X[q] - X[p], ddy = Y[q] - Y[p];
+            t.topLeft[i] = ddy < 0 || (ddy == 0 && ddx < 0);
+            bool swapEdge = X[p] > X[q] || (X[p] == X[q] && Y[p] > Y[q]);
+            int o = swapEdge ? q : p, e = swapEdge ? p : q;
+            t.ox[i] = X[o]; t.oy[i] = Y[o];
+            t.dx[i] = X[e] - X[o]; t.dy[i] = Y[e] - Y[o];
+            t.sign[i] = swapEdge ? -1.0f : 1.0f;
+        }
+        double dX1 = (double)X[1] - X[0], dY1 = (double)Y[1] - Y[0];
+        double dX2 = (double)X[2] - X[0], dY2 = (double)Y[2] - Y[0];
+        t.px = X[0]; t.py = Y[0];
+        for(int k=0;k<7;k++){
+            double f[3];
+            for(int j=0;j<3;j++)
+                f[j] = k == 0 ? Z[j] : k == 1 ? IW[j] : v[j]->attr[k - 2] * IW[j];
+            t.plane[k][0] = (float)f[0];
+            t.plane[k][1] = (float)(((f[1] - f[0]) * dY2 - (f[2] - f[0]) * dY1) / area);
+            t.plane[k][2] = (float)(((f[2] - f[0]) * dX1 - (f[1] - f[0]) * dX2) / area);
+        }
+        t.textured = d.textured;
+        uint32_t index = (uint32_t)bin.tris.size();
+        bin.tris.push_back(t);
+        for(int ty = t.minY / SOFT_TILE; ty <= t.maxY / SOFT_TILE; ty++)
+            for(int tx = t.minX / SOFT_TILE; tx <= t.maxX / SOFT_TILE; tx++)
+                bin.tiles[(size_t)ty * tilesX + tx].push_back(index);
+    }
+
+    // Fase 2: limpa o bloco e desenha os triângulos de todas as threads, na ordem da lista.
+    void rasterTile(int tile) {
+        int x0 = (tile % tilesX) * SOFT_TILE, y0 = (tile / tilesX) * SOFT_TILE;
+        int x1 = std::min(width, x0 + SOFT_TILE), y1 = std::min(height, y0 + SOFT_TILE);
+        for(int y=y0;y<y1;y++){
+            std::fill(&color[(size_t)y * width + x0], &color[(size_t)y * width + x1], 0u);
+            std::fill(&depth[(size_t)y * width + x0], &depth[(size_t)y * width + x1], 1.0f);
+        }
+        for(const Bin &b : bins)
+            for(uint32_t i : b.tiles[tile]) rasterTri(b.tris[i], x0, y0, x1 - 1, y1 - 1);
+    }
+
+    // Nível de detalhe pelas derivadas exatas de u = (u/w) / (1/w) no pixel com u, v e w dados.
+    float lod(const SoftTri &t, float u, float v, float w) const {
+        float dudx = (t.plane[5][1] - u * t.plane[1][1]) * w;
+        float dvdx = (t.plane[6][1] - v * t.plane[1][1]) * w;
+        float dudy = (t.plane[5][2] - u * t.plane[1][2]) * w;
+        float dvdy = (t.plane[6][2] - v * t.plane[1][2]) * w;
+        float rho = sqrtf(std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy)) * (float)asphaltTexSize;
+        return rho > 0 ? log2f(rho) : 0.0f;
+    }
+
+    // Primeira faixa ligada na máscara de 4 bits (não vazia); sem __builtin_ctz, que o MSVC não tem.
+    static int lowestLane(int bits) {
+        int k = 0;
+        while(!(bits >> k & 1)) k++;
+        return k;
+    }
+
+#if defined(__SSE2__) || defined(_M_X64)
+    // Amostra bilinear do nível 'l' com repetição (REPEAT) nos 4 pixels do bloco, em 0..255.
+    __m128 sampleLevel(int l, __m128 u, __m128 v) const {
+        int s = levelSize[l];
+        const uint32_t *q = &quads[levelOffset[l]];
+        const __m128 fs = _mm_set1_ps((float)s), inv = _mm_set1_ps(1.0f / s), half = _mm_set1_ps(0.5f);
+        auto floor4 = [](__m128 x) {
+            __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+            return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+        };
+        __m128 x = _mm_sub_ps(_mm_mul_ps(u, fs), half), y = _mm_sub_ps(_mm_mul_ps(v, fs), half);
+        x = _mm_sub_ps(x, _mm_mul_ps(fs, floor4(_mm_mul_ps(x, inv))));   // Em [0, s).
+        y = _mm_sub_ps(y, _mm_mul_ps(fs, floor4(_mm_mul_ps(y, inv))));
+        __m128 fx = floor4(x), fy = floor4(y);
+        __m128 ax = _mm_sub_ps(x, fx), ay = _mm_sub_ps(y, fy);
+        int i0[4], j0[4];
+        _mm_storeu_si128((__m128i*)i0, _mm_cvttps_epi32(fx));
+        _mm_storeu_si128((__m128i*)j0, _mm_cvttps_epi32(fy));
+        uint32_t texel[4];
+        for(int k=0;k<4;k++){
+            // O arredondamento da divisão pode deixar o índice em s.
+            int a = (unsigned)i0[k] < (unsigned)s ? i0[k] : 0, b = (unsigned)j0[k] < (unsigned)s ? j0[k] : 0;
+            texel[k] = q[(size_t)b * s + a];
+        }
+        __m128i t = _mm_loadu_si128((const __m128i*)texel), byte = _mm_set1_epi32(0xFF);
+        __m128 top = _mm_cvtepi32_ps(_mm_and_si128(t, byte));
+        __m128 bot = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(t, 16), byte));
+        top = _mm_add_ps(top, _mm_mul_ps(ax, _mm_sub_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(t, 8), byte)), top)));
+        bot = _mm_add_ps(bot, _mm_mul_ps(ax, _mm_sub_ps(_mm_cvtepi32_ps(_mm_srli_epi32(t, 24)), bot)));
+        return _mm_add_ps(top, _mm_mul_ps(ay, _mm_sub_ps(bot, top)));
+    }
+
+    // Filtro do GL para o nível de detalhe 'lambda': bilinear ampliando; reduzindo, bilinear no
+    // nível mais próximo (GL_LINEAR_MIPMAP_NEAREST) ou trilinear com --trilinear.
+    __m128 sample(float lambda, __m128 u, __m128 v) const {
+        int maxLevel = (int)levelSize.size() - 1;
+        if(lambda <= 0.0f || maxLevel == 0) return sampleLevel(0, u, v);
+        if(!asphaltTrilinear) return sampleLevel(lambda <= 0.5f ? 0 : std::min(maxLevel, (int)ceilf(lambda + 0.5f) - 1), u, v);
+        if(lambda >= maxLevel) return sampleLevel(maxLevel, u, v);
+        int l = (int)lambda;
+        __m128 a = sampleLevel(l, u, v);
+        return _mm_add_ps(a, _mm_mul_ps(_mm_set1_ps(lambda - l), _mm_sub_ps(sampleLevel(l + 1, u, v), a)));
+    }
+
+    void rasterTri(const SoftTri &t, int tx0, int ty0, int tx1, int ty1) {
+        int x0 = std::max(t.minX, tx0), x1 = std::min(t.maxX, tx1);
+        int y0 = std::max(t.minY, ty0), y1 = std::min(t.maxY, ty1);
+        if(x0 > x1 || y0 > y1) return;
+        const __m128 lane = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 xEnd = _mm_set1_ps((float)x1 + 1.0f);
+        __m128 ox[3], edgeDy[3], sign[3], tl[3];
+        for(int i=0;i<3;i++){
+            ox[i] = _mm_set1_ps(t.ox[i]);
+            edgeDy[i] = _mm_set1_ps(t.dy[i]);
+            sign[i] = _mm_set1_ps(t.sign[i]);
+            tl[i] = _mm_castsi128_ps(_mm_set1_epi32(t.topLeft[i] ? -1 : 0));
+        }
+        __m128 planeDx[7];
+        for(int k=0;k<7;k++) planeDx[k] = _mm_set1_ps(t.plane[k][1]);
+        const __m128 px0 = _mm_set1_ps(t.px);
+        const bool mip = t.textured && levelSize.size() > 1;
+        for(int y=y0;y<=y1;y++){
+            float cy = y + 0.5f;
+            __m128 rowE[3], rowPlane[7];
+            for(int i=0;i<3;i++) rowE[i] = _mm_set1_ps(t.dx[i] * (cy - t.oy[i]));
+            for(int k=0;k<7;k++) rowPlane[k] = _mm_set1_ps(t.plane[k][0] + t.plane[k][2] * (cy - t.py));
+            uint32_t *crow = &color[(size_t)y * width];
+            float *drow = &depth[(size_t)y * width];
+            for(int x=x0;x<=x1;x+=4){
+                __m128 cx = _mm_add_ps(_mm_set1_ps((float)x), lane);
+                __m128 mask = _mm_cmplt_ps(cx, xEnd);
+                for(int i=0;i<3;i++){
+                    // Mesma expressão, com os mesmos operandos, nos dois triângulos de uma aresta.
+                    __m128 e = _mm_mul_ps(_mm_sub_ps(rowE[i], _mm_mul_ps(edgeDy[i], _mm_sub_ps(cx, ox[i]))), sign[i]);
+                    __m128 in = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(_mm_cmpeq_ps(e, zero), tl[i]));
+                    mask = _mm_and_ps(mask, in);
+                }
+                if(_mm_movemask_ps(mask) == 0) continue;
+                __m128 rx = _mm_sub_ps(cx, px0);
+                __m128 z = _mm_add_ps(rowPlane[0], _mm_mul_ps(planeDx[0], rx));
+                // Blocos na borda direita da tela: lê e grava só as faixas válidas, via cópia local.
+                int valid = std::min(4, width - x);
+                float dbuf[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+                uint32_t cbuf[4] = {0, 0, 0, 0};
+                float *dptr = drow + x;
+                uint32_t *cptr = crow + x;
+                if(valid < 4) {
+                    memcpy(dbuf, dptr, valid * sizeof(float));
+                    memcpy(cbuf, cptr, valid * sizeof(uint32_t));
+                    dptr = dbuf;
+                    cptr = cbuf;
+                }
+                __m128 d = _mm_loadu_ps(dptr);
+                mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, d), _mm_cmple_ps(z, one)));
+                int bits = _mm_movemask_ps(mask);
+                if(bits == 0) continue;
+                _mm_storeu_ps(dptr, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, d)));
+
+                __m128 w = _mm_div_ps(one, _mm_add_ps(rowPlane[1], _mm_mul_ps(planeDx[1], rx)));
+                __m128 rgb[3];
+                for(int c=0;c<3;c++)
+                    rgb[c] = _mm_mul_ps(_mm_add_ps(rowPlane[2 + c], _mm_mul_ps(planeDx[2 + c], rx)), w);
+                if(t.textured) {
+                    // Pixels fora do triângulo podem ter u, v sem sentido (w perto de 0): zerados.
+                    __m128 u = _mm_and_ps(mask, _mm_mul_ps(_mm_add_ps(rowPlane[5], _mm_mul_ps(planeDx[5], rx)), w));
+                    __m128 v = _mm_and_ps(mask, _mm_mul_ps(_mm_add_ps(rowPlane[6], _mm_mul_ps(planeDx[6], rx)), w));
+                    // Nível de detalhe por bloco de 4 pixels (como o quad 2x2 da GPU), pelas derivadas
+                    // exatas de u = (u/w) / (1/w) no primeiro pixel coberto.
+                    float lambda = 0.0f;
+                    if(mip) {
+                        int k = lowestLane(bits);
+                        float us[4], vs[4], ws[4];
+                        _mm_storeu_ps(us, u); _mm_storeu_ps(vs, v); _mm_storeu_ps(ws, w);
+                        lambda = lod(t, us[k], vs[k], ws[k]);
+                    }
+                    __m128 tv = _mm_mul_ps(sample(lambda, u, v), _mm_set1_ps(1.0f / 255.0f));
+                    for(int c=0;c<3;c++) rgb[c] = _mm_mul_ps(rgb[c], tv);
+                }
+                // Cor em 8 bits por canal (arredondada), alfa 255.
+                const __m128 scale = _mm_set1_ps(255.0f);
+                __m128i r = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(rgb[0], zero), one), scale));
+                __m128i g = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(rgb[1], zero), one), scale));
+                __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(rgb[2], zero), one), scale));
+                __m128i px = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)),
+                                          _mm_or_si128(_mm_slli_epi32(b, 16), _mm_set1_epi32((int)0xFF000000u)));
+                __m128i m = _mm_castps_si128(mask);
+                __m128i old = _mm_loadu_si128((const __m128i*)cptr);
+                _mm_storeu_si128((__m128i*)cptr, _mm_or_si128(_mm_and_si128(m, px), _mm_andnot_si128(m, old)));
+                if(valid < 4) {
+                    memcpy(drow + x, dbuf, valid * sizeof(float));
+                    memcpy(crow + x, cbuf, valid * sizeof(uint32_t));
+                }
+            }
+        }
+    }
+
+#else
+    // Versão escalar (sem SSE2): os mesmos passos da versão SSE2, um pixel por vez.
+    float sampleLevel(int l, float u, float v) const {
+        int s = levelSize[l];
+        const uint32_t *q = &quads[levelOffset[l]];
+        const float fs = (float)s, inv = 1.0f / s;
+        float x = u * fs - 0.5f, y = v * fs - 0.5f;
+        x -= fs * floorf(x * inv);   // Em [0, s).
+        y -= fs * floorf(y * inv);
+        float fx = floorf(x), fy = floorf(y), ax = x - fx, ay = y - fy;
+        int i = (int)fx, j = (int)fy;
+        // O arredondamento da divisão pode deixar o índice em s.
+        int a = (unsigned)i < (unsigned)s ? i : 0, b = (unsigned)j < (unsigned)s ? j : 0;
+        uint32_t t = q[(size_t)b * s + a];
+        float top = (float)(t & 0xFF), bot = (float)(t >> 16 & 0xFF);
+        top += ax * ((float)(t >> 8 & 0xFF) - top);
+        bot += ax * ((float)(t >> 24) - bot);
+        return top + ay * (bot - top);
+    }
+
+    float sample(float lambda, float u, float v) const {
+        int maxLevel = (int)levelSize.size() - 1;
+        if(lambda <= 0.0f || maxLevel == 0) return sampleLevel(0, u, v);
+        if(!asphaltTrilinear) return sampleLevel(lambda <= 0.5f ? 0 : std::min(maxLevel, (int)ceilf(lambda + 0.5f) - 1), u, v);
+        if(lambda >= maxLevel) return sampleLevel(maxLevel, u, v);
+        int l = (int)lambda;
+        float a = sampleLevel(l, u, v);
+        return a + (lambda - l) * (sampleLevel(l + 1, u, v) - a);
+    }
+
+    void rasterTri(const SoftTri &t, int tx0, int ty0, int tx1, int ty1) {
+        int x0 = std::max(t.minX, tx0), x1 = std::min(t.maxX, tx1);
+        int y0 = std::max(t.minY, ty0), y1 = std::min(t.maxY, ty1);
+        if(x0 > x1 || y0 > y1) return;
+        const bool mip = t.textured && levelSize.size() > 1;
+        for(int y=y0;y<=y1;y++){
+            float cy = y + 0.5f;
+            float rowE[3], rowPlane[7];
+            for(int i=0;i<3;i++) rowE[i] = t.dx[i] * (cy - t.oy[i]);
+            for(int k=0;k<7;k++) rowPlane[k] = t.plane[k][0] + t.plane[k][2] * (cy - t.py);
+            uint32_t *crow = &color[(size_t)y * width];
+            float *drow = &depth[(size_t)y * width];
+            // Blocos de 4 pixels como na versão SSE2: o nível de detalhe sai do primeiro pixel coberto.
+            for(int x=x0;x<=x1;x+=4){
+                int n = std::min(4, x1 + 1 - x), bits = 0;
+                float rx[4], w[4], u[4], v[4];
+                for(int k=0;k<n;k++){
+                    float cx = (float)x + (k + 0.5f);
+                    bool in = true;
+                    for(int i=0;i<3;i++){
+                        float e = (rowE[i] - t.dy[i] * (cx - t.ox[i])) * t.sign[i];
+                        in = in && (e > 0 || (e == 0 && t.topLeft[i]));
+                    }
+                    if(!in) continue;
+                    rx[k] = cx - t.px;
+                    float z = rowPlane[0] + t.plane[0][1] * rx[k];
+                    if(!(z < drow[x + k] && z <= 1.0f)) continue;
+                    drow[x + k] = z;
+                    bits |= 1 << k;
+                    w[k] = 1.0f / (rowPlane[1] + t.plane[1][1] * rx[k]);
+                    u[k] = (rowPlane[5] + t.plane[5][1] * rx[k]) * w[k];
+                    v[k] = (rowPlane[6] + t.plane[6][1] * rx[k]) * w[k];
+                }
+                if(bits == 0) continue;
+                float lambda = 0.0f;
+                if(t.textured && mip) {
+                    int k = lowestLane(bits);
+                    lambda = lod(t, u[k], v[k], w[k]);
+                }
+                for(int k=0;k<n;k++){
+                    if(!(bits >> k & 1)) continue;
+                    float rgb[3];
+                    for(int c=0;c<3;c++) rgb[c] = (rowPlane[2 + c] + t.plane[2 + c][1] * rx[k]) * w[k];
+                    if(t.textured) {
+                        float tv = sample(lambda, u[k], v[k]) * (1.0f / 255.0f);
+                        for(int c=0;c<3;c++) rgb[c] *= tv;
+                    }
+                    // Cor em 8 bits por canal (arredondada), alfa 255.
+                    uint32_t px = 0xFF000000u;
+                    for(int c=0;c<3;c++)
+                        px |= (uint32_t)lrintf(std::min(std::max(rgb[c], 0.0f), 1.0f) * 255.0f) << (8 * c);
+                    crow[x + k] = px;
+                }
+            }
+        }
+    }
+#endif
+
+    // HUD por cima do frame: as faixas já compostas de cada linha, na cor da linha, com mistura por alfa.
+    void drawHud() {
+        const GlyphAtlas &a = hudAtlas;
+        for(const HudLine *l : HUD_LINES){
+            if(l->slot < 0 || l->band.empty()) continue;
+            const unsigned rgb[3] = {(unsigned)lroundf(l->color.r * 255), (unsigned)lroundf(l->color.g * 255),
+                                     (unsigned)lroundf(l->color.b * 255)};
+            for(int row=0;row<a.cellH;row++){
+                int y = l->y - a.descent + row;
+                if(y < 0 || y >= height) continue;
+                const unsigned char *src = &l->band[(size_t)row * HUD_TEX_W];
+                uint32_t *dst = &color[(size_t)y * width];
+                for(int col=0;col<l->width && 9 + col < width;col++){
+                    unsigned al = src[col];
+                    if(al == 0) continue;
+                    uint32_t p = dst[9 + col], out = 0;
+                    for(int c=0;c<3;c++){
+                        unsigned ch = (p >> (8 * c)) & 0xFF;
+                        out |= ((ch * (255 - al) + rgb[c] * al + 127) / 255) << (8 * c);
+                    }
+                    unsigned alpha = (p >> 24) * (255 - al) / 255 + al * al / 255;
+                    dst[9 + col] = out | alpha << 24;
+                }
+            }
+        }
+    }
+} soft;
+
+void softStop() { soft.stop(); }
+
+/**
+ * Prepara o rasterizador por software: malhas (do arquivo ou processadas) e textura na CPU e as
+ * threads do pool. Não precisa de contexto GL.
+ */
+void initSoftRaster() {
+    if(meshCube.indices.empty()) {
+        buildGroundMesh(meshGround);
+        if(!loadBakedMeshes(meshFilePath)) bakeAllMeshes();
+    }
+    int n = softThreads > 0 ? softThreads : (int)std::thread::hardware_concurrency();
+    soft.init(n);
+    atexit(softStop);
+}
+
+/**
+ * renderScene() na CPU: mesmo snapshot, câmera, culling e LOD; o frame fica em soft.color.
+ */
+const SimSnapshot &renderSceneSoft(bool hud) {
+    float alpha;
+    const SimSnapshot &snap = acquireSnapshot(alpha);
+    Camera rcam = lerpCamera(snap.prevCam, snap.cam, alpha);
+    Car rcar = lerpCar(snap.prevCar, snap.car, alpha);
+
+    auto submitStart = std::chrono::steady_clock::now();
+    soft.begin(winW, winH, rcam);
+    frustumFromMatrices(viewFrustum, soft.proj, soft.view, winH);
+    bool carVisible = !allowCulling || viewFrustum.sphereVisible(rcar.x, rcar.y + 0.25f, rcar.z, CAR_BOUND_RADIUS);
+    int wheelLod = allowCulling ? viewFrustum.lodFor(rcar.x, rcar.y, rcar.z, WHEEL_BOUND_RADIUS) : 0;
+
+    float m[16];
+    mat4Identity(m);
+    soft.add(meshGround, m, 1.0f, 1.0f, 1.0f, true, false);
+    cullCones(viewFrustum, coneVis);
+    for(int l=0;l<LOD_LEVELS;l++)
+        for(int i : coneVis.lod[l]){
+            mat4Identity(m);
+            mat4Translate(m, cones[i].first, 0.0f, cones[i].second);
+            bool knocked = coneView.knocked[i] != 0;
+            soft.add(soft.baked[1 + l], m, knocked ? 0.45f : 1.0f, knocked ? 0.2f : 0.45f, 0.05f, false, true);
+        }
+    if(carVisible) {
+        // Mesmas transformações de drawCarRetained.
+        float car[16];
+        mat4Identity(car);
+        mat4Translate(car, rcar.x, rcar.y + 0.25f, rcar.z);
+        mat4RotateY(car, rcar.heading);
+        memcpy(m, car, sizeof(m));
+        mat4Scale(m, 1.1f, 0.5f, 1.8f);
+        soft.add(soft.baked[0], m, 0.15f, 0.25f, 0.9f, false, true);
+        memcpy(m, car, sizeof(m));
+        mat4Translate(m, 0.0f, 0.35f, -0.1f);
+        mat4Scale(m, 0.7f, 0.3f, 0.6f);
+        soft.add(soft.baked[0], m, 0.8f, 0.9f, 0.95f, false, true);
+        const float wx=0.55f, wz=0.65f, wy=-0.25f;
+        const float wheels[4][3] = {{-wx, wy, -wz}, {wx, wy, -wz}, {-wx, wy, wz}, {wx, wy, wz}};
+        for(int k=0;k<4;k++){
+            memcpy(m, car, sizeof(m));
+            mat4Translate(m, wheels[k][0], wheels[k][1], wheels[k][2]);
+            if(k < 2) mat4RotateY(m, rcar.wheelAngle);
+            soft.add(soft.baked[1 + LOD_LEVELS + wheelLod], m, 0.02f, 0.02f, 0.02f, false, true);
+        }
+    }
+    soft.render();
+
+    renderStats.drawCalls = (int)soft.draws.size();
+    renderStats.conesCulled = coneVis.culled;
+    renderStats.conesDrawn = (int)cones.size() - coneVis.culled;
+    for(int l=0;l<LOD_LEVELS;l++) renderStats.conesPerLod[l] = (int)coneVis.lod[l].size();
+    renderStats.carDrawn = carVisible;
+    renderStats.wheelLod = wheelLod;
+    renderStats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+
+    if(hud) {
+        PROFILE_SCOPE(PROF_HUD);
+        updateHudText(snap, winH);
+        soft.drawHud();
+    }
+    PROFILE_END_FRAME();
+    return snap;
+}
+
+// Mostra o frame do rasterizador na janela GLUT.
+void blitSoftFrame() {
+    glMatrixMode(GL_PROJECTION); glPushMatrix(); glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW); glPushMatrix(); glLoadIdentity();
+    glState.disable(GL_DEPTH_TEST);
+    glState.disable(GL_LIGHTING);
+    glState.disable(GL_TEXTURE_2D);
+    glRasterPos2f(-1.0f, -1.0f);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glDrawPixels(soft.width, soft.height, GL_RGBA, GL_UNSIGNED_BYTE, soft.color.data());
+    glMatrixMode(GL_PROJECTION); glPopMatrix();
+    glMatrixMode(GL_MODELVIEW); glPopMatrix();
+}
+
+// ----------------------- Display / Render ------------------------
+Camera viewCam;            // Câmera usada na matriz de visão do último frame.
+bool viewCamValid = false;
+
+/**
+ * Desenha a cena 3D (e o HUD, se pedido) no framebuffer atual, ou em soft.color com --soft-raster;
+ * usada pela janela e pelo modo headless.
+ * @return Snapshot da simulação desenhado (para a medição de latência).
+ */
+const SimSnapshot &renderScene(bool hud) {
+    if(useSoftRaster) return renderSceneSoft(hud);
+    glState.beginFrame();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Configura a matriz de visualização (câmera)
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    // Estado interpolado entre os dois últimos passos de física.
+    float alpha;
+    const SimSnapshot &snap = acquireSnapshot(alpha);
+    Camera rcam = lerpCamera(snap.prevCam, snap.cam, alpha);
+    Car rcar = lerpCar(snap.prevCar, snap.car, alpha);
+
+    // gluLookAt define a posição da câmera (rcam.x, rcam.y, rcam.z), o ponto de foco (rcam.tx, rcam.ty, rcam.tz)
+    // e o vetor 'up' (0.0f, 1.0f, 0.0f).
+    gluLookAt(rcam.x, rcam.y, rcam.z, rcam.tx, rcam.ty, rcam.tz, 0.0f, 1.0f, 0.0f);
+    // 'up' é fixo: a visão só muda com a posição e o foco da câmera.
+    if(!viewCamValid || rcam.x != viewCam.x || rcam.y != viewCam.y || rcam.z != viewCam.z ||
+       rcam.tx != viewCam.tx || rcam.ty != viewCam.ty || rcam.tz != viewCam.tz) {
+        glState.viewChanged();
+        viewCam = rcam;
+        viewCamValid = true;
+    }
+    updateFrustum(viewFrustum, winH);
+    // Carro: esfera do conjunto para o culling, raio da roda para o nível de detalhe.
+    bool carVisible = !allowCulling || viewFrustum.sphereVisible(rcar.x, rcar.y + 0.25f, rcar.z, CAR_BOUND_RADIUS);
+    int wheelLod = allowCulling ? viewFrustum.lodFor(rcar.x, rcar.y, rcar.z, WHEEL_BOUND_RADIUS) : 0;
+
+    // Desenha a cena (modo retido com buffers em cache, ou o modo imediato antigo).
+    auto submitStart = std::chrono::steady_clock::now();
+    renderStats.drawCalls = 0;
+    { PROFILE_GL_SCOPE(PROF_LIGHTING); setupLighting(); }
+    if(useImmediateMode) {
+        { PROFILE_GL_SCOPE(PROF_GROUND); if(openWorld) drawGroundStreamed(rcam); else drawGroundTextured(); }
+        {
+            PROFILE_GL_SCOPE(PROF_CONES);
+            cullCones(viewFrustum, coneVis);
+            for(int l=0;l<LOD_LEVELS;l++)
+                for(int i : coneVis.lod[l]) drawConeAt(cones[i].first, cones[i].second, coneView.knocked[i] != 0, l);
+        }
+        if(carVisible) { PROFILE_GL_SCOPE(PROF_CAR); drawCarModel(rcar, wheelLod); }
+        // glBegin do chão, um glutSolidCone por cone, 6 sólidos do carro (blocos do chão já contados).
+        renderStats.drawCalls += (openWorld ? 0 : 1) + (int)(cones.size() - coneVis.culled) + (carVisible ? 6 : 0);
+    } else {
+        { PROFILE_GL_SCOPE(PROF_GROUND); if(openWorld) drawGroundStreamed(rcam); else drawGroundRetained(); }
+        { PROFILE_GL_SCOPE(PROF_CONES); cullCones(viewFrustum, coneVis); drawConesRetained(); }
+        if(carVisible) { PROFILE_GL_SCOPE(PROF_CAR); drawCarRetained(rcar, wheelLod); }
+    }
+    if(snap.path) drawPlannedPath(*snap.path);
+    if(snap.evalPath) drawPlannedPath(*snap.evalPath);
+    renderStats.conesCulled = coneVis.culled;
+    renderStats.conesDrawn = (int)cones.size() - coneVis.culled;
+    for(int l=0;l<LOD_LEVELS;l++) renderStats.conesPerLod[l] = (int)coneVis.lod[l].size();
+    renderStats.carDrawn = carVisible;
+    renderStats.wheelLod = wheelLod;
+    renderStats.submitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+
+    // Desenha o HUD (em 2D por cima da cena 3D)
+    if(hud) { PROFILE_GL_SCOPE(PROF_HUD); drawHUD(snap); }
+    PROFILE_END_FRAME();
+    return snap;
+}
+
+/**
+ * Função principal de desenho (callback de display).
+ */
+void display() {
+    updateFrameTiming();
+    const SimSnapshot &snap = renderScene(true);
+    if(useSoftRaster) blitSoftFrame();
+    glutSwapBuffers(); // Troca o buffer frontal e traseiro (para animação suave - double buffering).
+    inputLatency.presented(snap.inputsApplied, std::chrono::steady_clock::now());
+}
+
+// ----------------------- Reshape / Projection --------------------
+
+/**
+ * Função de callback chamada quando a janela é redimensionada.
+ */
+void reshape(int w, int h) {
+    if(h==0) h=1;
+    winW = w; winH = h;  // Guardado para o HUD (evita glutGet a cada frame).
+    glViewport(0,0,w,h); // Ajusta o viewport para o novo tamanho da janela.
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    // Configura a perspectiva (FOV=60, AspectRatio, near, far).
+    gluPerspective(60.0, (double)w/(double)h, 0.1, 300.0);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// ----------------------- Loop de redesenho ------------------------------
+//
+// O redesenho roda no glutIdleFunc e o ritmo vem do vsync: glutSwapBuffers espera o retraço,
+// então não há timer acordando a cada 1 ms. Sem a extensão de swap interval, idleFunc dorme
+// até completar FALLBACK_FRAME_SEC por quadro.
+
+const double FALLBACK_FRAME_SEC = 1.0 / 120;
+bool vsyncEnabled = false;
+
+/**
+ * Liga o vsync (wglSwapIntervalEXT / glXSwapIntervalSGI) no contexto atual da janela.
+ */
+void enableVsync() {
+#ifdef _WIN32
+    typedef BOOL (WINAPI *SwapIntervalProc)(int);
+    SwapIntervalProc swapInterval = (SwapIntervalProc)glutGetProcAddress("wglSwapIntervalEXT");
+    vsyncEnabled = swapInterval && swapInterval(1);
+#else
+    typedef int (*SwapIntervalProc)(int);
+    SwapIntervalProc swapInterval = (SwapIntervalProc)glutGetProcAddress("glXSwapIntervalSGI");
+    vsyncEnabled = swapInterval && swapInterval(1) == 0;
+#endif
+    if(!vsyncEnabled) printf("Vsync indisponivel; redesenho limitado a %.0f Hz.\n", 1.0 / FALLBACK_FRAME_SEC);
+}
+
+/**
+ * Callback ocioso do GLUT: alimenta o relógio de passo fixo e pede um redesenho.
+ */
+void idleFunc() {
+    // Tempo real decorrido (steady_clock tem resolução melhor que GLUT_ELAPSED_TIME em ms).
+    static auto last = std::chrono::steady_clock::now();
+    auto now = std::chrono::steady_clock::now();
+    if(!vsyncEnabled) {
+        double wait = FALLBACK_FRAME_SEC - std::chrono::duration<double>(now - last).count();
+        if(wait > 0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            now = std::chrono::steady_clock::now();
+        }
+    }
+    double frameSec = std::chrono::duration<double>(now - last).count();
+    last = now;
+
+    // Atualiza o estado da simulação em passos fixos (a thread de simulação, se ativa, já o faz).
+    if(!simThreadRunning) advanceSimulation(frameSec);
+
+    glutPostRedisplay(); // Marca a janela para ser redesenhada no próximo loop.
+}
+
+// ----------------------- Inicialização do GL e da cena -----------------
+
+/**
+ * Estado inicial do OpenGL e da cena; comum à janela GLUT e ao modo headless.
+ */
+void initScene() {
+    if(useSoftRaster) initSoftRaster(); // Sem estado GL: a cena inteira fica na CPU.
+    else {
+        // Configurações iniciais de estado do OpenGL
+        glState.enable(GL_DEPTH_TEST);  // Habilita o teste de profundidade para objetos 3D.
+        glShadeModel(GL_SMOOTH);  // Interpola cores e normais.
+        glState.enable(GL_NORMALIZE);   // Garante que normais sejam unitárias após transformações.
+
+        // Inicialização da cena
+        initTextures();
+        if(!useImmediateMode) initMeshes();
+        setupLighting();
+    }
+    if(cones.external) rebuildConeGrid(); // Percurso carregado com --course.
+    else setupConesStraightCorridor();
+    if(replay.file.data) beginReplay();
+    rewindHistory.init(physicsHz, rewindSeconds);
+    if(!telemetryPath.empty()) {
+        if(telemetry.start(telemetryPath.c_str(), car, physicsHz)) atexit(telemetryStop);
+        else fprintf(stderr, "Nao foi possivel criar a telemetria %s\n", telemetryPath.c_str());
+    }
+    if(autoParkAtStart) startAutopilot(autopilot, parkingPlanner, car, planThreadCount());
+    if(openWorld) { ground.init(); atexit(groundStop); }
+    publishSnapshot(1.0f, std::chrono::steady_clock::now()); // Estado inicial para o primeiro display().
+#if PROFILER
+    if(!useImmediateMode && !useSoftRaster) profInitGpu(); // Precisa das funções carregadas por initMeshes.
+    atexit(profWriteCsv);
+#endif
+}
+
+// ----------------------- Headless: render offscreen e captura -----------------
+//
+// Renderiza a cena sem janela (contexto EGL sem superfície, ex.: Mesa llvmpipe) em um
+// framebuffer offscreen. A leitura usa dois pixel-pack buffers: o glReadPixels do frame N
+// é assíncrono e só o frame N-1 é mapeado, então a cópia sobrepõe o frame seguinte. Os
+// pixels vão para uma thread que grava a sequência em PPM; se ela atrasar, o frame é
+// descartado e contado, nunca bloqueando a simulação.
+
+// Grava frames RGBA (linhas de baixo para cima, como vêm do GL) em arquivos PPM numa thread própria.
+struct FrameWriter {
+    struct Frame {
+        long index;
+        std::vector<unsigned char> pixels;
+    };
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<Frame> queue;                       // Frames aguardando gravação.
+    std::vector<std::vector<unsigned char>> spare; // Buffers já alocados para reaproveitar.
+    std::thread worker;
+    std::string dir;
+    int width = 0, height = 0;
+    size_t capacity = 16;
+    bool stopping = false;
+    long written = 0, dropped = 0, failed = 0; // failed: fopen/fwrite/fclose falhou (sem arquivo válido).
+
+    void start(const std::string &outDir, int w, int h, size_t maxQueued) {
+        dir = outDir; width = w; height = h; capacity = maxQueued;
+        worker = std::thread([this]() { run(); });
+    }
+
+    // Copia o frame para a fila; devolve false (e conta o descarte) se a fila estiver cheia.
+    bool submit(long index, const unsigned char *rgba) {
+        std::vector<unsigned char> buf;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(queue.size() >= capacity) { dropped++; return false; }
+            if(!spare.empty()) { buf.swap(spare.back()); spare.pop_back(); }
+        }
+        buf.assign(rgba, rgba + (size_t)width * height * 4);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(Frame{index, std::move(buf)});
+        }
+        cv.notify_one();
+        return true;
+    }
+
+    void run() {
+        std::vector<unsigned char> rgb((size_t)width * height * 3);
+        for(;;) {
+            Frame f;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if(queue.empty()) return;
+                f = std::move(queue.front());
+                queue.pop_front();
+            }
+            // Inverte as linhas e descarta o alfa.
+            for(int y=0;y<height;y++){
+                const unsigned char *src = &f.pixels[(size_t)(height - 1 - y) * width * 4];
+                unsigned char *dst = &rgb[(size_t)y * width * 3];
+                for(int x=0;x<width;x++){ dst[x*3] = src[x*4]; dst[x*3+1] = src[x*4+1]; dst[x*3+2] = src[x*4+2]; }
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "/frame_%06ld.ppm", f.index);
+            std::string path = dir + name;
+            FILE *fp = fopen(path.c_str(), "wb");
+            bool ok = fp && fprintf(fp, "P6\n%d %d\n255\n", width, height) > 0 &&
+                      fwrite(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+            if(fp && fclose(fp) != 0) ok = false;
+            int err = ok ? 0 : errno;
+            if(fp && !ok) remove(path.c_str()); // Não deixa um PPM truncado.
+            std::lock_guard<std::mutex> lock(mtx);
+            if(ok) written++;
+            else if(failed++ == 0) fprintf(stderr, "Falha ao gravar %s: %s (avisando so uma vez)\n", path.c_str(), strerror(err));
+            spare.push_back(std::move(f.pixels));
+        }
+    }
+
+    // Espera a fila esvaziar e encerra a thread.
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_one();
+        if(worker.joinable()) worker.join();
+    }
+};
+
+// Leitura do framebuffer com dois PBOs em alternância (ou glReadPixels síncrono sem PBO).
+struct AsyncReadback {
+    GLuint pbo[2] = {0, 0};
+    int width = 0, height = 0;
+    long frames = 0;                 // Leituras iniciadas.
+    long pendingIndex = -1;          // Índice do frame ainda no PBO anterior.
+    std::vector<unsigned char> sync; // Buffer do caminho sem PBO.
+
+    void init(int w, int h) {
+        width = w; height = h;
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        if(glHasPBO) {
+            glf.GenBuffers(2, pbo);
+            for(int i=0;i<2;i++){
+                glf.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+                glf.BufferData(GL_PIXEL_PACK_BUFFER, (size_t)w * h * 4, NULL, GL_STREAM_READ);
+            }
+            glf.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        } else {
+            sync.resize((size_t)w * h * 4);
+        }
+    }
+
+    // Inicia a leitura do frame atual e entrega ao escritor o frame anterior, já copiado.
+    void capture(FrameWriter &writer, long index) {
+        if(!glHasPBO) {
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, sync.data());
+            writer.submit(index, sync.data());
+            return;
+        }
+        glf.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frames % 2]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        long previous = pendingIndex;
+        pendingIndex = index;
+        frames++;
+        if(previous >= 0) deliver(writer, pbo[frames % 2], previous);
+        glf.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Entrega o último frame que ficou no PBO.
+    void flush(FrameWriter &writer) {
+        if(!glHasPBO || pendingIndex < 0) return;
+        deliver(writer, pbo[(frames - 1) % 2], pendingIndex);
+        glf.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pendingIndex = -1;
+    }
+
+    void deliver(FrameWriter &writer, GLuint buffer, long index) {
+        glf.BindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        const unsigned char *p = (const unsigned char*)glf.MapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if(p) writer.submit(index, p);
+        glf.UnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+};
+
+#ifdef HEADLESS_EGL
+GLProc eglProcLoader(const char *name) { return (GLProc)eglGetProcAddress(name); }
+
+/**
+ * Cria um contexto OpenGL (perfil de compatibilidade) sem janela nem superfície.
+ */
+bool createHeadlessContext() {
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(getPlatformDisplay) dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if(dpy == EGL_NO_DISPLAY) dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL)) return false;
+
+    const EGLint attribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig cfg;
+    EGLint count = 0;
+    if(!eglChooseConfig(dpy, attribs, &cfg, 1, &count) || count == 0) return false;
+    if(!eglBindAPI(EGL_OPENGL_API)) return false;
+    EGLContext ctx = eglCreateContext(dpy, cfg, EGL_NO_CONTEXT, NULL);
+    if(ctx == EGL_NO_CONTEXT) return false;
+    if(!eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx)) return false;
+    glProcLoader = eglProcLoader;
+    return true;
+}
+#endif
+
+/**
+ * Cria o framebuffer offscreen (cor RGBA8 + profundidade 24 bits) e o deixa ligado.
+ */
+bool createOffscreenFramebuffer(int w, int h) {
+    if(!glHasFBO) return false;
+    GLuint fbo, rb[2];
+    glf.GenFramebuffers(1, &fbo);
+    glf.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glf.GenRenderbuffers(2, rb);
+    glf.BindRenderbuffer(GL_RENDERBUFFER, rb[0]);
+    glf.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glf.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb[0]);
+    glf.BindRenderbuffer(GL_RENDERBUFFER, rb[1]);
+    glf.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+    glf.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rb[1]);
+    return glf.CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Memória residente do processo (KB), para conferir o chão do mundo aberto; -1 fora do Linux.
+long residentKB() {
+#ifdef __linux__
+    long pages = 0, rss = -1;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if(!f) return -1;
+    if(fscanf(f, "%ld %ld", &pages, &rss) != 2) rss = -1;
+    fclose(f);
+    return rss < 0 ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024);
+#else
+    return -1;
+#endif
+}
+
+/**
+ * Modo headless: projeto --headless [frames] [--out dir] [--size LxA] [--capture-every N] [--realtime]
+ * Avança a física um passo fixo por vez (o carro segue o roteiro de entradas do modo batch),
+ * renderiza offscreen e captura um frame a cada N passos. Sem --out, só mede.
+ * Com --realtime o laço imita a janela: o roteiro vira eventos de tecla pelo relógio real, a
+ * física roda na thread própria (ou no laço, com --single-thread) e a latência entrada->tela é
+ * medida até o glFinish de cada frame.
+ * Com --open-world o roteiro é acelerar em linha reta (quilômetros de chão novo) e o resumo
+ * mostra blocos gerados, custo do chão por frame e a memória residente ao longo do percurso.
+ */
+int runHeadlessMode(int argc, char **argv) {
+#ifndef HEADLESS_EGL
+    if(!useSoftRaster) {
+        fprintf(stderr, "Modo headless indisponivel: compile com -DHEADLESS_EGL e -lEGL (ou use --soft-raster).\n");
+        return 1;
+    }
+#endif
+    int frames = (argc > 2 && argv[2][0] != '-') ? atoi(argv[2]) : 240;
+    int w = 1000, h = 700, every = 1;
+    bool realtime = false;
+    std::string outDir;
+    for(int i=2;i+1<argc;i++){
+        if(strcmp(argv[i], "--out") == 0) outDir = argv[i+1];
+        if(strcmp(argv[i], "--size") == 0) sscanf(argv[i+1], "%dx%d", &w, &h);
+        if(strcmp(argv[i], "--capture-every") == 0) every = std::max(1, atoi(argv[i+1]));
+    }
+    for(int i=2;i<argc;i++) if(strcmp(argv[i], "--realtime") == 0) realtime = true;
+    if(useImmediateMode) {
+        fprintf(stderr, "O modo imediato usa glutSolid* e precisa de janela; ignorando --immediate.\n");
+        useImmediateMode = false;
+    }
+    if(useSoftRaster) {
+        // Sem contexto GL: o frame sai de soft.color.
+        initScene();
+        winW = w; winH = h;
+        printf("Headless: rasterizador por software, %d threads\n", soft.threads);
+    } else {
+#ifdef HEADLESS_EGL
+        if(!createHeadlessContext()) { fprintf(stderr, "Falha ao criar contexto EGL headless.\n"); return 1; }
+        printf("Headless: %s | %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+#endif
+        initScene();
+        if(!createOffscreenFramebuffer(w, h)) { fprintf(stderr, "Framebuffer offscreen indisponivel.\n"); return 1; }
+        reshape(w, h);
+    }
+
+    FrameWriter writer;
+    if(!outDir.empty()) {
+        std::filesystem::create_directories(outDir);
+        writer.start(outDir, w, h, 16);
+    }
+    AsyncReadback readback;
+    if(!useSoftRaster) readback.init(w, h);
+
+    const float step = 1.0f / physicsHz;
+    const int inBits[4] = {IN_UP, IN_DOWN, IN_LEFT, IN_RIGHT};
+    const int inKeys[4] = {GLUT_KEY_UP, GLUT_KEY_DOWN, GLUT_KEY_LEFT, GLUT_KEY_RIGHT};
+    unsigned char held = 0;
+    auto scriptInput = [](long long s) { return openWorld ? IN_UP : batchInputFor(0, (int)s); };
+    double simMs = 0, renderMs = 0, captureMs = 0, groundMaxMs = 0, softGeometryMs = 0, softRasterMs = 0;
+    long rssWarm = -1, rssMax = -1;
+    long long stepIndex = 0;
+    if(realtime && simThreadEnabled) startSimThread();
+    auto t0 = std::chrono::steady_clock::now(), last = t0;
+    for(int f=0;f<frames;f++){
+        auto a = std::chrono::steady_clock::now();
+        if(realtime) {
+            // Roteiro pelo relógio real: cada mudança vira evento, como nos callbacks do GLUT.
+            unsigned char in = scriptInput((long long)(std::chrono::duration<double>(a - t0).count() * physicsHz));
+            for(int k=0;k<4;k++)
+                if((in ^ held) & inBits[k]) pushInputEvent(in & inBits[k] ? EV_SPECIAL_DOWN : EV_SPECIAL_UP, inKeys[k]);
+            held = in;
+            if(!simThreadRunning) advanceSimulation(std::chrono::duration<double>(a - last).count());
+            last = a;
+        } else {
+            for(int k=0;k<every;k++, stepIndex++){
+                unsigned char in = scriptInput(stepIndex);
+                keyUp = (in & IN_UP) != 0; keyDown = (in & IN_DOWN) != 0;
+                keyLeft = (in & IN_LEFT) != 0; keyRight = (in & IN_RIGHT) != 0;
+                advanceSimulation(step); // Exatamente um passo fixo.
+            }
+        }
+        auto b = std::chrono::steady_clock::now();
+        const SimSnapshot &snap = renderScene(false);
+        if(realtime) {
+            if(!useSoftRaster) glFinish(); // Sem janela, "na tela" = GPU terminou o frame.
+            inputLatency.presented(snap.inputsApplied, std::chrono::steady_clock::now());
+        }
+        auto c = std::chrono::steady_clock::now();
+        if(!outDir.empty()) {
+            if(useSoftRaster) writer.submit(f, (const unsigned char*)soft.color.data());
+            else readback.capture(writer, f);
+        }
+        softGeometryMs += soft.geometryMs;
+        softRasterMs += soft.rasterMs;
+        auto d = std::chrono::steady_clock::now();
+        simMs += std::chrono::duration<double, std::milli>(b - a).count();
+        renderMs += std::chrono::duration<double, std::milli>(c - b).count();
+        captureMs += std::chrono::duration<double, std::milli>(d - c).count();
+        if(openWorld) {
+            groundMaxMs = std::max(groundMaxMs, ground.updateMs);
+            if(f % 100 == 99) {
+                long kb = residentKB();
+                if(rssWarm < 0 && f >= frames / 10) rssWarm = kb;
+                rssMax = std::max(rssMax, kb);
+            }
+        }
+    }
+    if(!useSoftRaster) {
+        if(!outDir.empty()) readback.flush(writer);
+        glFinish();
+    }
+    double totalSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    writer.finish();
+    bool threaded = simThreadRunning;
+    stopSimThread();
+    if(realtime) stepIndex = llround(simTime * physicsHz);
+
+    // Passo do chão isolado, da última câmera e com glFinish: mede a amostragem da textura.
+    double groundPassMs = 0;
+    if(!openWorld && !useSoftRaster) {
+        const int reps = 50;
+        auto g0 = std::chrono::steady_clock::now();
+        for(int r=0;r<reps;r++){
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawGroundRetained();
+            glFinish();
+        }
+        groundPassMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g0).count() / reps;
+    }
+
+    printf("  %d frames %dx%d, %lld passos de %.2f ms, %.1f frames/s\n", frames, w, h, stepIndex, step * 1000.0f, frames / totalSec);
+    printf("  por frame: fisica %.3f ms, render %.3f ms, captura %.3f ms (PBO %s)\n",
+           simMs / frames, renderMs / frames, captureMs / frames,
+           useSoftRaster ? "dispensado, frame na memoria" : glHasPBO ? "duplo" : "indisponivel");
+    if(useSoftRaster)
+        printf("  software: %d threads, %lld triangulos/frame, geometria %.3f ms, rasterizacao %.3f ms por frame\n",
+               soft.threads, soft.triangles, softGeometryMs / frames, softRasterMs / frames);
+    printf("  asfalto %dx%d: 1 canal + %d mipmaps, %.1f KB (RGB sem mipmaps: %.1f KB), %s em %.1f ms\n",
+           asphaltTexSize, asphaltTexSize, asphaltMipmaps ? mipLevelCount(asphaltTexSize) - 1 : 0, asphaltTexBytes / 1024.0,
+           3.0 * asphaltTexSize * asphaltTexSize / 1024.0, asphaltTexCached ? "lido do cache" : "gerado", asphaltTexMs);
+    if(!openWorld && !useSoftRaster) printf("  passo do chao isolado: %.3f ms (%s)\n", groundPassMs, asphaltFilterName());
+    if(!outDir.empty()) printf("  gravados %ld, descartados %ld, falhas %ld em %s\n", writer.written, writer.dropped,
+                               writer.failed, outDir.c_str());
+    if(realtime) {
+        const LatencyProbe &lp = inputLatency;
+        printf("  simulacao %s: latencia entrada->frame p50 %.2f ms, p95 %.2f ms, max %.2f ms (%lld eventos)\n",
+               threaded ? "em thread propria" : "no laco de render", lp.p50, lp.p95, lp.maxMs, lp.samples);
+    }
+    if(openWorld) {
+        printf("  mundo aberto: %.2f km percorridos, %lld blocos gerados, %lld reaproveitados, %d no cache (%d MB)\n",
+               hypotf(car.x - course.startX, car.z - course.startZ) / 1000.0f, ground.generated, ground.evicted,
+               (int)ground.slots.size(), groundCacheMB);
+        printf("  chao no thread do desenho: max %.3f ms/frame; memoria residente %ld KB apos aquecer, max %ld KB\n",
+               groundMaxMs, rssWarm, rssMax);
+    }
+    return writer.failed == 0 ? 0 : 1;
+}
+
+/**
+ * Benchmark do rasterizador: projeto --bench-raster [frames]
+ * Desenha a cena inicial (sem HUD) com o GL do contexto headless e com o rasterizador por
+ * software em algumas resoluções, medindo frames/s de cada um (o GL com glFinish por frame) e a
+ * diferença média por canal entre as duas imagens.
+ */
+int runRasterBenchmark(int argc, char **argv) {
+#ifndef HEADLESS_EGL
+    (void)argc; (void)argv;
+    fprintf(stderr, "Benchmark do rasterizador indisponivel: compile com -DHEADLESS_EGL e -lEGL.\n");
+    return 1;
+#else
+    int frames = (argc > 2 && argv[2][0] != '-') ? std::max(1, atoi(argv[2])) : 30;
+    if(!createHeadlessContext()) { fprintf(stderr, "Falha ao criar contexto EGL headless.\n"); return 1; }
+    useSoftRaster = useImmediateMode = false;
+    initScene();
+    initSoftRaster();
+    printf("Rasterizador: GL %s contra software (%d threads, textura %s), %d frames por medida\n",
+           (const char*)glGetString(GL_RENDERER), soft.threads, asphaltFilterName(), frames);
+    printf("  %-10s %12s %12s %8s %10s %10s\n", "resolucao", "GL q/s", "software q/s", "razao", "dif. media", "pixels >8");
+    const int sizes[][2] = {{640, 360}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    std::vector<unsigned char> glFrame;
+    for(const auto &sz : sizes){
+        int w = sz[0], h = sz[1];
+        if(!createOffscreenFramebuffer(w, h)) { fprintf(stderr, "Framebuffer offscreen indisponivel.\n"); return 1; }
+        reshape(w, h);
+        double fps[2];
+        for(int mode=0;mode<2;mode++){
+            useSoftRaster = mode == 1;
+            renderScene(false); // Aquece (buffers do frame, caches).
+            if(!useSoftRaster) glFinish();
+            auto t0 = std::chrono::steady_clock::now();
+            for(int f=0;f<frames;f++){
+                renderScene(false);
+                if(!useSoftRaster) glFinish();
+            }
+            fps[mode] = frames / std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            if(!useSoftRaster) {
+                glFrame.resize((size_t)w * h * 4);
+                glPixelStorei(GL_PACK_ALIGNMENT, 1);
+                glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, glFrame.data());
+            }
+        }
+        useSoftRaster = false;
+        const unsigned char *sp = (const unsigned char*)soft.color.data();
+        double diff = 0;
+        long far = 0;
+        for(size_t p=0;p<(size_t)w * h;p++){
+            int worst = 0;
+            for(int c=0;c<3;c++){
+                int d = abs((int)glFrame[p * 4 + c] - (int)sp[p * 4 + c]);
+                diff += d;
+                worst = std::max(worst, d);
+            }
+            far += worst > 8;
+        }
+        char res[16];
+        snprintf(res, sizeof(res), "%dx%d", w, h);
+        printf("  %-10s %12.1f %12.1f %7.2fx %10.2f %9.2f%%\n", res, fps[0], fps[1], fps[1] / fps[0],
+               diff / (3.0 * w * h), 100.0 * far / ((double)w * h));
+    }
+    return 0;
+#endif
+}
+
+// ----------------------- Suíte de benchmarks -------------------------------------
+//
+// projeto --bench-suite [--json bench.json] [--label texto] roda os pontos quentes com
+// entradas fixas e grava o resultado em JSON, para comparar entre commits: física (um carro
+// por updatePhysics e stepCar, lote SoA), geração do asfalto e dos mipmaps, montagem e colisão
+// dos cones em escala e o renderScene() do display() com N cones (software e, com
+// -DHEADLESS_EGL, GL). Cada medida repete a operação até ~0,2 s, três vezes, e fica com a
+// melhor. As alocações por operação só são contadas compilando com -DBENCH_ALLOC=1, que troca o
+// operator new global por um que conta; sem ele as colunas de alocação saem vazias (null no JSON)
+// e os outros modos não pagam os contadores atômicos.
+
+#ifndef BENCH_ALLOC
+#define BENCH_ALLOC 0
+#endif
+
+#if BENCH_ALLOC
+// Alocações no heap desde o início (contadores relaxados).
+std::atomic<long long> heapAllocs{0}, heapAllocBytes{0};
+
+// O GCC vê free() sobre um ponteiro de operator new depois de expandir os dois, mas aqui os pares
+// são os substitutos abaixo, que usam malloc/free.
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t n) {
+    heapAllocs.fetch_add(1, std::memory_order_relaxed);
+    heapAllocBytes.fetch_add((long long)n, std::memory_order_relaxed);
+    if(void *p = malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t n) { return operator new(n); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+// Resultado de uma medida; 'item' é a unidade de trabalho (passo, texel, cone, frame).
+struct BenchResult {
+    std::string name, item;
+    double itemsPerOp = 1.0;
+    long long iterations = 0;
+    double nsPerOp = 0.0;
+    double allocsPerOp = -1.0, bytesPerOp = -1.0;   // Negativos: não contados (sem BENCH_ALLOC).
+};
+
+/**
+ * Mede 'op' (que processa 'itemsPerOp' itens): uma execução de aquecimento calibra quantas
+ * cabem em ~0,2 s e a melhor de três rodadas vale. Imprime a linha da tabela.
+ */
+template<class F>
+BenchResult runBench(std::vector<BenchResult> &out, const std::string &name, const char *item, double itemsPerOp, F op) {
+    BenchResult r;
+    r.name = name;
+    r.item = item;
+    r.itemsPerOp = itemsPerOp;
+    auto a = std::chrono::steady_clock::now();
+    op();
+    double once = std::chrono::duration<double>(std::chrono::steady_clock::now() - a).count();
+    r.iterations = std::max(1LL, std::min(1000000LL, (long long)(0.2 / std::max(once, 1e-9))));
+    r.nsPerOp = 1e30;
+    for(int rep=0;rep<3;rep++){
+#if BENCH_ALLOC
+        long long allocs = heapAllocs.load(), bytes = heapAllocBytes.load();
+#endif
+        auto t0 = std::chrono::steady_clock::now();
+        for(long long i=0;i<r.iterations;i++) op();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / r.iterations;
+        r.nsPerOp = std::min(r.nsPerOp, ns);
+#if BENCH_ALLOC
+        r.allocsPerOp = (double)(heapAllocs.load() - allocs) / r.iterations;
+        r.bytesPerOp = (double)(heapAllocBytes.load() - bytes) / r.iterations;
+#endif
+    }
+    if(r.allocsPerOp >= 0)
+        printf("  %-28s %14.1f %14.3g %-7s %10.2f %12.0f\n", r.name.c_str(), r.nsPerOp,
+               itemsPerOp * 1e9 / r.nsPerOp, item, r.allocsPerOp, r.bytesPerOp);
+    else
+        printf("  %-28s %14.1f %14.3g %-7s %10s %12s\n", r.name.c_str(), r.nsPerOp,
+               itemsPerOp * 1e9 / r.nsPerOp, item, "-", "-");
+    fflush(stdout);
+    out.push_back(r);
+    return r;
+}
+
+// Texto entre aspas para o JSON.
+std::string jsonString(const std::string &s) {
+    std::string o = "\"";
+    for(char c : s){
+        if(c == '"' || c == '\\') { o += '\\'; o += c; }
+        else if((unsigned char)c < 0x20) { char b[8]; snprintf(b, sizeof(b), "\\u%04x", c); o += b; }
+        else o += c;
+    }
+    return o + "\"";
+}
+
+// Espalha 'n' cones numa grade sobre o trecho do chão diante da câmera inicial.
+void setupConeField(int n) {
+    cones.clear();
+    int side = (int)ceil(sqrt((double)n));
+    for(int i=0;i<n;i++){
+        float fx = (i % side + 0.5f) / side, fz = (i / side + 0.5f) / side;
+        cones.emplace_back(-8.0f + 16.0f * fx, 6.0f - 30.0f * fz);
+    }
+    rebuildConeGrid();
+}
+
+/**
+ * Suíte de benchmarks: projeto --bench-suite [--json bench.json] [--label texto]
+ */
+int runBenchSuite(int argc, char **argv) {
+    std::string jsonPath = "bench.json", label;
+    for(int i=2;i+1<argc;i++){
+        if(strcmp(argv[i], "--json") == 0) jsonPath = argv[i+1];
+        if(strcmp(argv[i], "--label") == 0) label = argv[i+1];
+    }
+    int hw = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<BenchResult> results;
+    printf("Suite de benchmarks (%d threads, SIMD de %d faixas)\n", hw, SIMD_W);
+    printf("  %-28s %14s %22s %10s %12s\n", "medida", "ns/op", "itens/s", "aloc/op", "bytes/op");
+
+    // Física: o carro da cena segue o roteiro do lote (cones derrubados ficam no chão).
+    setupConesStraightCorridor();
+    resetCarAndCones();
+    long long step = 0;
+    runBench(results, "fisica/updatePhysics", "passo", 1, [&]() {
+        CarInput in = inputFromFlags(batchInputFor(0, (int)(step++ % 100000)));
+        keyUp = in.up; keyDown = in.down; keyLeft = in.left; keyRight = in.right;
+        updatePhysics(1.0f / physicsHz);
+    });
+    Car solo;
+    step = 0;
+    runBench(results, "fisica/stepCar", "passo", 1, [&]() {
+        stepCar(solo, inputFromFlags(batchInputFor(0, (int)(step++ % 100000))), DEFAULT_CAR_PARAMS, 1.0f / physicsHz);
+    });
+    const int batchCars = 100000, batchSteps = 10;
+    CarBatch batch;
+    setupBatchSweep(batch, batchCars);
+    runBench(results, "fisica/lote_100k", "passo", (double)batchCars * batchSteps, [&]() {
+        runCarBatch(batch, batchSteps, 1.0f / physicsHz, hw);
+    });
+
+    // Textura do asfalto (um canal, como a cena a usa) e a cadeia de mipmaps.
+    for(int size : {256, 1024, 4096}){
+        std::vector<unsigned char> chain(mipChainBytes(size));
+        runBench(results, "asfalto/gerar_" + std::to_string(size), "texel", (double)size * size, [&]() {
+            generateAsphaltProc(chain.data(), size, asphaltSeed, 1);
+        });
+        runBench(results, "asfalto/mipmaps_" + std::to_string(size), "texel", (double)size * size, [&]() {
+            buildMipChain(chain.data(), size);
+        });
+    }
+
+    // Cones: montagem da grade do zero e colisão do carro num campo denso.
+    for(int n : {1000, 100000, 1000000}){
+        std::vector<std::pair<float,float>> field(n);
+        float half = sqrtf(n * 4.0f) * 0.5f;
+        for(int i=0;i<n;i++)
+            field[i] = std::make_pair((asphaltHash(7, (unsigned)i, 0) / 4294967296.0f * 2.0f - 1.0f) * half,
+                                      (asphaltHash(11, (unsigned)i, 0) / 4294967296.0f * 2.0f - 1.0f) * half);
+        char name[64];
+        snprintf(name, sizeof(name), "cones/montagem_%d", n);
+        runBench(results, name, "cone", n, [&]() {
+            cones.clear();
+            for(const auto &c : field) cones.emplace_back(c.first, c.second);
+            rebuildConeGrid();
+        });
+        std::vector<Car> path(2000);
+        Car c;
+        for(Car &p : path){ stepCar(c, CarInput{true, false, true, false}, DEFAULT_CAR_PARAMS, 1.0f / 240); p = c; }
+        std::vector<ConeHit> hits;
+        size_t k = 0;
+        snprintf(name, sizeof(name), "cones/colisao_%d", n);
+        runBench(results, name, "passo", 1, [&]() {
+            queryConeHits(coneGrid, cones.data(), path[k++ % path.size()], hits);
+        });
+    }
+
+    // Desenho: renderScene() do display(), sem HUD, em 1280x720 com N cones.
+    const int w = 1280, h = 720;
+    std::string renderer = "software";
+    bool haveGL = false;
+#ifdef HEADLESS_EGL
+    haveGL = createHeadlessContext();
+    if(haveGL) renderer = (const char*)glGetString(GL_RENDERER);
+#endif
+    useImmediateMode = false;
+    useSoftRaster = !haveGL;
+    resetCarAndCones();
+    initScene();
+    if(haveGL) {
+        initSoftRaster();
+        haveGL = createOffscreenFramebuffer(w, h);
+        if(haveGL) reshape(w, h);
+    }
+    winW = w; winH = h;
+    for(int n : {100, 1000, 10000}){
+        setupConeField(n);
+        for(int mode = haveGL ? 0 : 1; mode < 2; mode++){
+            useSoftRaster = mode == 1;
+            char name[64];
+            snprintf(name, sizeof(name), "render/%s_%dcones", useSoftRaster ? "software" : "gl", n);
+            runBench(results, name, "frame", 1, [&]() {
+                renderScene(false);
+                if(!useSoftRaster) glFinish();
+            });
+        }
+    }
+    useSoftRaster = false;
+
+    FILE *fp = fopen(jsonPath.c_str(), "w");
+    if(!fp) { fprintf(stderr, "Nao foi possivel criar %s\n", jsonPath.c_str()); return 1; }
+    char date[32];
+    time_t now = time(NULL);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(fp, "{\n  \"label\": %s,\n  \"date\": \"%s\",\n  \"compiler\": %s,\n", jsonString(label).c_str(), date,
+            jsonString(__VERSION__).c_str());
+    fprintf(fp, "  \"threads\": %d,\n  \"simd_width\": %d,\n  \"renderer\": %s,\n  \"benchmarks\": [\n", hw, SIMD_W,
+            jsonString(renderer).c_str());
+    for(size_t i=0;i<results.size();i++){
+        const BenchResult &r = results[i];
+        char allocs[32] = "null", bytes[32] = "null";
+        if(r.allocsPerOp >= 0) {
+            snprintf(allocs, sizeof(allocs), "%.3f", r.allocsPerOp);
+            snprintf(bytes, sizeof(bytes), "%.1f", r.bytesPerOp);
+        }
+        fprintf(fp, "    {\"name\": %s, \"item\": %s, \"items_per_op\": %.0f, \"iterations\": %lld, \"ns_per_op\": %.3f, "
+                    "\"ops_per_s\": %.6g, \"items_per_s\": %.6g, \"allocs_per_op\": %s, \"bytes_per_op\": %s}%s\n",
+                jsonString(r.name).c_str(), jsonString(r.item).c_str(), r.itemsPerOp, r.iterations, r.nsPerOp,
+                1e9 / r.nsPerOp, r.itemsPerOp * 1e9 / r.nsPerOp, allocs, bytes,
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+    printf("Resultados em %s\n", jsonPath.c_str());
+    return 0;
+}
+
+// ----------------------- Main ------------------------------------
+
+int main(int argc, char** argv) {
+    // Modos sem janela (tratados antes de glutInit).
+    if(argc > 1 && strcmp(argv[1], "--batch") == 0) return runBatchMode(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "--bench-asphalt") == 0) return runAsphaltBenchmark();
+    if(argc > 1 && strcmp(argv[1], "--bench-cones") == 0) return runConeBenchmark();
+    if(argc > 1 && strcmp(argv[1], "--bench-planner") == 0) return runPlannerBenchmark(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "--bench-rewind") == 0) return runRewindBenchmark(argc, argv);
+    if(argc > 3 && strcmp(argv[1], "--course-convert") == 0) return runCourseConvert(argv[2], argv[3]);
+    if(argc > 2 && strcmp(argv[1], "--course-info") == 0) return runCourseInfo(argv[2]);
+    if(argc > 3 && strcmp(argv[1], "--telemetry-csv") == 0) return runTelemetryCsv(argv[2], argv[3]);
+    if(argc > 1 && strcmp(argv[1], "--bake-meshes") == 0) return runMeshBake(argc > 2 ? argv[2] : meshFilePath);
+
+    // --hz N: frequência do passo fixo de física; --tex N / --seed N / --tex-cache pasta: textura do asfalto.
+    for(int i=1;i+1<argc;i++){
+        if(strcmp(argv[i], "--hz") == 0 && atoi(argv[i+1]) > 0) physicsHz = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--tex") == 0 && atoi(argv[i+1]) > 0) asphaltTexSize = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--seed") == 0) asphaltSeed = (unsigned)strtoul(argv[i+1], NULL, 10);
+        if(strcmp(argv[i], "--tex-cache") == 0) texCacheDir = argv[i+1];
+        if(strcmp(argv[i], "--course") == 0 && !loadCourseFile(argv[i+1])) return 1;
+        if(strcmp(argv[i], "--plan-threads") == 0) plannerThreads = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--record") == 0) telemetryPath = argv[i+1];
+        if(strcmp(argv[i], "--replay") == 0 && !loadReplay(argv[i+1])) return 1;
+        if(strcmp(argv[i], "--ground-cache-mb") == 0 && atoi(argv[i+1]) > 0) groundCacheMB = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--meshes") == 0) meshFilePath = argv[i+1];
+        if(strcmp(argv[i], "--rewind-sec") == 0 && atoi(argv[i+1]) > 0) rewindSeconds = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--soft-threads") == 0) softThreads = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--eval-rollouts") == 0 && atoi(argv[i+1]) > 0) evalRollouts = atoi(argv[i+1]);
+        if(strcmp(argv[i], "--eval-threads") == 0) evalThreads = atoi(argv[i+1]);
+    }
+    if(replay.physicsHz > 0) physicsHz = replay.physicsHz;
+    for(int i=1;i<argc;i++){
+        if(strcmp(argv[i], "--immediate") == 0) useImmediateMode = true;
+        if(strcmp(argv[i], "--no-instancing") == 0) allowInstancing = false;
+        if(strcmp(argv[i], "--legacy-hud") == 0) legacyHud = true;
+        if(strcmp(argv[i], "--no-cull") == 0) allowCulling = false;
+        if(strcmp(argv[i], "--no-mipmaps") == 0) asphaltMipmaps = false;
+        if(strcmp(argv[i], "--trilinear") == 0) asphaltTrilinear = true;
+        if(strcmp(argv[i], "--autopark") == 0) autoParkAtStart = true;
+        if(strcmp(argv[i], "--single-thread") == 0) simThreadEnabled = false;
+        if(strcmp(argv[i], "--open-world") == 0) openWorld = followCar = true;
+        if(strcmp(argv[i], "--soft-raster") == 0) useSoftRaster = true;
+    }
+    if(useSoftRaster && openWorld) {
+        fprintf(stderr, "O mundo aberto usa o chao em blocos do GL; ignorando --soft-raster.\n");
+        useSoftRaster = false;
+    }
+#if PROFILER
+    for(int i=1;i+1<argc;i++)
+        if(strcmp(argv[i], "--profile-csv") == 0) prof.csvPath = argv[i+1];
+#endif
+    if(argc > 1 && strcmp(argv[1], "--headless") == 0) return runHeadlessMode(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "--bench-raster") == 0) return runRasterBenchmark(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "--bench-suite") == 0) return runBenchSuite(argc, argv);
+    if(argc > 1 && strcmp(argv[1], "--eval-course") == 0) return runCourseEvalBenchmark(argc, argv);
+
+    // Inicialização do GLUT/FreeGLUT
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH); // Double buffer, cor RGB, buffer de profundidade.
+    glutInitWindowSize(WIN_W, WIN_H);
+    glutCreateWindow("Baliza - Asfalto Procedural, Cones, Carro e Camera");
+
+    // Estado do OpenGL e da cena
+    initScene();
+    if(!legacyHud) initHudAtlas();
 
     // Configura os callbacks (funções que serão chamadas em eventos)
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
-    glutKeyboardFunc(keyboardDown);  // Teclas regulares pressionadas
-    glutKeyboardUpFunc(keyboardUp);  // Teclas regulares liberadas
-    glutSpecialFunc(specialDown);    // Teclas especiais (setas) pressionadas
-    glutSpecialUpFunc(specialUp);    // Teclas especiais (setas) liberadas
+    glutKeyboardFunc(keyboardDown);  // Teclas regulares pressionadas
+    glutKeyboardUpFunc(keyboardUp);  // Teclas regulares liberadas
+    glutSpecialFunc(specialDown);    // Teclas especiais (setas) pressionadas
+    glutSpecialUpFunc(specialUp);    // Teclas especiais (setas) liberadas
 
-    // Inicia o loop do timer (animação)
-    glutTimerFunc(16, timerFunc, 0);
+    // Inicia a simulação (thread própria ou no loop do GLUT) e o redesenho no ritmo do vsync
+    if(simThreadEnabled) startSimThread();
+    enableVsync();
+    glutIdleFunc(idleFunc);
 
     // Inicia o loop principal do FreeGLUT (mantém a janela aberta e processa eventos)
     glutMainLoop();
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file